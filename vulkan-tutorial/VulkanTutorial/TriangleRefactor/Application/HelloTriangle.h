@@ -4,8 +4,18 @@
 #include <glm\glm.hpp>
 #include <glm\gtc\matrix_transform.hpp>
 #include <array>
+#include <cstddef>
 #include "..\Data\Vertex.h"
 #include "..\Builders\BufferInfoBuilder.h"
+#include "..\Systems\Descriptors\DynamicUniformAllocator.h"
+#include "..\Systems\Rendering\MaterialSystem.h"
+#include "..\Systems\Rendering\RenderQueue.h"
+#include "..\Systems\Rendering\IndirectDrawList.h"
+#include "..\Systems\Rendering\InstanceStream.h"
+#include "..\Systems\Culling\GpuCulling.h"
+#include "..\Systems\Culling\DepthPyramid.h"
+#include "..\Systems\Scene\TransformHierarchy.h"
+#include "..\Systems\Scene\Renderables.h"
 #include <chrono>
 using namespace std;
 
@@ -16,129 +26,277 @@ using namespace std;
 /// Sky (clear)
 /// </summary>
 
-struct UniformBufferObject {
-	glm::mat4 model;
+struct FrameUniforms {
 	glm::mat4 view;
 	glm::mat4 projection;
 };
 
+struct DrawUniforms {
+	glm::mat4 model;
+};
+
+struct MaterialParameters {
+	glm::vec4 tint;
+};
+
+// Everything in the frame set, pushed once per command buffer through frameTemplate.
+struct FrameDescriptors {
+	VkDescriptorBufferInfo frame;
+};
+
+struct DrawConstants {
+	uint32_t frameIndex;
+};
+
 class HelloTriangle : public VulkanApplication {
 public:
 	HelloTriangle(shared_ptr<IVulkanGraphicsSystem> graphicsSystem) : VulkanApplication(graphicsSystem)
 	{
-
+		graphicsSystem->EnableBindless(1024, 1024);
+		triangleTransform = transforms.Create(glm::mat4());
+		paneTransform = transforms.Create(glm::translate(glm::mat4(), glm::vec3(0.0f, 0.0f, 0.25f)));
 	}
 
 	~HelloTriangle()
 	{
-
+		uniforms.Cleanup();
+		frameTemplate.Cleanup();
+		frameBuffer.Destroy(graphicsSystem->GetDevice());
+		instanceStream.Cleanup();
+		culling.Cleanup();
+		depthPyramid.Cleanup();
+		drawList.Cleanup();
+		materials.Cleanup();
 	}
 protected:
 	virtual void Update() override {
 		updateUniformBuffer();
+
+		// A click picks what is under the cursor, on the press rather than for as long as the button is held.
+		bool pressed = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+		if (pressed && !mousePressed) {
+			double cursorX, cursorY;
+			glfwGetCursorPos(window, &cursorX, &cursorY);
+			pick(glm::vec2(static_cast<float>(cursorX), static_cast<float>(cursorY)));
+		}
+		mousePressed = pressed;
+	}
+
+	virtual void UpdateFrame(uint32_t frame) override {
+		materials.Update(frame);
+		if (!indirect) {
+			buildRenderQueue();
+		}
+		writeFrameData(frame);
 	}
 
 	virtual void CreateGraphicsPipeline(VkDevice device) override {
+		if (!materials.IsInitialized()) {
+			materials.Initialize(graphicsSystem.get());
+		}
+
+		auto bindless = graphicsSystem->GetBindlessTable();
+		std::vector<std::string> defines;
+		if (bindless) {
+			defines.push_back("BINDLESS");
+		}
+		// Draws come from a GPU draw list wherever the device can issue them that way.
+		indirect = graphicsSystem->GetIndirectDrawSupport().Supported();
+		if (indirect) {
+			defines.push_back("INDIRECT");
+		}
+
+		PipelineReflection reflection;
 		auto shaderStages = graphicsSystem->CreateShaderStages({
-			ShaderStage(VK_SHADER_STAGE_VERTEX_BIT, "shaders/uniforms/uniforms.vert.spv"),
-			ShaderStage(VK_SHADER_STAGE_FRAGMENT_BIT, "shaders/uniforms/uniforms.frag.spv"),
-		});
-
-		auto bindingDescription = Vertex::getBindingDescription();
-		auto attributeDescriptions = Vertex::getAttributeDescriptions();
-
-		auto vertexInput = VertexInputBuilder()
-			.WithBindings(&bindingDescription, 1)
-			->WithAttributes(attributeDescriptions.data(), attributeDescriptions.size())
-			->Build();
-
-		VkDescriptorSetLayoutBinding uboLayoutBinding = {};
-		uboLayoutBinding.binding = 0;
-		uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		uboLayoutBinding.descriptorCount = 1;
-		uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-		uboLayoutBinding.pImmutableSamplers = nullptr;
-
-		VkDescriptorSetLayoutCreateInfo layoutInfo = {};
-		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-		layoutInfo.bindingCount = 1;
-		layoutInfo.pBindings = &uboLayoutBinding;
-
-
-		vkOk(vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout));
-
-		VkDescriptorSetLayout setLayouts[] = { descriptorSetLayout };
-		VkPipelineLayoutCreateInfo pipelineLayoutInfo = PipelineLayoutBuilder(1, setLayouts)
-			.Build();
+			ShaderStage(VK_SHADER_STAGE_VERTEX_BIT, "shaders/uniforms/uniforms.vert", defines),
+			ShaderStage(VK_SHADER_STAGE_FRAGMENT_BIT, "shaders/uniforms/uniforms.frag"),
+		}, &reflection);
+
+		// Without a draw list each instance's transform comes from the instance stream.
+		VertexLayoutBuilder vertexLayoutBuilder;
+		vertexLayoutBuilder.WithStream<Vertex>(0);
+		if (!indirect) {
+			vertexLayoutBuilder.WithStream<InstanceTransform>(InstanceBinding);
+		}
+		auto vertexLayout = vertexLayoutBuilder.Build(reflection);
+		auto vertexInput = vertexLayout.Build();
+
+		reflection.MakeDynamic(MaterialSet, 0);
+
+		auto setLayouts = graphicsSystem->GetDescriptorSetLayouts(reflection);
+		if (bindless) {
+			// The bindless set replaces the reflected one, its arrays are sized by the table rather than the shader.
+			setLayouts[FrameSet] = bindless->GetSetLayout();
+		}
+		else {
+			// Frame data is pushed rather than kept in a set, the frame's slice changes with every command buffer.
+			frameSetLayout = graphicsSystem->GetPushDescriptorSetLayout(reflection.SetLayoutBindings()[FrameSet]);
+			setLayouts[FrameSet] = frameSetLayout;
+		}
+		passSetLayout = setLayouts[PassSet];
 
 		auto graphicsPipeline = graphicsSystem->StartGraphicsPipeline(vertexInput, shaderStages)
-			->WithPipelineLayout(pipelineLayoutInfo)
+			->WithPipelineLayout(setLayouts, reflection.PushConstantRanges())
 			->Create();
 
 		graphicsSystem->SetGraphicsPipeline(graphicsPipeline.pipeline);
+		if (!bindless) {
+			frameTemplate.WithBuffer(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, offsetof(FrameDescriptors, frame))
+				->InitializeForPush(graphicsSystem->GetDevice(), graphicsSystem->GetDescriptorFunctions(), VK_PIPELINE_BIND_POINT_GRAPHICS,
+					graphicsSystem->GetPipelineLayout(), FrameSet);
+		}
+		vertexColorMaterial = materials.CreateTemplate("vertexColor", graphicsPipeline, graphicsSystem->GetPipelineLayout(),
+			setLayouts[MaterialSet], sizeof(MaterialParameters));
+
+		// The draw list only holds opaque draws, blended ones need the queue's back to front order. They read the same
+		// shaders and test depth without writing it, so panes further back still show through nearer ones.
+		if (!indirect) {
+			auto blendAttachment = ColorBlendAttachmentStateBuilder().EnableBlend()
+				->WithSourceColorBlendFactor(VK_BLEND_FACTOR_SRC_ALPHA)
+				->WithDistColorBlendFactor(VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA)
+				->Build();
+			auto blendedPipeline = graphicsSystem->StartGraphicsPipeline(vertexInput, shaderStages)
+				->WithPipelineLayout(setLayouts, reflection.PushConstantRanges())
+				->WithColorBlendState(ColorBlendStateBuilder(&blendAttachment, 1).Build())
+				->WithDepthStencilState(DepthStencilStateBuilder().DisableDepthWrite()->Build())
+				->Create();
+			glassMaterial = materials.CreateTemplate("vertexColorBlended", blendedPipeline, graphicsSystem->GetPipelineLayout(),
+				setLayouts[MaterialSet], sizeof(MaterialParameters), true);
+		}
 
 		//auto graphicsPipeline = graphicsSystem->CreateGraphicsPipeline(vertexInput, shaderStages, pipelineLayoutInfo);
 		//graphicsSystem->SetGraphicsPipeline(graphicsPipeline);
 	}
 
+	virtual void CreatePrePassCommands(VkCommandBuffer commandBuffer) override {
+		if (indirect) {
+			// A resize recreates the depth buffer, and with it the pyramid the culling reads.
+			if (depthPyramid.Prepare()) {
+				culling.SetPyramid(depthPyramid);
+			}
+			culling.Dispatch(commandBuffer, graphicsSystem->GetRecordingFrame());
+		}
+	}
+
+	virtual void CreatePostPassCommands(VkCommandBuffer commandBuffer) override {
+		if (indirect) {
+			depthPyramid.Build(commandBuffer);
+		}
+	}
+
 	virtual void CreateDrawCommands(VkCommandBuffer commandBuffer) override {
-		VkBuffer vertexBuffers[] = { vertexBuffer.mainBuffer.buffer , uniformBuffer.mainBuffer.buffer};
-		VkDeviceSize offsets[] = { 0 };
-		vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
-		vkCmdBindIndexBuffer(commandBuffer, indexBuffer.mainBuffer.buffer, 0, VK_INDEX_TYPE_UINT16);
-		auto layout = graphicsSystem->GetPipelineLayout();
-		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 1, &descriptorSet, 0, nullptr);
-		vkCmdDrawIndexed(commandBuffer,indices.size(), 1, 0, 0, 0);
+		auto bindless = graphicsSystem->GetBindlessTable();
+		auto binder = graphicsSystem->CreateDescriptorBinder(commandBuffer);
+		// Each frame's command buffer reads the copy of the per frame data written for that frame.
+		auto frame = graphicsSystem->GetRecordingFrame();
+		auto bindFrameSet = [this, bindless, frame, commandBuffer](DescriptorBinder & binder) {
+			// With bindless the table is the frame set, bound once per command buffer, and the frame's entry is pushed.
+			if (bindless) {
+				binder.Bind(FrameSet, bindless->GetSet());
+				drawConstants.Push(commandBuffer, binder.GetLayout(), { frameIndices[frame] });
+			}
+			else {
+				FrameDescriptors descriptors = { uniforms.FrameInfo(frameUniform, frame) };
+				graphicsSystem->PushDescriptorSet(commandBuffer, frameSetLayout, frameTemplate, &descriptors);
+			}
+		};
+
+		if (indirect) {
+			// The whole list is one material, so the pass costs the same few commands however many objects it holds.
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, materials.GetPipeline(*vertexColorMaterial));
+			binder.UseLayout(vertexColorMaterial->layout);
+			bindFrameSet(binder);
+			auto parameterOffset = materials.ParameterOffset(*triangleMaterial);
+			binder.Bind(MaterialSet, vertexColorMaterial->parameterSet, 1, &parameterOffset);
+			binder.Bind(PassSet, drawListSets[frame]);
+			culling.Draw(commandBuffer, drawList);
+			return;
+		}
+
+		// buildRenderQueue sorted the queue for this frame and wrote the frame's transforms in Instances() order, each
+		// batch starts reading at its firstInstance.
+		instanceStream.Bind(commandBuffer, frame, instanceRange);
+		renderQueue.Record(commandBuffer, binder, materials, bindFrameSet, nullptr);
 	}
 
 	virtual void CreateBuffers() override {
+		// The simplified levels go into the same index buffer, after the full mesh.
+		auto lods = GenerateLods(vertices, indices);
 		auto vertexBufferSize = sizeof(vertices[0]) * vertices.size();
-		auto indexBufferSize = sizeof(indices[0]) * indices.size();
-		auto uniformBufferSize = sizeof(UniformBufferObject);
+		auto indexBufferSize = sizeof(lods.indices[0]) * lods.indices.size();
 
 		vertexBuffer = graphicsSystem->MapToLocalMemory(vertexBufferSize, vertices.data());
-		indexBuffer = graphicsSystem->MapToLocalMemory(indexBufferSize, indices.data());
-		uniformBuffer = graphicsSystem->MapToLocalMemory(uniformBufferSize, &ubo, static_cast<VkBufferUsageFlagBits>(VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT));
-		VkDescriptorPoolSize poolSize = {};
-		poolSize.descriptorCount = 1;
-		poolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-
-		VkDescriptorPoolCreateInfo poolInfo = {};
-		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-		poolInfo.poolSizeCount = 1;
-		poolInfo.pPoolSizes = &poolSize;
-
-		poolInfo.maxSets = 1;
-		vkOk(vkCreateDescriptorPool(graphicsSystem->GetDevice(), &poolInfo, nullptr, &descriptorPool));
-
-		VkDescriptorSetLayout layouts[] = { descriptorSetLayout };
-		VkDescriptorSetAllocateInfo allocInfo = {};
-		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-		allocInfo.descriptorPool = descriptorPool;
-		allocInfo.descriptorSetCount = 1;
-		allocInfo.pSetLayouts = layouts;
-
-		vkOk(vkAllocateDescriptorSets(graphicsSystem->GetDevice(), &allocInfo, &descriptorSet));
-
-		VkDescriptorBufferInfo bufferInfo = {};
-		bufferInfo.buffer = uniformBuffer.mainBuffer.buffer;
-		bufferInfo.offset = 0;
-		bufferInfo.range = sizeof(UniformBufferObject);
-
-		VkWriteDescriptorSet descriptorWrite = {};
-		descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptorWrite.dstSet = descriptorSet;
-		descriptorWrite.dstBinding = 0;
-		descriptorWrite.dstArrayElement = 0;
-
-		descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		descriptorWrite.descriptorCount = 1;
-
-		descriptorWrite.pBufferInfo = &bufferInfo;
-		descriptorWrite.pImageInfo = nullptr;
-		descriptorWrite.pTexelBufferView = nullptr;
-
-		vkUpdateDescriptorSets(graphicsSystem->GetDevice(), 1, &descriptorWrite, 0, nullptr);
+		indexBuffer = graphicsSystem->MapToLocalMemory(indexBufferSize, lods.indices.data());
+		triangleMesh = { vertexBuffer.mainBuffer.buffer, indexBuffer.mainBuffer.buffer, VK_INDEX_TYPE_UINT16,
+			static_cast<uint32_t>(indices.size()), 0, 0, 0 };
+		triangleLods = LodMesh::Create(triangleMesh, lods, 0);
+		triangleMaterial = materials.CreateInstance(vertexColorMaterial, MaterialParameters{ glm::vec4(1.0f) });
+
+		// The triangle spins around its center, so one sphere through its corners bounds every frame.
+		triangle = scene.Create();
+		scene.Add(triangle, TransformComponent{ triangleTransform });
+		scene.Add(triangle, MeshComponent{ &triangleMesh });
+		scene.Add(triangle, LodComponent{ &triangleLods });
+		scene.Add(triangle, MaterialComponent{ triangleMaterial, 0 });
+		scene.Add(triangle, BoundsComponent{ { glm::vec4(0.0f, 0.0f, 0.0f, 0.71f) }, {} });
+		// The quad is its own occluder, it is already as simple as an occluder gets. SubmitVisible draws it without testing
+		// it against its own depth.
+		std::vector<glm::vec3> occluderPositions;
+		for (auto & vertex : vertices) {
+			occluderPositions.push_back(vertex.position);
+		}
+		scene.Add(triangle, OccluderComponent{ occlusion.AddOccluder(occluderPositions, std::vector<uint32_t>(indices.begin(), indices.end())) });
+
+		// A tinted pane of glass over the triangle, drawn after it through the queue's blended draws.
+		if (glassMaterial) {
+			paneMaterial = materials.CreateInstance(glassMaterial, MaterialParameters{ glm::vec4(0.6f, 0.8f, 1.0f, 0.4f) });
+			pane = scene.Create();
+			scene.Add(pane, TransformComponent{ paneTransform });
+			scene.Add(pane, MeshComponent{ &triangleMesh });
+			scene.Add(pane, MaterialComponent{ paneMaterial, 0 });
+			scene.Add(pane, BoundsComponent{ { glm::vec4(0.0f, 0.0f, 0.0f, 0.71f) }, {} });
+		}
+
+		// Placed and bounded before the hierarchy is built over them, so its first tree fits the scene.
+		transforms.Update();
+		UpdateWorldBounds(scene, transforms);
+		BuildHierarchy(scene, hierarchy, hierarchyEntities, &graphicsSystem->GetWorkerPool());
+
+		auto bindless = graphicsSystem->GetBindlessTable();
+		auto frames = graphicsSystem->GetFrameCount();
+		if (indirect) {
+			drawList.Initialize(graphicsSystem->GetDevice(), graphicsSystem->GetPhysicalDevice(), graphicsSystem->GetIndirectDrawSupport(),
+				1024, frames);
+			triangleDraw = drawList.Add(triangleMesh, drawData);
+			depthPyramid.Initialize(graphicsSystem.get());
+			culling.Initialize(graphicsSystem.get(), drawList, &depthPyramid);
+			// The draw list is the pass's data, every draw in it reads the same set, one per frame for the frame's copy.
+			for (uint32_t frame = 0; frame < frames; frame++) {
+				auto drawListSet = graphicsSystem->AllocateDescriptorSet(passSetLayout);
+				DescriptorWriter(drawListSet)
+					.WriteBuffer(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, drawList.ObjectsInfo(frame))
+					->Update(graphicsSystem->GetDevice());
+				drawListSets.push_back(drawListSet);
+			}
+		}
+
+		if (!indirect) {
+			instanceStream.Initialize(graphicsSystem->GetDevice(), graphicsSystem->GetPhysicalDevice(), MaxInstances, frames, InstanceBinding);
+			instanceRange = instanceStream.Allocate(MaxInstances);
+		}
+		if (bindless) {
+			// Mapped and written in place every frame, each frame's slice is a table entry of its own.
+			auto device = graphicsSystem->GetDevice();
+			auto physicalDevice = graphicsSystem->GetPhysicalDevice();
+			frameBuffer.Create(device, physicalDevice, sizeof(FrameUniforms), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, frames);
+			for (uint32_t frame = 0; frame < frames; frame++) {
+				frameIndices.push_back(bindless->AddStorageBuffer(frameBuffer.buffer, frameBuffer.Offset(frame), sizeof(FrameUniforms)));
+			}
+			return;
+		}
+
+		uniforms.Initialize(graphicsSystem->GetDevice(), graphicsSystem->GetPhysicalDevice(), 64 * 1024, frames);
+		frameUniform = uniforms.Allocate<FrameUniforms>();
 	}
 
 	
@@ -149,27 +307,143 @@ private:
 
 		auto currentTime = std::chrono::high_resolution_clock::now();
 		float time = std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - startTime).count() / 1000.0f;
-		ubo = {};
-		ubo.model = glm::rotate(glm::mat4(), time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-		ubo.view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-		ubo.projection = glm::perspective(glm::radians(45.0f), width / (float)height, 0.1f, 10.0f);
+		transforms.SetLocal(triangleTransform, glm::rotate(glm::mat4(), time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f)));
+		transforms.Update(&graphicsSystem->GetWorkerPool());
+		drawData.model = transforms.GetWorld(triangleTransform);
+		UpdateWorldBounds(scene, transforms);
+		// FrustumCuller culls every frame, the hierarchy only answers clicks, so pick refits it when one comes in.
+		hierarchyMoved = true;
+		glm::vec3 eye(2.0f, 2.0f, 2.0f);
+		frameData.view = glm::lookAt(eye, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+		frameData.projection = glm::perspective(glm::radians(45.0f), width / (float)height, nearPlane, farPlane);
+		viewDepth = ViewDepth::FromView(frameData.view, nearPlane, farPlane);
+		SelectLods(scene, LodCamera::FromPerspective(eye, glm::radians(45.0f), static_cast<float>(height)));
 		
-		ubo.projection[1][1] *= -1;
+		frameData.projection[1][1] *= -1;
+	}
+
+	// Tints what the cursor is over, and gives the previous pick its own tint back. Entities sharing a material light
+	// up together, the tint belongs to the material.
+	void pick(const glm::vec2 & cursor) {
+		if (pickedMaterial) {
+			materials.SetParameters(pickedMaterial, pickedParameters);
+			pickedMaterial = nullptr;
+		}
+		if (hierarchyMoved) {
+			RefitHierarchy(scene, hierarchy, hierarchyEntities);
+			hierarchyMoved = false;
+		}
+
+		auto entity = PickEntity(hierarchy, hierarchyEntities, frameData.projection * frameData.view, cursor,
+			glm::vec2(static_cast<float>(width), static_cast<float>(height)));
+		if (entity == NoEntity) return;
+
+		pickedMaterial = scene.Get<MaterialComponent>(entity).material;
+		pickedParameters = materials.GetParameters<MaterialParameters>(pickedMaterial);
+		auto highlight = pickedParameters;
+		highlight.tint = glm::vec4(1.0f, 0.6f, 0.2f, pickedParameters.tint.w);
+		materials.SetParameters(pickedMaterial, highlight);
+	}
+
+	// The order and the visible set follow the camera, so the queue is culled and sorted again every frame and the
+	// frame's command buffer recorded again from it. What the frustum keeps is then tested against the occluders.
+	void buildRenderQueue() {
+		auto & workers = graphicsSystem->GetWorkerPool();
+		auto viewProjection = frameData.projection * frameData.view;
+		renderQueue.Clear();
+		GatherCullingBounds(scene, frustumCuller, culledEntities);
+		auto & visible = frustumCuller.Cull(Frustum::FromViewProjection(viewProjection), &workers);
+		UpdateOccluders(scene, transforms, occlusion);
+		occlusion.Render(viewProjection, &workers);
+		SubmitVisible(scene, renderQueue, viewDepth, visible, culledEntities, &occlusion);
+		renderQueue.Sort(&workers);
+		graphicsSystem->InvalidateCommandBuffers();
+	}
 
-		graphicsSystem->MapToLocalMemory(uniformBuffer, &ubo);
+	// Only frame's own slices are written, the frames still in flight keep reading theirs.
+	void writeFrameData(uint32_t frame) {
+		if (graphicsSystem->GetBindlessTable()) {
+			*frameBuffer.As<FrameUniforms>(frame) = frameData;
+		}
+		else {
+			uniforms.Write(frame, frameUniform, &frameData);
+		}
+
+		if (indirect) {
+			drawList.Update(frame, triangleDraw, drawData);
+			// The list is recorded once, the level SelectLods chose reaches the GPU through the frame's command.
+			drawList.SetMesh(frame, triangleDraw, *scene.Get<MeshComponent>(triangle).mesh);
+			culling.SetBounds(frame, triangleDraw, scene.Get<BoundsComponent>(triangle).world);
+			culling.Update(frame, frameData.projection * frameData.view, drawList.Count());
+			return;
+		}
+
+		// Same order as the queue this frame's command buffer was recorded from.
+		auto & objects = renderQueue.Instances();
+		instanceData.resize(objects.size());
+		for (size_t i = 0; i < objects.size(); i++) {
+			auto & transform = scene.Get<TransformComponent>(scene.EntityAt(objects[i]));
+			instanceData[i].model = transforms.GetWorld(transform.node);
+		}
+		instanceStream.Write(frame, instanceRange, instanceData);
 	}
 
 	TransferBuffer vertexBuffer;
 	TransferBuffer indexBuffer;
-	TransferBuffer uniformBuffer;
+	MappedBuffer frameBuffer;
 
 	uint32_t verticesCount;
 	uint32_t indiicesCount;
-	UniformBufferObject ubo;
-
-	VDeleter<VkDescriptorSetLayout> descriptorSetLayout{graphicsSystem->GetDevice(), vkDestroyDescriptorSetLayout };
-	VDeleter<VkDescriptorPool> descriptorPool{ graphicsSystem->GetDevice(), vkDestroyDescriptorPool };
-	VkDescriptorSet descriptorSet;
+	// Clip distances of the camera, shared by the projection and the sort depth.
+	float nearPlane = 0.1f;
+	float farPlane = 10.0f;
+	FrameUniforms frameData = {};
+	ViewDepth viewDepth = {};
+	DrawUniforms drawData = {};
+
+	VkDescriptorSetLayout frameSetLayout;
+	VkDescriptorSetLayout passSetLayout;
+	std::vector<VkDescriptorSet> drawListSets;
+	// Bindless table entries of each frame's slice.
+	std::vector<uint32_t> frameIndices;
+	DynamicUniformAllocator uniforms;
+	DynamicUniformRange frameUniform = {};
+	DescriptorUpdateTemplate frameTemplate;
+	static const uint32_t MaxInstances = 1024;
+	static const uint32_t InstanceBinding = 1;
+	InstanceStream<InstanceTransform> instanceStream;
+	InstanceRange instanceRange = {};
+	std::vector<InstanceTransform> instanceData;
+	MaterialSystem materials;
+	RenderQueue renderQueue;
+	FrustumCuller frustumCuller;
+	OcclusionRasterizer occlusion;
+	// Every renderable entity's bounds for picking, refit as they move.
+	BoundingVolumeHierarchy hierarchy;
+	std::vector<Entity> hierarchyEntities;
+	bool hierarchyMoved = false;
+	bool mousePressed = false;
+	const MaterialInstance * pickedMaterial = nullptr;
+	MaterialParameters pickedParameters = {};
+	std::vector<Entity> culledEntities;
+	bool indirect = false;
+	IndirectDrawList<DrawUniforms> drawList;
+	GpuCulling culling;
+	DepthPyramid depthPyramid;
+	uint32_t triangleDraw = 0;
+	TransformHierarchy transforms;
+	TransformHandle triangleTransform = NoTransform;
+	TransformHandle paneTransform = NoTransform;
+	EntityRegistry scene;
+	Entity triangle = NoEntity;
+	Entity pane = NoEntity;
+	Mesh triangleMesh = {};
+	LodMesh triangleLods;
+	MaterialTemplate * vertexColorMaterial = nullptr;
+	MaterialInstance * triangleMaterial = nullptr;
+	MaterialTemplate * glassMaterial = nullptr;
+	MaterialInstance * paneMaterial = nullptr;
+	PushConstants<DrawConstants> drawConstants{ VK_SHADER_STAGE_VERTEX_BIT };
 	std::vector<Vertex> vertices = {
 		{ { -0.5f, -0.5f, 0.0f }, { 1.0f, 0.0f, 0.0f } },
 		{ { 0.5f, -0.5f, 0.0f }, { 0.0f, 1.0f, 1.0f } },
@@ -43,6 +43,11 @@ public:
 	virtual void OnInit() { }
 	virtual void OnResize(int width, int height) { }
 	virtual void Update() { }
+	/// <summary>
+	/// Called once frame's previous submission has finished, before it is submitted again. Anything the GPU reads per
+	/// frame is written here, into that frame's slice, Update runs while earlier frames may still be executing.
+	/// </summary>
+	virtual void UpdateFrame(uint32_t frame) { }
 
 	void run() {
 		initVulkan();
@@ -52,7 +57,8 @@ public:
 
 protected:
 	/// <summary>
-	/// This is used to describe the pipeline(s) for the current running application.
+	/// This is used to describe the pipeline(s) for the current running application. Called once, a swap chain change
+	/// rebuilds the pipelines from what was described here.
 	/// </summary>
 	virtual void CreateGraphicsPipeline(VkDevice device) = 0;
 	/// <summary>
@@ -61,6 +67,14 @@ protected:
 	/// <param name="commandBuffer"></param>
 	virtual void CreateDrawCommands(VkCommandBuffer commandBuffer) = 0;
 	/// <summary>
+	/// Recorded with the draw commands but before the render pass begins, for compute work the draws depend on.
+	/// </summary>
+	virtual void CreatePrePassCommands(VkCommandBuffer commandBuffer) {};
+	/// <summary>
+	/// Recorded with the draw commands after the render pass ends, for work that reads what the pass rendered.
+	/// </summary>
+	virtual void CreatePostPassCommands(VkCommandBuffer commandBuffer) {};
+	/// <summary>
 	/// Used to initialize all of the vertex buffers that are needed for viewing in the application.
 	/// </summary>
 	virtual void CreateBuffers() {};
@@ -107,11 +121,17 @@ private:
 		initWindow();
 		graphicsSystem->SetValidationLayers(validationLayers);
 		graphicsSystem->SetDeviceExtensions(deviceExtensions);
+		graphicsSystem->SetPrePassCommands([this](VkCommandBuffer commandBuffer) { CreatePrePassCommands(commandBuffer); });
+		graphicsSystem->SetPostPassCommands([this](VkCommandBuffer commandBuffer) { CreatePostPassCommands(commandBuffer); });
+		graphicsSystem->SetFrameUpdate([this](uint32_t frame) { UpdateFrame(frame); });
 		graphicsSystem->Initialize([this](const VkInstance & instance, VkSurfaceKHR * surface) { createSurface(instance, surface); },
 			[this](VkDevice device) { return CreateGraphicsPipeline(device); },
 			[this](VkCommandBuffer commandBuffer) {CreateDrawCommands(commandBuffer); },
 			[this]() {CreateBuffers(); },
 		glm::vec2(width,height));
+#ifndef NDEBUG
+		graphicsSystem->EnableShaderHotReload("shaders");
+#endif
 		OnInit();
 	}
 
@@ -1,41 +1,146 @@
 #pragma once
 #include "..\FileReader.h"
+#include "..\Hash.h"
 #include <vector>
+#include <map>
+#include <type_traits>
+#include <string>
+#include <stdexcept>
 
 class ShaderModuleInfoBuilder {
 public:
-	ShaderModuleInfoBuilder(size_t codeSize, const char * data)
-		:codeSize(codeSize), data(data)
+	ShaderModuleInfoBuilder(size_t codeSize, const uint32_t * code)
+		:codeSize(codeSize), code(code)
 	{
+		Validate(codeSize, "SPIR-V module");
+	}
+
+	ShaderModuleInfoBuilder(const MappedFile & spirvFile) {
+		codeSize = spirvFile.Size();
+		code = spirvFile.Words();
+		Validate(codeSize, "SPIR-V module");
+	}
 
+	ShaderModuleInfoBuilder(const std::vector<uint32_t> & spirv) {
+		codeSize = spirv.size() * sizeof(uint32_t);
+		code = spirv.data();
+		Validate(codeSize, "SPIR-V module");
 	}
 
-	ShaderModuleInfoBuilder(const std::vector<char> & fileContents) {
-		codeSize = fileContents.size();
-		data = fileContents.data();
+	/// <summary>
+	/// SPIR-V is a stream of 32 bit words, anything else is a truncated or foreign file. An empty file maps to no
+	/// memory at all, so this has to be caught before the words are read.
+	/// </summary>
+	static void Validate(size_t codeSize, const std::string & source) {
+		if (codeSize == 0) {
+			throw std::runtime_error(source + " is empty");
+		}
+		if (codeSize % sizeof(uint32_t) != 0) {
+			throw std::runtime_error(source + " is " + std::to_string(codeSize) + " bytes, not a whole number of SPIR-V words");
+		}
 	}
 
 	VkShaderModuleCreateInfo Build() {
 		VkShaderModuleCreateInfo createInfo = {};
 		createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
 		createInfo.codeSize = codeSize;
-		createInfo.pCode = (uint32_t*)data;
+		createInfo.pCode = code;
 
 		return createInfo;
 	}
 private:
 	size_t codeSize;
-	const char * data = nullptr;
+	const uint32_t * code = nullptr;
+};
+
+/// <summary>
+/// Values for a stage's specialization constants, packed in constant id order so equal sets hash equally.
+/// The info points into this object, keep it alive until the pipeline has been created.
+/// </summary>
+struct SpecializationConstants
+{
+	std::vector<VkSpecializationMapEntry> entries;
+	std::vector<char> data;
+
+	bool Empty() const {
+		return entries.empty();
+	}
+
+	const VkSpecializationInfo * Info() {
+		if (Empty()) return nullptr;
+
+		info.mapEntryCount = static_cast<uint32_t>(entries.size());
+		info.pMapEntries = entries.data();
+		info.dataSize = data.size();
+		info.pData = data.data();
+		return &info;
+	}
+
+	uint64_t Hash(uint64_t hash = fnvOffsetBasis) const {
+		for (auto & entry : entries) {
+			hash = hashValue(entry.constantID, hash);
+			hash = hashValue(entry.offset, hash);
+			hash = hashValue(static_cast<uint64_t>(entry.size), hash);
+		}
+		return hashBytes(data.data(), data.size(), hash);
+	}
+
+	bool Equals(const SpecializationConstants & other) const {
+		if (entries.size() != other.entries.size() || data != other.data) return false;
+		for (size_t i = 0; i < entries.size(); i++) {
+			auto & a = entries[i];
+			auto & b = other.entries[i];
+			if (a.constantID != b.constantID || a.offset != b.offset || a.size != b.size) return false;
+		}
+		return true;
+	}
+
+private:
+	VkSpecializationInfo info = {};
+};
+
+class SpecializationBuilder {
+public:
+	template <typename T> SpecializationBuilder * WithConstant(uint32_t constantId, T value) {
+		static_assert(std::is_arithmetic<T>::value, "Specialization constants must be scalars");
+		auto bytes = reinterpret_cast<const char*>(&value);
+		values[constantId].assign(bytes, bytes + sizeof(T));
+		return this;
+	}
+
+	// GLSL bool constants are 32 bit, a C++ bool is not.
+	SpecializationBuilder * WithConstant(uint32_t constantId, bool value) {
+		return WithConstant(constantId, static_cast<VkBool32>(value ? VK_TRUE : VK_FALSE));
+	}
+
+	SpecializationConstants Build() {
+		SpecializationConstants constants;
+		for (auto & value : values) {
+			size_t offset = (constants.data.size() + value.second.size() - 1) / value.second.size() * value.second.size();
+			constants.data.resize(offset);
+			constants.data.insert(constants.data.end(), value.second.begin(), value.second.end());
+
+			VkSpecializationMapEntry entry = {};
+			entry.constantID = value.first;
+			entry.offset = static_cast<uint32_t>(offset);
+			entry.size = value.second.size();
+			constants.entries.push_back(entry);
+		}
+		return constants;
+	}
+private:
+	std::map<uint32_t, std::vector<char>> values;
 };
 
 class ShaderStageBuilder {
 public:
-	ShaderStageBuilder * AddStage(VkShaderStageFlagBits shaderStage, VkShaderModule shaderModule) {
+	ShaderStageBuilder * AddStage(VkShaderStageFlagBits shaderStage, VkShaderModule shaderModule, const VkSpecializationInfo * specialization = nullptr) {
 		VkPipelineShaderStageCreateInfo shader = {};
 		shader.sType = type;
 		shader.module = shaderModule;
 		shader.stage = shaderStage;
 		shader.pName = name;
+		shader.pSpecializationInfo = specialization;
 		shaders.push_back(shader);
 
 		return this;
@@ -385,6 +490,43 @@ private:
 	VkBool32 alphaToCoverageEnable = VK_FALSE;
 };
 
+class DepthStencilStateBuilder
+{
+public:
+	DepthStencilStateBuilder* DisableDepthTest() {
+		depthTestEnable = VK_FALSE;
+		return this;
+	}
+
+	DepthStencilStateBuilder* DisableDepthWrite() {
+		depthWriteEnable = VK_FALSE;
+		return this;
+	}
+
+	DepthStencilStateBuilder* WithCompareOperation(VkCompareOp operation) {
+		depthCompareOp = operation;
+		return this;
+	}
+
+	VkPipelineDepthStencilStateCreateInfo Build()
+	{
+		VkPipelineDepthStencilStateCreateInfo depthStencil = {};
+		depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+		depthStencil.depthTestEnable = depthTestEnable;
+		depthStencil.depthWriteEnable = depthWriteEnable;
+		depthStencil.depthCompareOp = depthCompareOp;
+		depthStencil.depthBoundsTestEnable = VK_FALSE;
+		depthStencil.stencilTestEnable = VK_FALSE;
+		depthStencil.minDepthBounds = 0.0f;
+		depthStencil.maxDepthBounds = 1.0f;
+		return depthStencil;
+	}
+private:
+	VkBool32 depthTestEnable = VK_TRUE;
+	VkBool32 depthWriteEnable = VK_TRUE;
+	VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS;
+};
+
 class ColorBlendAttachmentStateBuilder
 {
 public:
@@ -534,6 +676,13 @@ public:
 	{
 
 	}
+
+	PipelineLayoutBuilder * WithPushConstants(uint32_t rangeCount, const VkPushConstantRange * ranges) {
+		pushConstantRangeCount = rangeCount;
+		pushConstantRanges = ranges;
+		return this;
+	}
+
 	VkPipelineLayoutCreateInfo Build()
 	{
 		VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
@@ -593,6 +742,11 @@ public:
 		return this;
 	}
 
+	GraphicsPipelineBuilder* WithColorBlendState(VkPipelineColorBlendStateCreateInfo inputState) {
+		colorBlendState = inputState;
+		return this;
+	}
+
 	GraphicsPipelineBuilder* WithDynamicState(VkPipelineDynamicStateCreateInfo inputState) {
 		dynamicState = inputState;
 		return this;
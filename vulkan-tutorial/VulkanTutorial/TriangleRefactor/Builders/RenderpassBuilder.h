@@ -108,17 +108,25 @@ public:
 		return this;
 	}
 
+	SubpassDescriptionBuilder* WithDepthStencilAttachment(const VkAttachmentReference * attachment)
+	{
+		depthStencilAttachment = attachment;
+		return this;
+	}
+
 	VkSubpassDescription Build()
 	{
 		VkSubpassDescription subPass = {};
 		subPass.pipelineBindPoint = pipelineBindPoint;
 		subPass.colorAttachmentCount = colorAttachmentCount;
 		subPass.pColorAttachments = colorAttachments;
+		subPass.pDepthStencilAttachment = depthStencilAttachment;
 		return subPass;
 	}
 private:
 	const VkAttachmentReference * colorAttachments;
 	uint32_t colorAttachmentCount = 1;
+	const VkAttachmentReference * depthStencilAttachment = nullptr;
 	VkPipelineBindPoint pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
 };
 
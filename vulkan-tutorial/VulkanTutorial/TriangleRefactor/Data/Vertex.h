@@ -1,31 +1,24 @@
 #pragma once
+#include "VertexLayout.h"
+
 struct Vertex {
 	glm::vec3 position;
 	glm::vec3 color;
 
-	static VkVertexInputBindingDescription getBindingDescription() {
-		VkVertexInputBindingDescription bindingDescription = {};
-		bindingDescription.binding = 0;
-		bindingDescription.stride = sizeof(Vertex);
-		bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-		return bindingDescription;
+	static const VkVertexInputRate InputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+	static std::vector<VertexAttributeDescriptor> Attributes() {
+		return { VERTEX_ATTRIBUTE(Vertex, position, 0), VERTEX_ATTRIBUTE(Vertex, color, 1) };
 	}
+};
 
-	static std::array<VkVertexInputAttributeDescription, 2> getAttributeDescriptions() {
-		std::array<VkVertexInputAttributeDescription, 2> attributeDescriptions = {};
-
-		attributeDescriptions[0].binding = 0;
-		attributeDescriptions[0].location = 0;
-		attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-		attributeDescriptions[0].offset = offsetof(Vertex, position);
-
-		attributeDescriptions[1].binding = 0;
-		attributeDescriptions[1].location = 1;
-		attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-		attributeDescriptions[1].offset = offsetof(Vertex, color);
+/// <summary>
+/// Per instance stream, advanced once per instance rather than per vertex. Takes locations 2 to 5, one per column.
+/// </summary>
+struct InstanceTransform {
+	glm::mat4 model;
 
-		return attributeDescriptions;
+	static const VkVertexInputRate InputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+	static std::vector<VertexAttributeDescriptor> Attributes() {
+		return { VERTEX_ATTRIBUTE(InstanceTransform, model, 2) };
 	}
-};
-
+};
\ No newline at end of file
@@ -0,0 +1,100 @@
+#pragma once
+#include <vulkan\vulkan.h>
+#include <glm\glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include <Systems\Shaders\ShaderReflection.h>
+
+/// <summary>
+/// The format a member type is fetched with and how many consecutive locations it takes, matrices take one per column.
+/// Only types listed here can be vertex attributes, anything else fails to compile.
+/// </summary>
+template <typename T> struct VertexAttributeFormat;
+
+template <> struct VertexAttributeFormat<float> { static const VkFormat format = VK_FORMAT_R32_SFLOAT; static const uint32_t locations = 1; };
+template <> struct VertexAttributeFormat<glm::vec2> { static const VkFormat format = VK_FORMAT_R32G32_SFLOAT; static const uint32_t locations = 1; };
+template <> struct VertexAttributeFormat<glm::vec3> { static const VkFormat format = VK_FORMAT_R32G32B32_SFLOAT; static const uint32_t locations = 1; };
+template <> struct VertexAttributeFormat<glm::vec4> { static const VkFormat format = VK_FORMAT_R32G32B32A32_SFLOAT; static const uint32_t locations = 1; };
+template <> struct VertexAttributeFormat<glm::mat4> { static const VkFormat format = VK_FORMAT_R32G32B32A32_SFLOAT; static const uint32_t locations = 4; };
+template <> struct VertexAttributeFormat<uint32_t> { static const VkFormat format = VK_FORMAT_R32_UINT; static const uint32_t locations = 1; };
+template <> struct VertexAttributeFormat<int32_t> { static const VkFormat format = VK_FORMAT_R32_SINT; static const uint32_t locations = 1; };
+
+struct VertexAttributeDescriptor
+{
+	uint32_t location;
+	VkFormat format;
+	uint32_t offset;
+	uint32_t locations;
+	uint32_t locationStride;
+};
+
+template <typename Member> VertexAttributeDescriptor MakeVertexAttribute(uint32_t location, size_t offset) {
+	typedef VertexAttributeFormat<Member> Format;
+	return { location, Format::format, static_cast<uint32_t>(offset), Format::locations,
+		static_cast<uint32_t>(sizeof(Member) / Format::locations) };
+}
+
+/// <summary>
+/// Describes one member of a vertex stream struct, its format follows from the member's type.
+/// </summary>
+#define VERTEX_ATTRIBUTE(Stream, member, location) MakeVertexAttribute<decltype(Stream::member)>(location, offsetof(Stream, member))
+
+/// <summary>
+/// Builds vertex input state from stream structs. A stream struct declares its InputRate and lists its members with
+/// VERTEX_ATTRIBUTE in a static Attributes(), every stream gets its own binding with the struct's size as stride:
+///
+///   VertexLayoutBuilder().WithStream<Vertex>(0)->WithStream<InstanceTransform>(1)->Build();
+/// </summary>
+class VertexLayoutBuilder
+{
+public:
+	template <typename Stream> VertexLayoutBuilder * WithStream(uint32_t binding) {
+		VkVertexInputBindingDescription bindingDescription = {};
+		bindingDescription.binding = binding;
+		bindingDescription.stride = sizeof(Stream);
+		bindingDescription.inputRate = Stream::InputRate;
+		layout.bindings.push_back(bindingDescription);
+
+		for (auto & descriptor : Stream::Attributes()) {
+			for (uint32_t column = 0; column < descriptor.locations; column++) {
+				VkVertexInputAttributeDescription attribute = {};
+				attribute.binding = binding;
+				attribute.location = descriptor.location + column;
+				attribute.format = descriptor.format;
+				attribute.offset = descriptor.offset + column * descriptor.locationStride;
+				layout.attributes.push_back(attribute);
+			}
+		}
+		return this;
+	}
+
+	ReflectedVertexInput Build() const {
+		return layout;
+	}
+
+	/// <summary>
+	/// Build, after checking that every input the vertex shader declares is fed with the format it expects.
+	/// </summary>
+	ReflectedVertexInput Build(const PipelineReflection & reflection) const {
+		for (auto & input : reflection.VertexInputs()) {
+			auto attribute = std::find_if(layout.attributes.begin(), layout.attributes.end(), [&input](const VkVertexInputAttributeDescription & attribute) {
+				return attribute.location == input.location;
+			});
+			if (attribute == layout.attributes.end()) {
+				throw std::runtime_error("No vertex stream feeds shader input " + input.name);
+			}
+			if (attribute->format != input.format) {
+				throw std::runtime_error("Vertex stream format doesn't match shader input " + input.name);
+			}
+		}
+		return layout;
+	}
+
+private:
+	ReflectedVertexInput layout;
+};
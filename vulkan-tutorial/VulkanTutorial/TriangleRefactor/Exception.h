@@ -2,6 +2,12 @@
 #include <vulkan\vulkan.h>
 #include <stdexcept>
 
+// Descriptor indexing, draw indirect count and the 1.1 result codes first shipped together in this SDK. The project
+// takes its headers and libraries from $(VULKAN_SDK), point it at this version or a newer one.
+#if !defined(VK_HEADER_VERSION) || VK_HEADER_VERSION < 77
+#error The Vulkan SDK at VULKAN_SDK is too old, version 1.1.77 or newer is required
+#endif
+
 
 static void vkOk(VkResult vkResult, const char * message) {
 	if (vkResult != VK_SUCCESS) throw std::runtime_error(message);
@@ -3,6 +3,24 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <cstdint>
+#include <stdexcept>
+#include <algorithm>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 static std::vector<char> readFile(const std::string & filename) {
 	std::ifstream file(filename, std::ios::ate | std::ios::binary);
@@ -20,4 +38,228 @@ static std::vector<char> readFile(const std::string & filename) {
 	file.close();
 
 	return buffer;
-}
\ No newline at end of file
+}
+
+enum class FileAccessPattern {
+	Sequential,
+	Random
+};
+
+// Anything above this is read through FileStreamReader, a 32 bit process can't spare the address space.
+static const uint64_t maxMappedFileSize = sizeof(void*) == 4 ? (uint64_t(256) << 20) : (uint64_t(64) << 30);
+
+/// <summary>
+/// Read-only view of a whole file mapped into memory. Views always start on a page boundary,
+/// so SPIR-V can be handed to Vulkan as words without copying it into an aligned buffer first.
+/// </summary>
+class MappedFile {
+public:
+	MappedFile() {
+
+	}
+
+	MappedFile(const std::string & filename, FileAccessPattern pattern = FileAccessPattern::Sequential) {
+		open(filename, pattern);
+	}
+
+	~MappedFile() {
+		Release();
+	}
+
+	MappedFile(const MappedFile &) = delete;
+	MappedFile & operator=(const MappedFile &) = delete;
+
+	MappedFile(MappedFile && other) {
+		*this = std::move(other);
+	}
+
+	MappedFile & operator=(MappedFile && other) {
+		if (this != &other) {
+			Release();
+			data = other.data;
+			size = other.size;
+			other.data = nullptr;
+			other.size = 0;
+#ifdef _WIN32
+			file = other.file;
+			mapping = other.mapping;
+			other.file = INVALID_HANDLE_VALUE;
+			other.mapping = nullptr;
+#endif
+		}
+		return *this;
+	}
+
+	const char * Data() const {
+		return data;
+	}
+
+	size_t Size() const {
+		return size;
+	}
+
+	const uint32_t * Words() const {
+		return reinterpret_cast<const uint32_t*>(data);
+	}
+
+	size_t WordCount() const {
+		return size / sizeof(uint32_t);
+	}
+
+	bool Empty() const {
+		return size == 0;
+	}
+
+	void Release() {
+#ifdef _WIN32
+		if (data) UnmapViewOfFile(data);
+		if (mapping) CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+		mapping = nullptr;
+		file = INVALID_HANDLE_VALUE;
+#else
+		if (data) munmap(const_cast<char*>(data), size);
+#endif
+		data = nullptr;
+		size = 0;
+	}
+
+private:
+	void open(const std::string & filename, FileAccessPattern pattern) {
+#ifdef _WIN32
+		DWORD accessHint = (pattern == FileAccessPattern::Sequential) ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS;
+		file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | accessHint, nullptr);
+		if (file == INVALID_HANDLE_VALUE) {
+			throw std::runtime_error("Failed to open " + filename);
+		}
+
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize)) {
+			Release();
+			throw std::runtime_error("Failed to read the size of " + filename);
+		}
+		checkMappable(filename, static_cast<uint64_t>(fileSize.QuadPart));
+		if (fileSize.QuadPart == 0) return;
+
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!mapping) {
+			Release();
+			throw std::runtime_error("Failed to map " + filename);
+		}
+
+		data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+		if (!data) {
+			Release();
+			throw std::runtime_error("Failed to map " + filename);
+		}
+		size = static_cast<size_t>(fileSize.QuadPart);
+#else
+		int descriptor = ::open(filename.c_str(), O_RDONLY);
+		if (descriptor < 0) {
+			throw std::runtime_error("Failed to open " + filename);
+		}
+
+		struct stat fileStats;
+		if (fstat(descriptor, &fileStats) != 0) {
+			close(descriptor);
+			throw std::runtime_error("Failed to read the size of " + filename);
+		}
+
+		uint64_t fileSize = static_cast<uint64_t>(fileStats.st_size);
+		if (fileSize == 0 || fileSize > maxMappedFileSize) {
+			close(descriptor);
+			checkMappable(filename, fileSize);
+			return;
+		}
+
+#ifdef POSIX_FADV_SEQUENTIAL
+		posix_fadvise(descriptor, 0, 0, pattern == FileAccessPattern::Sequential ? POSIX_FADV_SEQUENTIAL : POSIX_FADV_RANDOM);
+#endif
+		void * view = mmap(nullptr, static_cast<size_t>(fileSize), PROT_READ, MAP_PRIVATE, descriptor, 0);
+		// The mapping keeps its own reference to the file.
+		close(descriptor);
+		if (view == MAP_FAILED) {
+			throw std::runtime_error("Failed to map " + filename);
+		}
+
+		if (pattern == FileAccessPattern::Sequential) {
+			madvise(view, static_cast<size_t>(fileSize), MADV_SEQUENTIAL);
+			madvise(view, static_cast<size_t>(fileSize), MADV_WILLNEED);
+		}
+		else {
+			madvise(view, static_cast<size_t>(fileSize), MADV_RANDOM);
+		}
+		data = static_cast<const char*>(view);
+		size = static_cast<size_t>(fileSize);
+#endif
+	}
+
+	void checkMappable(const std::string & filename, uint64_t fileSize) {
+		if (fileSize > maxMappedFileSize) {
+			Release();
+			throw std::runtime_error(filename + " is too large to map, read it with a FileStreamReader");
+		}
+	}
+
+	const char * data = nullptr;
+	size_t size = 0;
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+#endif
+};
+
+/// <summary>
+/// Reads a file in fixed size chunks for assets too large to map. Each chunk lands in a word
+/// aligned buffer that is reused between reads, so only one chunk is resident at a time.
+/// </summary>
+class FileStreamReader {
+public:
+	FileStreamReader(const std::string & filename, size_t chunkSize = 4 << 20)
+		: file(filename, std::ios::binary), chunk((chunkSize + sizeof(uint32_t) - 1) / sizeof(uint32_t)) {
+		if (!file.is_open()) {
+			throw std::runtime_error("Failed to open " + filename);
+		}
+
+		file.seekg(0, std::ios::end);
+		size = static_cast<uint64_t>(file.tellg());
+		file.seekg(0);
+	}
+
+	/// <summary>
+	/// Reads the next chunk, returns false once the whole file has been consumed.
+	/// </summary>
+	bool Next(const char ** chunkData, size_t * chunkSize) {
+		if (remaining() == 0) return false;
+
+		size_t capacity = chunk.size() * sizeof(uint32_t);
+		size_t readSize = static_cast<size_t>(std::min<uint64_t>(capacity, remaining()));
+		file.read(reinterpret_cast<char*>(chunk.data()), readSize);
+		if (static_cast<size_t>(file.gcount()) != readSize) {
+			throw std::runtime_error("Failed to read file chunk");
+		}
+
+		offset += readSize;
+		*chunkData = reinterpret_cast<const char*>(chunk.data());
+		*chunkSize = readSize;
+		return true;
+	}
+
+	uint64_t Size() const {
+		return size;
+	}
+
+	uint64_t Offset() const {
+		return offset;
+	}
+
+private:
+	uint64_t remaining() const {
+		return size - offset;
+	}
+
+	std::ifstream file;
+	std::vector<uint32_t> chunk;
+	uint64_t size = 0;
+	uint64_t offset = 0;
+};
@@ -0,0 +1,40 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+static const uint64_t fnvOffsetBasis = 14695981039346656037ull;
+static const uint64_t fnvPrime = 1099511628211ull;
+
+/// <summary>
+/// 64 bit FNV-1a, stable across runs and platforms so it can be used for on-disk cache keys.
+/// </summary>
+static uint64_t hashBytes(const void * data, size_t size, uint64_t hash = fnvOffsetBasis) {
+	auto bytes = static_cast<const unsigned char*>(data);
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= fnvPrime;
+	}
+	return hash;
+}
+
+static uint64_t hashString(const std::string & value, uint64_t hash = fnvOffsetBasis) {
+	// Hash the length as well so {"ab","c"} and {"a","bc"} differ.
+	uint64_t length = value.size();
+	hash = hashBytes(&length, sizeof(length), hash);
+	return hashBytes(value.data(), value.size(), hash);
+}
+
+template <typename T> static uint64_t hashValue(const T & value, uint64_t hash = fnvOffsetBasis) {
+	return hashBytes(&value, sizeof(T), hash);
+}
+
+static std::string hashToHex(uint64_t hash) {
+	static const char digits[] = "0123456789abcdef";
+	std::string hex(16, '0');
+	for (int i = 15; i >= 0; i--) {
+		hex[i] = digits[hash & 0xf];
+		hash >>= 4;
+	}
+	return hex;
+}
@@ -0,0 +1,543 @@
+#pragma once
+#include <glm\glm.hpp>
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <cfloat>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define BOUNDING_VOLUME_HIERARCHY_SIMD 1
+#include <emmintrin.h>
+#endif
+
+#include <Systems\Culling\Frustum.h>
+#include <Systems\Threading\WorkerPool.h>
+
+struct RayHit
+{
+	uint32_t object;
+	float distance;
+};
+
+/// <summary>
+/// Tree of object bounding boxes for frustum culling and ray picking, so queries visit a number of nodes that grows
+/// with the log of the object count. Every node has four children with their bounds stored component by component,
+/// which lets one SSE instruction test all four against a plane or a ray slab, and a node takes two cache lines.
+///
+/// Build splits each range with a binned surface area heuristic and hands large subtrees to the worker pool. Objects
+/// that move only need SetBounds and Refit, which grows or shrinks the boxes above them without changing the tree.
+/// The tree gets worse as objects travel far from where they were built, rebuild when queries slow down.
+/// </summary>
+class BoundingVolumeHierarchy
+{
+public:
+	static const uint32_t Width = 4;
+	static const uint32_t LeafSize = 4;
+	static const uint32_t BinCount = 16;
+	// Ranges larger than this build their children as separate tasks.
+	static const uint32_t ParallelThreshold = 4096;
+
+	/// <summary>
+	/// Builds the tree over boxes, the index of a box is its object's ID in every query. Runs on the calling thread
+	/// without a worker pool.
+	/// </summary>
+	void Build(const std::vector<BoundingBox> & boxes, WorkerPool * workers = nullptr) {
+		this->boxes = boxes;
+		dirty.clear();
+		auto count = static_cast<uint32_t>(boxes.size());
+		order.resize(count);
+		centroids.resize(count);
+		for (uint32_t i = 0; i < count; i++) {
+			order[i] = i;
+			centroids[i] = (boxes[i].min + boxes[i].max) * 0.5f;
+		}
+
+		nodes.clear();
+		parents.clear();
+		objectLeaves.assign(count, NoParent);
+		if (count == 0) return;
+
+		// Every node but the root holds more than a leaf's worth of objects in disjoint ranges, so there are fewer
+		// nodes than objects and the arrays never grow while tasks write into them.
+		nodes.resize(count + 1);
+		parents.resize(count + 1);
+		parents[0] = NoParent;
+		nodeCount = 1;
+		buildNode(0, 0, count, workers);
+		nodes.resize(nodeCount);
+		parents.resize(nodeCount);
+
+		for (uint32_t node = 0; node < nodes.size(); node++) {
+			for (uint32_t slot = 0; slot < Width; slot++) {
+				if (!isLeaf(nodes[node].children[slot])) continue;
+				auto first = nodes[node].children[slot] & ~LeafFlag;
+				for (uint32_t i = first; i < first + nodes[node].counts[slot]; i++) {
+					objectLeaves[order[i]] = node * Width + slot;
+				}
+			}
+		}
+	}
+
+	/// <summary>
+	/// New bounds for an object that moved, applied to the tree by the next Refit.
+	/// </summary>
+	void SetBounds(uint32_t object, const BoundingBox & box) {
+		if (object >= boxes.size()) {
+			throw std::runtime_error("Bounds set for an object outside the hierarchy");
+		}
+		boxes[object] = box;
+		dirty.push_back(object);
+	}
+
+	/// <summary>
+	/// Brings the node bounds in line with every SetBounds since the last refit. A few moved objects walk up from their
+	/// leaves and stop where a box doesn't change, once many have moved every node is recomputed instead.
+	/// </summary>
+	void Refit() {
+		if (dirty.empty()) return;
+
+		if (dirty.size() > boxes.size() / 8) {
+			// Children are always allocated after their parent, so a backwards sweep sees every child first.
+			for (auto node = static_cast<uint32_t>(nodes.size()); node-- > 0;) {
+				for (uint32_t slot = 0; slot < Width; slot++) {
+					if (nodes[node].children[slot] != EmptySlot) {
+						setSlotBounds(nodes[node], slot, childBounds(nodes[node], slot));
+					}
+				}
+			}
+		}
+		else {
+			for (auto object : dirty) {
+				auto reference = objectLeaves[object];
+				while (reference != NoParent) {
+					auto & node = nodes[reference / Width];
+					auto slot = reference % Width;
+					auto bounds = childBounds(node, slot);
+					if (sameBounds(slotBounds(node, slot), bounds)) break;
+					setSlotBounds(node, slot, bounds);
+					reference = parents[reference / Width];
+				}
+			}
+		}
+		dirty.clear();
+	}
+
+	/// <summary>
+	/// Objects whose boxes intersect the frustum, in no particular order. Subtrees entirely inside are taken whole
+	/// without testing what is below them.
+	/// </summary>
+	const std::vector<uint32_t> & Cull(const Frustum & frustum) {
+		visible.clear();
+		if (nodes.empty()) return visible;
+
+		stack.clear();
+		stack.push_back(0);
+		while (!stack.empty()) {
+			auto & node = nodes[stack.back()];
+			stack.pop_back();
+
+			int outside, inside;
+			testFrustum(frustum, node, outside, inside);
+			for (uint32_t slot = 0; slot < Width; slot++) {
+				auto child = node.children[slot];
+				if (child == EmptySlot || (outside & (1 << slot))) continue;
+
+				if (inside & (1 << slot)) {
+					appendSubtree(node, slot);
+				}
+				else if (isLeaf(child)) {
+					auto first = child & ~LeafFlag;
+					for (uint32_t i = first; i < first + node.counts[slot]; i++) {
+						if (frustum.Intersects(boxes[order[i]])) {
+							visible.push_back(order[i]);
+						}
+					}
+				}
+				else {
+					stack.push_back(child);
+				}
+			}
+		}
+		return visible;
+	}
+
+	/// <summary>
+	/// Nearest object box the ray enters within maxDistance, direction need not be normalized and distance is in
+	/// multiples of it. A ray starting inside a box hits it at distance zero.
+	/// </summary>
+	bool Raycast(const glm::vec3 & origin, const glm::vec3 & direction, RayHit & hit, float maxDistance = FLT_MAX) const {
+		if (nodes.empty()) return false;
+
+		// A zero component would turn the slab test into 0 * infinity.
+		glm::vec3 inverse;
+		for (int axis = 0; axis < 3; axis++) {
+			float component = direction[axis];
+			if (std::fabs(component) < 1e-30f) component = component < 0.0f ? -1e-30f : 1e-30f;
+			inverse[axis] = 1.0f / component;
+		}
+
+		bool found = false;
+		float nearest = maxDistance;
+		struct Entry { uint32_t node; float distance; };
+		std::vector<Entry> pending;
+		pending.push_back({ 0, 0.0f });
+		while (!pending.empty()) {
+			auto entry = pending.back();
+			pending.pop_back();
+			if (entry.distance > nearest) continue;
+
+			auto & node = nodes[entry.node];
+			float entries[Width];
+			int hits = testRay(origin, inverse, nearest, node, entries);
+
+			// Nearer children go on the stack last so they are opened first and shrink nearest for the rest.
+			Entry inner[Width];
+			uint32_t innerCount = 0;
+			for (uint32_t slot = 0; slot < Width; slot++) {
+				auto child = node.children[slot];
+				if (child == EmptySlot || !(hits & (1 << slot))) continue;
+
+				if (isLeaf(child)) {
+					auto first = child & ~LeafFlag;
+					for (uint32_t i = first; i < first + node.counts[slot]; i++) {
+						float distance;
+						if (intersectBox(boxes[order[i]], origin, inverse, nearest, distance)) {
+							nearest = distance;
+							hit = { order[i], distance };
+							found = true;
+						}
+					}
+				}
+				else {
+					inner[innerCount++] = { child, entries[slot] };
+				}
+			}
+			for (uint32_t i = 1; i < innerCount; i++) {
+				for (uint32_t j = i; j > 0 && inner[j - 1].distance < inner[j].distance; j--) {
+					std::swap(inner[j - 1], inner[j]);
+				}
+			}
+			pending.insert(pending.end(), inner, inner + innerCount);
+		}
+		return found;
+	}
+
+	uint32_t ObjectCount() const { return static_cast<uint32_t>(boxes.size()); }
+	uint32_t NodeCount() const { return static_cast<uint32_t>(nodes.size()); }
+
+private:
+	// Enumerators rather than static members, they are passed by reference to the standard containers.
+	enum : uint32_t
+	{
+		LeafFlag = 0x80000000u,
+		EmptySlot = 0xFFFFFFFFu,
+		NoParent = 0xFFFFFFFFu
+	};
+
+	// Children are node indices, or with LeafFlag set the first of counts[slot] entries in order.
+	struct Node
+	{
+		float minX[Width];
+		float minY[Width];
+		float minZ[Width];
+		float maxX[Width];
+		float maxY[Width];
+		float maxZ[Width];
+		uint32_t children[Width];
+		uint32_t counts[Width];
+	};
+
+	static bool isLeaf(uint32_t child) {
+		return child != EmptySlot && (child & LeafFlag) != 0;
+	}
+
+	static BoundingBox emptyBounds() {
+		return { glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX) };
+	}
+
+	static void grow(BoundingBox & bounds, const BoundingBox & box) {
+		bounds.min = glm::min(bounds.min, box.min);
+		bounds.max = glm::max(bounds.max, box.max);
+	}
+
+	static float surfaceArea(const BoundingBox & box) {
+		auto size = box.max - box.min;
+		return size.x * size.y + size.y * size.z + size.z * size.x;
+	}
+
+	static bool sameBounds(const BoundingBox & a, const BoundingBox & b) {
+		return a.min.x == b.min.x && a.min.y == b.min.y && a.min.z == b.min.z &&
+			a.max.x == b.max.x && a.max.y == b.max.y && a.max.z == b.max.z;
+	}
+
+	static BoundingBox slotBounds(const Node & node, uint32_t slot) {
+		return { glm::vec3(node.minX[slot], node.minY[slot], node.minZ[slot]), glm::vec3(node.maxX[slot], node.maxY[slot], node.maxZ[slot]) };
+	}
+
+	static void setSlotBounds(Node & node, uint32_t slot, const BoundingBox & box) {
+		node.minX[slot] = box.min.x;
+		node.minY[slot] = box.min.y;
+		node.minZ[slot] = box.min.z;
+		node.maxX[slot] = box.max.x;
+		node.maxY[slot] = box.max.y;
+		node.maxZ[slot] = box.max.z;
+	}
+
+	BoundingBox rangeBounds(uint32_t begin, uint32_t end) const {
+		auto bounds = emptyBounds();
+		for (uint32_t i = begin; i < end; i++) {
+			grow(bounds, boxes[order[i]]);
+		}
+		return bounds;
+	}
+
+	// Recomputed from what is below the slot: the objects of a leaf or the four slots of a child node.
+	BoundingBox childBounds(const Node & node, uint32_t slot) const {
+		auto child = node.children[slot];
+		if (isLeaf(child)) {
+			auto first = child & ~LeafFlag;
+			return rangeBounds(first, first + node.counts[slot]);
+		}
+
+		auto bounds = emptyBounds();
+		auto & inner = nodes[child];
+		for (uint32_t i = 0; i < Width; i++) {
+			if (inner.children[i] != EmptySlot) {
+				grow(bounds, slotBounds(inner, i));
+			}
+		}
+		return bounds;
+	}
+
+	void buildNode(uint32_t index, uint32_t begin, uint32_t end, WorkerPool * workers) {
+		// Two levels of binary splits give the four children, always splitting the largest range left.
+		uint32_t begins[Width] = { begin };
+		uint32_t ends[Width] = { end };
+		uint32_t rangeCount = 1;
+		while (rangeCount < Width) {
+			uint32_t largest = 0;
+			for (uint32_t i = 1; i < rangeCount; i++) {
+				if (ends[i] - begins[i] > ends[largest] - begins[largest]) largest = i;
+			}
+			if (ends[largest] - begins[largest] <= LeafSize) break;
+
+			auto middle = split(begins[largest], ends[largest]);
+			begins[rangeCount] = middle;
+			ends[rangeCount] = ends[largest];
+			ends[largest] = middle;
+			rangeCount++;
+		}
+
+		auto & node = nodes[index];
+		uint32_t innerSlots[Width];
+		uint32_t innerCount = 0;
+		for (uint32_t slot = 0; slot < Width; slot++) {
+			if (slot >= rangeCount) {
+				node.children[slot] = EmptySlot;
+				node.counts[slot] = 0;
+				setSlotBounds(node, slot, emptyBounds());
+				continue;
+			}
+
+			setSlotBounds(node, slot, rangeBounds(begins[slot], ends[slot]));
+			if (ends[slot] - begins[slot] <= LeafSize) {
+				node.children[slot] = begins[slot] | LeafFlag;
+				node.counts[slot] = ends[slot] - begins[slot];
+			}
+			else {
+				auto child = nodeCount.fetch_add(1);
+				parents[child] = index * Width + slot;
+				node.children[slot] = child;
+				node.counts[slot] = 0;
+				innerSlots[innerCount++] = slot;
+			}
+		}
+
+		auto buildChildren = [this, &node, &innerSlots, &begins, &ends, workers](size_t first, size_t last) {
+			for (size_t i = first; i < last; i++) {
+				auto slot = innerSlots[i];
+				buildNode(node.children[slot], begins[slot], ends[slot], workers);
+			}
+		};
+		if (workers && end - begin > ParallelThreshold) {
+			workers->ParallelFor(innerCount, 1, buildChildren);
+		}
+		else {
+			buildChildren(0, innerCount);
+		}
+	}
+
+	// Partitions order[begin, end) at the cheapest of the bin boundaries along the widest centroid axis and returns
+	// where the second half starts.
+	uint32_t split(uint32_t begin, uint32_t end) {
+		glm::vec3 low(FLT_MAX), high(-FLT_MAX);
+		for (uint32_t i = begin; i < end; i++) {
+			low = glm::min(low, centroids[order[i]]);
+			high = glm::max(high, centroids[order[i]]);
+		}
+		auto extent = high - low;
+		int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+		uint32_t half = begin + (end - begin) / 2;
+		if (extent[axis] <= 0.0f) {
+			// Every centroid is the same point, any split is as good as another.
+			return half;
+		}
+
+		float scale = BinCount / extent[axis];
+		auto binOf = [this, axis, &low, scale](uint32_t object) {
+			return std::min(static_cast<uint32_t>((centroids[object][axis] - low[axis]) * scale), BinCount - 1);
+		};
+
+		BoundingBox binBounds[BinCount];
+		uint32_t binCounts[BinCount] = {};
+		for (auto & bounds : binBounds) {
+			bounds = emptyBounds();
+		}
+		for (uint32_t i = begin; i < end; i++) {
+			auto bin = binOf(order[i]);
+			binCounts[bin]++;
+			grow(binBounds[bin], boxes[order[i]]);
+		}
+
+		// Cost of splitting after bin i, sweeping in from the right and then from the left.
+		float rightCosts[BinCount];
+		auto bounds = emptyBounds();
+		uint32_t count = 0;
+		for (uint32_t bin = BinCount - 1; bin > 0; bin--) {
+			grow(bounds, binBounds[bin]);
+			count += binCounts[bin];
+			rightCosts[bin - 1] = count > 0 ? surfaceArea(bounds) * count : 0.0f;
+		}
+
+		uint32_t best = 0;
+		float bestCost = FLT_MAX;
+		bounds = emptyBounds();
+		count = 0;
+		for (uint32_t bin = 0; bin < BinCount - 1; bin++) {
+			grow(bounds, binBounds[bin]);
+			count += binCounts[bin];
+			float cost = (count > 0 ? surfaceArea(bounds) * count : 0.0f) + rightCosts[bin];
+			if (cost < bestCost) {
+				bestCost = cost;
+				best = bin;
+			}
+		}
+
+		auto middle = std::partition(order.begin() + begin, order.begin() + end,
+			[&binOf, best](uint32_t object) { return binOf(object) <= best; });
+		auto result = static_cast<uint32_t>(middle - order.begin());
+		return result == begin || result == end ? half : result;
+	}
+
+	void appendSubtree(const Node & node, uint32_t slot) {
+		auto child = node.children[slot];
+		if (isLeaf(child)) {
+			auto first = child & ~LeafFlag;
+			for (uint32_t i = first; i < first + node.counts[slot]; i++) {
+				visible.push_back(order[i]);
+			}
+			return;
+		}
+
+		auto & inner = nodes[child];
+		for (uint32_t i = 0; i < Width; i++) {
+			if (inner.children[i] != EmptySlot) {
+				appendSubtree(inner, i);
+			}
+		}
+	}
+
+	static bool intersectBox(const BoundingBox & box, const glm::vec3 & origin, const glm::vec3 & inverse, float maxDistance, float & distance) {
+		float enter = 0.0f;
+		float exit = maxDistance;
+		for (int axis = 0; axis < 3; axis++) {
+			float lower = (box.min[axis] - origin[axis]) * inverse[axis];
+			float upper = (box.max[axis] - origin[axis]) * inverse[axis];
+			enter = std::max(enter, std::min(lower, upper));
+			exit = std::min(exit, std::max(lower, upper));
+		}
+		distance = enter;
+		return enter <= exit;
+	}
+
+	// Bit per slot: outside when the box is behind one plane, inside when it is in front of all six.
+	static void testFrustum(const Frustum & frustum, const Node & node, int & outside, int & inside) {
+#ifdef BOUNDING_VOLUME_HIERARCHY_SIMD
+		__m128 minX = _mm_loadu_ps(node.minX), minY = _mm_loadu_ps(node.minY), minZ = _mm_loadu_ps(node.minZ);
+		__m128 maxX = _mm_loadu_ps(node.maxX), maxY = _mm_loadu_ps(node.maxY), maxZ = _mm_loadu_ps(node.maxZ);
+		__m128 zero = _mm_setzero_ps();
+		__m128 anyOutside = zero;
+		__m128 allInside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (auto & plane : frustum.planes) {
+			__m128 nx = _mm_set1_ps(plane.x), ny = _mm_set1_ps(plane.y), nz = _mm_set1_ps(plane.z), d = _mm_set1_ps(plane.w);
+			// The corner furthest along the normal decides outside, the one furthest against it inside.
+			__m128 furthest = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, plane.x > 0.0f ? maxX : minX), _mm_mul_ps(ny, plane.y > 0.0f ? maxY : minY)),
+				_mm_add_ps(_mm_mul_ps(nz, plane.z > 0.0f ? maxZ : minZ), d));
+			__m128 closest = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, plane.x > 0.0f ? minX : maxX), _mm_mul_ps(ny, plane.y > 0.0f ? minY : maxY)),
+				_mm_add_ps(_mm_mul_ps(nz, plane.z > 0.0f ? minZ : maxZ), d));
+			anyOutside = _mm_or_ps(anyOutside, _mm_cmplt_ps(furthest, zero));
+			allInside = _mm_and_ps(allInside, _mm_cmpge_ps(closest, zero));
+		}
+		outside = _mm_movemask_ps(anyOutside);
+		inside = _mm_movemask_ps(allInside);
+#else
+		outside = 0;
+		inside = 0;
+		for (uint32_t slot = 0; slot < Width; slot++) {
+			auto box = slotBounds(node, slot);
+			bool allInside = true;
+			for (auto & plane : frustum.planes) {
+				float furthest = plane.x * (plane.x > 0.0f ? box.max.x : box.min.x) + plane.y * (plane.y > 0.0f ? box.max.y : box.min.y) +
+					plane.z * (plane.z > 0.0f ? box.max.z : box.min.z) + plane.w;
+				float closest = plane.x * (plane.x > 0.0f ? box.min.x : box.max.x) + plane.y * (plane.y > 0.0f ? box.min.y : box.max.y) +
+					plane.z * (plane.z > 0.0f ? box.min.z : box.max.z) + plane.w;
+				if (furthest < 0.0f) outside |= 1 << slot;
+				allInside = allInside && closest >= 0.0f;
+			}
+			if (allInside) inside |= 1 << slot;
+		}
+#endif
+	}
+
+	// Bit per slot the ray enters before maxDistance, with the entry distances.
+	static int testRay(const glm::vec3 & origin, const glm::vec3 & inverse, float maxDistance, const Node & node, float * entries) {
+#ifdef BOUNDING_VOLUME_HIERARCHY_SIMD
+		const float * mins[] = { node.minX, node.minY, node.minZ };
+		const float * maxs[] = { node.maxX, node.maxY, node.maxZ };
+		__m128 enter = _mm_setzero_ps();
+		__m128 exit = _mm_set1_ps(maxDistance);
+		for (int axis = 0; axis < 3; axis++) {
+			__m128 start = _mm_set1_ps(origin[axis]);
+			__m128 scale = _mm_set1_ps(inverse[axis]);
+			__m128 lower = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(mins[axis]), start), scale);
+			__m128 upper = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(maxs[axis]), start), scale);
+			enter = _mm_max_ps(enter, _mm_min_ps(lower, upper));
+			exit = _mm_min_ps(exit, _mm_max_ps(lower, upper));
+		}
+		_mm_storeu_ps(entries, enter);
+		return _mm_movemask_ps(_mm_cmple_ps(enter, exit));
+#else
+		int hits = 0;
+		for (uint32_t slot = 0; slot < Width; slot++) {
+			if (intersectBox(slotBounds(node, slot), origin, inverse, maxDistance, entries[slot])) hits |= 1 << slot;
+		}
+		return hits;
+#endif
+	}
+
+	std::vector<BoundingBox> boxes;
+	std::vector<glm::vec3> centroids;
+	// Object IDs, every leaf owns a contiguous range.
+	std::vector<uint32_t> order;
+	std::vector<Node> nodes;
+	// Node index * Width + slot of the slot pointing at each node, and at each object's leaf.
+	std::vector<uint32_t> parents;
+	std::vector<uint32_t> objectLeaves;
+	std::atomic<uint32_t> nodeCount{ 0 };
+	std::vector<uint32_t> dirty;
+	std::vector<uint32_t> visible;
+	std::vector<uint32_t> stack;
+};
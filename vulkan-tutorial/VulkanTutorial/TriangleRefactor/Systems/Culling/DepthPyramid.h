@@ -0,0 +1,225 @@
+#pragma once
+#include <vulkan\vulkan.h>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+#include <Exception.h>
+#include <Systems\Graphics\IVulkanGraphicsSystem.h>
+#include <Systems\Graphics\DeviceImage.h>
+#include <Systems\Graphics\PushConstants.h>
+#include <Systems\Descriptors\DescriptorAllocator.h>
+
+/// <summary>
+/// Min/max mip chain of the render pass's depth buffer for hierarchical Z occlusion culling. Every texel holds the
+/// nearest and farthest depth of the area it covers, so one fetch at the right level bounds the depth behind any
+/// screen rectangle.
+///
+/// Build runs after the render pass and the result is read by the next frame's culling, which tests against last
+/// frame's camera. The pyramid stays in GENERAL layout, it is written and read by compute only.
+/// </summary>
+class DepthPyramid
+{
+public:
+	static const uint32_t GroupSize = 8;
+	// Levels of a 16384 texel wide pyramid, so one descriptor pool holds every level set.
+	static const uint32_t MaxLevels = 15;
+
+	void Initialize(IVulkanGraphicsSystem * graphicsSystem) {
+		this->graphicsSystem = graphicsSystem;
+		device = graphicsSystem->GetDevice();
+
+		pipeline = graphicsSystem->CreateComputePipeline(ShaderStage(VK_SHADER_STAGE_COMPUTE_BIT, "shaders/culling/depthpyramid.comp"));
+
+		// Texels are fetched directly, the sampler only has to exist for the combined image sampler bindings.
+		VkSamplerCreateInfo samplerInfo = {};
+		samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		samplerInfo.magFilter = VK_FILTER_NEAREST;
+		samplerInfo.minFilter = VK_FILTER_NEAREST;
+		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+		vkOk(vkCreateSampler(device, &samplerInfo, nullptr, &sampler), "Failed to create the depth pyramid sampler");
+
+		// The level sets are thrown away with the pyramid, so they come from pools of their own that can be reset.
+		descriptors.Initialize(device, MaxLevels, {
+			{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1.0f },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1.0f }
+		});
+
+		Prepare();
+	}
+
+	/// <summary>
+	/// Recreates the pyramid when the swap chain has been recreated since the last call and returns true, descriptors
+	/// that read the pyramid must then be written again. Only acts while the device is idle after a recreate, so it is
+	/// safe to call every time commands are recorded.
+	/// </summary>
+	bool Prepare() {
+		auto generation = graphicsSystem->GetSwapChainGeneration();
+		if (pyramid.image != VK_NULL_HANDLE && generation == preparedGeneration) {
+			return false;
+		}
+		preparedGeneration = generation;
+
+		destroyPyramid();
+		createPyramid();
+		return true;
+	}
+
+	/// <summary>
+	/// Records the reduction, outside the render pass once depth has been written.
+	/// </summary>
+	void Build(VkCommandBuffer commandBuffer) const {
+		// The render pass hands depth over to compute, only the previous reads of the pyramid have to finish.
+		barrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0);
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.pipeline);
+		auto sourceExtent = graphicsSystem->GetDepthImage().extent;
+		for (uint32_t level = 0; level < pyramid.mipLevels; level++) {
+			auto targetExtent = levelExtent(level);
+			LevelConstants constants = {
+				static_cast<int32_t>(sourceExtent.width), static_cast<int32_t>(sourceExtent.height),
+				static_cast<int32_t>(targetExtent.width), static_cast<int32_t>(targetExtent.height),
+				level == 0 ? 1u : 0u
+			};
+
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.layout, 0, 1, &levelSets[level], 0, nullptr);
+			levelConstants.Push(commandBuffer, pipeline.layout, constants);
+			vkCmdDispatch(commandBuffer, (targetExtent.width + GroupSize - 1) / GroupSize, (targetExtent.height + GroupSize - 1) / GroupSize, 1);
+
+			// Each level reads the one before it, and the last one is read by the culling pass.
+			barrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+			sourceExtent = targetExtent;
+		}
+	}
+
+	/// <summary>
+	/// The whole chain, for a combined image sampler binding.
+	/// </summary>
+	VkDescriptorImageInfo DescriptorInfo() const {
+		VkDescriptorImageInfo imageInfo = {};
+		imageInfo.sampler = sampler;
+		imageInfo.imageView = pyramid.view;
+		imageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+		return imageInfo;
+	}
+
+	VkExtent2D Extent() const { return pyramid.extent; }
+	uint32_t Levels() const { return pyramid.mipLevels; }
+
+	void Cleanup() {
+		if (device == VK_NULL_HANDLE) return;
+
+		destroyPyramid();
+		descriptors.Cleanup();
+		vkDestroySampler(device, sampler, nullptr);
+		device = VK_NULL_HANDLE;
+	}
+
+private:
+	// Matches the Level push constant block in depthpyramid.comp.
+	struct LevelConstants
+	{
+		int32_t sourceWidth;
+		int32_t sourceHeight;
+		int32_t targetWidth;
+		int32_t targetHeight;
+		uint32_t fromDepth;
+	};
+
+	static uint32_t previousPowerOfTwo(uint32_t value) {
+		uint32_t power = 1;
+		while (power * 2 <= value) {
+			power *= 2;
+		}
+		return power;
+	}
+
+	static void barrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags sourceStages, VkAccessFlags sourceAccess) {
+		VkMemoryBarrier memoryBarrier = {};
+		memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		memoryBarrier.srcAccessMask = sourceAccess;
+		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, sourceStages, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+	}
+
+	VkExtent2D levelExtent(uint32_t level) const {
+		return { std::max(pyramid.extent.width >> level, 1u), std::max(pyramid.extent.height >> level, 1u) };
+	}
+
+	void createPyramid() {
+		auto & depth = graphicsSystem->GetDepthImage();
+
+		// Halving a power of two never leaves a texel that straddles two, only the first level needs a wide footprint.
+		VkExtent2D extent = { previousPowerOfTwo(depth.extent.width), previousPowerOfTwo(depth.extent.height) };
+		uint32_t levels = 1;
+		while ((std::max(extent.width, extent.height) >> levels) > 0) {
+			levels++;
+		}
+
+		pyramid.Create(device, graphicsSystem->GetPhysicalDevice(), VK_FORMAT_R32G32_SFLOAT, extent, levels,
+			VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_IMAGE_ASPECT_COLOR_BIT);
+
+		DescriptorWriter writer;
+		for (uint32_t level = 0; level < levels; level++) {
+			levelViews.push_back(pyramid.CreateView(device, level, 1));
+			levelSets.push_back(descriptors.Allocate(pipeline.setLayouts[0]));
+
+			VkDescriptorImageInfo source = { sampler, depth.view, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL };
+			if (level > 0) {
+				source = { sampler, levelViews[level - 1], VK_IMAGE_LAYOUT_GENERAL };
+			}
+			VkDescriptorImageInfo target = { VK_NULL_HANDLE, levelViews[level], VK_IMAGE_LAYOUT_GENERAL };
+			writer.ForSet(levelSets[level])
+				->WriteImage(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, source)
+				->WriteImage(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, target);
+		}
+		writer.Update(device);
+
+		// Until the first build nothing is behind anything: the farthest depth everywhere is the far plane.
+		auto & image = pyramid;
+		graphicsSystem->ExecuteImmediately([&image](VkCommandBuffer commandBuffer) {
+			VkImageMemoryBarrier toGeneral = {};
+			toGeneral.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			toGeneral.srcAccessMask = 0;
+			toGeneral.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			toGeneral.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			toGeneral.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+			toGeneral.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			toGeneral.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			toGeneral.image = image.image;
+			toGeneral.subresourceRange = image.Range();
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &toGeneral);
+
+			VkClearColorValue farPlane = {};
+			farPlane.float32[0] = 0.0f;
+			farPlane.float32[1] = 1.0f;
+			auto range = image.Range();
+			vkCmdClearColorImage(commandBuffer, image.image, VK_IMAGE_LAYOUT_GENERAL, &farPlane, 1, &range);
+		});
+	}
+
+	void destroyPyramid() {
+		for (auto view : levelViews) {
+			vkDestroyImageView(device, view, nullptr);
+		}
+		levelViews.clear();
+		levelSets.clear();
+		descriptors.Reset();
+		pyramid.Destroy(device);
+	}
+
+	IVulkanGraphicsSystem * graphicsSystem = nullptr;
+	VkDevice device = VK_NULL_HANDLE;
+	ComputePipeline pipeline = {};
+	PushConstants<LevelConstants> levelConstants = PushConstants<LevelConstants>(VK_SHADER_STAGE_COMPUTE_BIT);
+	VkSampler sampler = VK_NULL_HANDLE;
+	DeviceImage pyramid;
+	std::vector<VkImageView> levelViews;
+	std::vector<VkDescriptorSet> levelSets;
+	DescriptorAllocator descriptors;
+	uint64_t preparedGeneration = 0;
+};
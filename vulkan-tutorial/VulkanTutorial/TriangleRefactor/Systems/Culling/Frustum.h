@@ -0,0 +1,90 @@
+#pragma once
+#include <glm\glm.hpp>
+#include <cmath>
+
+/// <summary>
+/// Bounding sphere, center in world space. Stored as one vec4 so it can go straight into a storage buffer.
+/// </summary>
+struct BoundingSphere
+{
+	glm::vec4 centerRadius;
+};
+
+/// <summary>
+/// Axis aligned box, corners in world space.
+/// </summary>
+struct BoundingBox
+{
+	glm::vec3 min;
+	glm::vec3 max;
+
+	static BoundingBox FromSphere(const BoundingSphere & sphere) {
+		auto & s = sphere.centerRadius;
+		return { glm::vec3(s.x - s.w, s.y - s.w, s.z - s.w), glm::vec3(s.x + s.w, s.y + s.w, s.z + s.w) };
+	}
+};
+
+/// <summary>
+/// The six planes of a view frustum, each as (normal, distance) with the normal pointing inwards. Laid out like the
+/// culling shader's uniform block, so it can be copied into it as is.
+/// </summary>
+struct Frustum
+{
+	enum Plane { Left, Right, Bottom, Top, Near, Far, PlaneCount };
+
+	glm::vec4 planes[PlaneCount];
+
+	/// <summary>
+	/// Extracts the planes from projection * view, with depth running from 0 to 1 as it does in Vulkan.
+	/// </summary>
+	static Frustum FromViewProjection(const glm::mat4 & viewProjection) {
+		// Rows of the matrix, glm stores columns.
+		glm::vec4 rows[4];
+		for (int row = 0; row < 4; row++) {
+			rows[row] = glm::vec4(viewProjection[0][row], viewProjection[1][row], viewProjection[2][row], viewProjection[3][row]);
+		}
+
+		Frustum frustum;
+		frustum.planes[Left] = add(rows[3], rows[0], 1.0f);
+		frustum.planes[Right] = add(rows[3], rows[0], -1.0f);
+		frustum.planes[Bottom] = add(rows[3], rows[1], 1.0f);
+		frustum.planes[Top] = add(rows[3], rows[1], -1.0f);
+		frustum.planes[Near] = rows[2];
+		frustum.planes[Far] = add(rows[3], rows[2], -1.0f);
+
+		for (auto & plane : frustum.planes) {
+			float length = std::sqrt(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+			plane = glm::vec4(plane.x / length, plane.y / length, plane.z / length, plane.w / length);
+		}
+		return frustum;
+	}
+
+	/// <summary>
+	/// False only when the sphere is entirely outside one plane. This is the reference the culling shaders match.
+	/// </summary>
+	bool Intersects(const BoundingSphere & sphere) const {
+		auto & s = sphere.centerRadius;
+		for (auto & plane : planes) {
+			if (plane.x * s.x + plane.y * s.y + plane.z * s.z + plane.w < -s.w) return false;
+		}
+		return true;
+	}
+
+	/// <summary>
+	/// False only when the box is entirely outside one plane, tested with the corner furthest along the plane's normal.
+	/// </summary>
+	bool Intersects(const BoundingBox & box) const {
+		for (auto & plane : planes) {
+			float x = plane.x > 0.0f ? box.max.x : box.min.x;
+			float y = plane.y > 0.0f ? box.max.y : box.min.y;
+			float z = plane.z > 0.0f ? box.max.z : box.min.z;
+			if (plane.x * x + plane.y * y + plane.z * z + plane.w < 0.0f) return false;
+		}
+		return true;
+	}
+
+private:
+	static glm::vec4 add(const glm::vec4 & a, const glm::vec4 & b, float sign) {
+		return glm::vec4(a.x + sign * b.x, a.y + sign * b.y, a.z + sign * b.z, a.w + sign * b.w);
+	}
+};
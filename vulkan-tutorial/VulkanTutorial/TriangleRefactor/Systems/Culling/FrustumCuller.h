@@ -0,0 +1,240 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cfloat>
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define FRUSTUM_CULLER_SIMD 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// AVX is picked at run time, so the AVX loop is compiled for it even when the rest of the build isn't.
+#if defined(FRUSTUM_CULLER_SIMD) && defined(__GNUC__)
+#define FRUSTUM_CULLER_AVX __attribute__((target("avx")))
+#else
+#define FRUSTUM_CULLER_AVX
+#endif
+
+#include <Systems\Culling\Frustum.h>
+#include <Systems\Threading\WorkerPool.h>
+
+enum class CullingPath
+{
+	Scalar,
+	Sse,
+	Avx
+};
+
+/// <summary>
+/// Frustum culling on the CPU for large object counts. Bounding spheres are kept as structure of arrays, one array
+/// per component, so one SSE or AVX instruction tests 4 or 8 objects against a plane. The arrays are padded to a
+/// multiple of 8 with spheres no frustum can contain, which lets the wide loops run past the last object without a
+/// scalar tail.
+///
+/// Cull splits the objects into fixed blocks handed to the worker pool, every block collects its own survivors and
+/// they are joined in block order, so the visible list is in ascending index order whatever the thread count.
+/// </summary>
+class FrustumCuller
+{
+public:
+	static const uint32_t BlockSize = 4096;
+
+	FrustumCuller() : path(BestPath()) {
+
+	}
+
+	uint32_t Add(const BoundingSphere & sphere) {
+		if (count == xs.size()) {
+			// Padding spheres have a radius of -FLT_MAX and fail every plane.
+			auto padded = count + 8;
+			xs.resize(padded, 0.0f);
+			ys.resize(padded, 0.0f);
+			zs.resize(padded, 0.0f);
+			radii.resize(padded, -FLT_MAX);
+		}
+		Set(count, sphere);
+		return count++;
+	}
+
+	void Set(uint32_t index, const BoundingSphere & sphere) {
+		xs[index] = sphere.centerRadius.x;
+		ys[index] = sphere.centerRadius.y;
+		zs[index] = sphere.centerRadius.z;
+		radii[index] = sphere.centerRadius.w;
+	}
+
+	void Clear() {
+		count = 0;
+		xs.clear();
+		ys.clear();
+		zs.clear();
+		radii.clear();
+	}
+
+	uint32_t Count() const { return count; }
+
+	/// <summary>
+	/// Forces a code path, the scalar one being the baseline the wide ones are measured and checked against.
+	/// </summary>
+	void SetPath(CullingPath path) {
+		if (static_cast<int>(path) > static_cast<int>(BestPath())) {
+			throw std::runtime_error("This CPU can't run the requested culling path");
+		}
+		this->path = path;
+	}
+
+	CullingPath GetPath() const { return path; }
+
+	/// <summary>
+	/// Indices of every object intersecting frustum, ascending. Runs on the calling thread without a worker pool.
+	/// </summary>
+	const std::vector<uint32_t> & Cull(const Frustum & frustum, WorkerPool * workers = nullptr) {
+		size_t blockCount = (count + BlockSize - 1) / BlockSize;
+		if (blockVisible.size() < blockCount) {
+			blockVisible.resize(blockCount);
+		}
+
+		auto cullBlocks = [this, &frustum](size_t begin, size_t end) {
+			for (size_t block = begin; block < end; block++) {
+				auto & visible = blockVisible[block];
+				visible.clear();
+				auto first = static_cast<uint32_t>(block * BlockSize);
+				cullRange(frustum, first, std::min(first + BlockSize, count), visible);
+			}
+		};
+
+		if (workers) {
+			workers->ParallelFor(blockCount, 1, cullBlocks);
+		}
+		else {
+			cullBlocks(0, blockCount);
+		}
+
+		visible.clear();
+		for (size_t block = 0; block < blockCount; block++) {
+			visible.insert(visible.end(), blockVisible[block].begin(), blockVisible[block].end());
+		}
+		return visible;
+	}
+
+	static CullingPath BestPath() {
+#ifdef FRUSTUM_CULLER_SIMD
+		return cpuHasAvx() ? CullingPath::Avx : CullingPath::Sse;
+#else
+		return CullingPath::Scalar;
+#endif
+	}
+
+private:
+	void cullRange(const Frustum & frustum, uint32_t begin, uint32_t end, std::vector<uint32_t> & visible) const {
+		switch (path) {
+#ifdef FRUSTUM_CULLER_SIMD
+		case CullingPath::Avx:
+			cullAvx(frustum, begin, end, visible);
+			return;
+		case CullingPath::Sse:
+			cullSse(frustum, begin, end, visible);
+			return;
+#endif
+		default:
+			cullScalar(frustum, begin, end, visible);
+		}
+	}
+
+	void cullScalar(const Frustum & frustum, uint32_t begin, uint32_t end, std::vector<uint32_t> & visible) const {
+		for (uint32_t i = begin; i < end; i++) {
+			if (frustum.Intersects({ glm::vec4(xs[i], ys[i], zs[i], radii[i]) })) {
+				visible.push_back(i);
+			}
+		}
+	}
+
+#ifdef FRUSTUM_CULLER_SIMD
+	void cullSse(const Frustum & frustum, uint32_t begin, uint32_t end, std::vector<uint32_t> & visible) const {
+		__m128 planes[Frustum::PlaneCount][4];
+		for (int plane = 0; plane < Frustum::PlaneCount; plane++) {
+			for (int component = 0; component < 4; component++) {
+				planes[plane][component] = _mm_set1_ps(frustum.planes[plane][component]);
+			}
+		}
+
+		for (uint32_t i = begin; i < end; i += 4) {
+			__m128 x = _mm_loadu_ps(&xs[i]);
+			__m128 y = _mm_loadu_ps(&ys[i]);
+			__m128 z = _mm_loadu_ps(&zs[i]);
+			__m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&radii[i]));
+
+			__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (int plane = 0; plane < Frustum::PlaneCount; plane++) {
+				__m128 distance = _mm_add_ps(
+					_mm_add_ps(_mm_mul_ps(planes[plane][0], x), _mm_mul_ps(planes[plane][1], y)),
+					_mm_add_ps(_mm_mul_ps(planes[plane][2], z), planes[plane][3]));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+			}
+			appendLanes(_mm_movemask_ps(inside), 4, i, end, visible);
+		}
+	}
+
+	FRUSTUM_CULLER_AVX void cullAvx(const Frustum & frustum, uint32_t begin, uint32_t end, std::vector<uint32_t> & visible) const {
+		__m256 planes[Frustum::PlaneCount][4];
+		for (int plane = 0; plane < Frustum::PlaneCount; plane++) {
+			for (int component = 0; component < 4; component++) {
+				planes[plane][component] = _mm256_set1_ps(frustum.planes[plane][component]);
+			}
+		}
+
+		for (uint32_t i = begin; i < end; i += 8) {
+			__m256 x = _mm256_loadu_ps(&xs[i]);
+			__m256 y = _mm256_loadu_ps(&ys[i]);
+			__m256 z = _mm256_loadu_ps(&zs[i]);
+			__m256 negativeRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&radii[i]));
+
+			__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			for (int plane = 0; plane < Frustum::PlaneCount; plane++) {
+				__m256 distance = _mm256_add_ps(
+					_mm256_add_ps(_mm256_mul_ps(planes[plane][0], x), _mm256_mul_ps(planes[plane][1], y)),
+					_mm256_add_ps(_mm256_mul_ps(planes[plane][2], z), planes[plane][3]));
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negativeRadius, _CMP_GE_OQ));
+			}
+			appendLanes(_mm256_movemask_ps(inside), 8, i, end, visible);
+		}
+	}
+
+	static void appendLanes(int mask, uint32_t lanes, uint32_t first, uint32_t end, std::vector<uint32_t> & visible) {
+		for (uint32_t lane = 0; mask != 0 && lane < lanes; lane++, mask >>= 1) {
+			// Lanes past end belong to the next block or the padding.
+			if ((mask & 1) && first + lane < end) {
+				visible.push_back(first + lane);
+			}
+		}
+	}
+
+	static bool cpuHasAvx() {
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 1);
+		bool osSavesAvx = (info[2] & (1 << 27)) != 0;
+		bool avx = (info[2] & (1 << 28)) != 0;
+		return osSavesAvx && avx && (_xgetbv(0) & 6) == 6;
+#elif defined(__GNUC__)
+		return __builtin_cpu_supports("avx");
+#else
+		return false;
+#endif
+	}
+#endif
+
+	CullingPath path;
+	uint32_t count = 0;
+	std::vector<float> xs;
+	std::vector<float> ys;
+	std::vector<float> zs;
+	std::vector<float> radii;
+	std::vector<std::vector<uint32_t>> blockVisible;
+	std::vector<uint32_t> visible;
+};
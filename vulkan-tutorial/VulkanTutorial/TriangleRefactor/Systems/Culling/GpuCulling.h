@@ -0,0 +1,190 @@
+#pragma once
+#include <vulkan\vulkan.h>
+#include <cstring>
+#include <vector>
+#include <stdexcept>
+
+#include <Systems\Graphics\IVulkanGraphicsSystem.h>
+#include <Systems\Graphics\MappedBuffer.h>
+#include <Systems\Rendering\IndirectDrawList.h>
+#include <Systems\Culling\Frustum.h>
+#include <Systems\Culling\DepthPyramid.h>
+
+/// <summary>
+/// Compute pass that filters an IndirectDrawList against the view frustum before it is drawn. Each draw's bounding
+/// sphere is tested on the GPU and the survivors are compacted through an atomic counter into a second command buffer,
+/// which is what gets drawn, so culled objects cost no vertex work at all. Devices without the draw count extension
+/// can't draw a count the GPU wrote, there culled draws keep their slot with an instance count of zero.
+///
+/// Given a DepthPyramid, draws hidden behind last frame's depth are culled as well. The test uses last frame's camera
+/// against last frame's depth, so something coming out from behind an occluder can show up a frame late.
+///
+/// The frustum, draw count and bounds are read from mapped buffers when the pass runs, so the recorded commands stay
+/// valid from frame to frame. Like the draw list, every frame in flight has its own copy of them and its own set, and
+/// only the copy of a frame whose previous submission has finished is written.
+/// </summary>
+class GpuCulling
+{
+public:
+	static const uint32_t GroupSize = 64;
+
+	template <typename T> void Initialize(IVulkanGraphicsSystem * graphicsSystem, const IndirectDrawList<T> & drawList,
+		const DepthPyramid * pyramid = nullptr) {
+		device = graphicsSystem->GetDevice();
+		auto physicalDevice = graphicsSystem->GetPhysicalDevice();
+		support = drawList.Support();
+		capacity = drawList.Capacity();
+		auto frames = drawList.Frames();
+
+		occlusion = pyramid != nullptr;
+		std::vector<std::string> defines;
+		if (occlusion) {
+			defines.push_back("OCCLUSION");
+		}
+		pipeline = graphicsSystem->CreateComputePipeline(ShaderStage(VK_SHADER_STAGE_COMPUTE_BIT, "shaders/culling/cull.comp", defines));
+
+		parameters.Create(device, physicalDevice, sizeof(Parameters), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, frames);
+		bounds.Create(device, physicalDevice, sizeof(BoundingSphere) * capacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, frames);
+		visibleCommands.Create(device, physicalDevice, sizeof(VkDrawIndexedIndirectCommand) * capacity,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
+		visibleCount.Create(device, physicalDevice, sizeof(uint32_t),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+		memset(parameters.mapped, 0, static_cast<size_t>(parameters.stride * frames));
+
+		sets.clear();
+		for (uint32_t frame = 0; frame < frames; frame++) {
+			auto set = graphicsSystem->AllocateDescriptorSet(pipeline.setLayouts[0]);
+			DescriptorWriter(set)
+				.WriteBuffer(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, parameters.FrameInfo(frame))
+				->WriteBuffer(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, bounds.FrameInfo(frame))
+				->WriteBuffer(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, drawList.CommandsInfo(frame))
+				->WriteBuffer(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, visibleCommands.DescriptorInfo())
+				->WriteBuffer(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, visibleCount.DescriptorInfo())
+				->Update(device);
+			sets.push_back(set);
+		}
+		if (occlusion) {
+			SetPyramid(*pyramid);
+		}
+	}
+
+	/// <summary>
+	/// Points the occlusion test at the pyramid again, after DepthPyramid::Prepare has recreated it. Only valid when
+	/// the culling was initialized with a pyramid, and only while no frame is in flight, as after a swap chain
+	/// recreation. The pyramid's size reaches each frame's parameters with its next Update.
+	/// </summary>
+	void SetPyramid(const DepthPyramid & pyramid) {
+		if (!occlusion) {
+			throw std::runtime_error("Culling was initialized without a depth pyramid");
+		}
+		pyramidSize = glm::vec2(static_cast<float>(pyramid.Extent().width), static_cast<float>(pyramid.Extent().height));
+		pyramidLevels = pyramid.Levels();
+		for (auto set : sets) {
+			DescriptorWriter(set)
+				.WriteImage(5, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, pyramid.DescriptorInfo())
+				->Update(device);
+		}
+	}
+
+	/// <summary>
+	/// World space bounds of the draw with this ID in frame's copy, kept up to date for anything that moves. Only call
+	/// it once frame's previous submission has finished.
+	/// </summary>
+	void SetBounds(uint32_t frame, uint32_t drawId, const BoundingSphere & sphere) {
+		if (drawId >= capacity) {
+			throw std::runtime_error("Bounds set for a draw outside the culled list");
+		}
+		bounds.As<BoundingSphere>(frame)[drawId] = sphere;
+	}
+
+	/// <summary>
+	/// Once per frame from the frame update, with the camera the frame renders with.
+	/// </summary>
+	void Update(uint32_t frame, const glm::mat4 & viewProjection, uint32_t drawCount) {
+		auto values = parameters.As<Parameters>(frame);
+		values->frustum = Frustum::FromViewProjection(viewProjection);
+		// The pyramid read this frame was built by the last one.
+		values->pyramidViewProjection = previousViewProjection;
+		previousViewProjection = viewProjection;
+		values->drawCount = drawCount;
+		values->capacity = capacity;
+		values->compact = support.DrawCount() ? 1 : 0;
+		values->pyramidSize = pyramidSize;
+		values->pyramidLevels = pyramidLevels;
+	}
+
+	/// <summary>
+	/// Records the culling dispatch of frame's copy, outside the render pass. The whole capacity is dispatched so the
+	/// recording doesn't depend on how many draws the list holds.
+	/// </summary>
+	void Dispatch(VkCommandBuffer commandBuffer, uint32_t frame) const {
+		// The previous frame's draws read the buffers this pass rewrites.
+		barrier(commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0);
+		vkCmdFillBuffer(commandBuffer, visibleCount.buffer, 0, sizeof(uint32_t), 0);
+		barrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.pipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.layout, 0, 1, &sets[frame], 0, nullptr);
+		vkCmdDispatch(commandBuffer, (capacity + GroupSize - 1) / GroupSize, 1, 1);
+
+		barrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+			VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+	}
+
+	/// <summary>
+	/// Draws what survived, inside the render pass with the list's pipeline and sets bound.
+	/// </summary>
+	template <typename T> void Draw(VkCommandBuffer commandBuffer, const IndirectDrawList<T> & drawList) const {
+		drawList.BindBuffers(commandBuffer);
+		recordIndexedIndirect(commandBuffer, support, visibleCommands.buffer, 0, visibleCount.buffer, 0, capacity, capacity);
+	}
+
+	void Cleanup() {
+		if (device == VK_NULL_HANDLE) return;
+
+		parameters.Destroy(device);
+		bounds.Destroy(device);
+		visibleCommands.Destroy(device);
+		visibleCount.Destroy(device);
+		device = VK_NULL_HANDLE;
+	}
+
+private:
+	// Matches the std140 Culling block in cull.comp.
+	struct Parameters
+	{
+		Frustum frustum;
+		uint32_t drawCount;
+		uint32_t capacity;
+		uint32_t compact;
+		uint32_t padding;
+		glm::mat4 pyramidViewProjection;
+		glm::vec2 pyramidSize;
+		uint32_t pyramidLevels;
+		uint32_t padding2;
+	};
+
+	static void barrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags sourceStages, VkPipelineStageFlags targetStages,
+		VkAccessFlags sourceAccess, VkAccessFlags targetAccess) {
+		VkMemoryBarrier memoryBarrier = {};
+		memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		memoryBarrier.srcAccessMask = sourceAccess;
+		memoryBarrier.dstAccessMask = targetAccess;
+		vkCmdPipelineBarrier(commandBuffer, sourceStages, targetStages, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+	}
+
+	VkDevice device = VK_NULL_HANDLE;
+	IndirectDrawSupport support;
+	ComputePipeline pipeline = {};
+	std::vector<VkDescriptorSet> sets;
+	MappedBuffer parameters;
+	MappedBuffer bounds;
+	DeviceBuffer visibleCommands;
+	DeviceBuffer visibleCount;
+	uint32_t capacity = 0;
+	bool occlusion = false;
+	glm::mat4 previousViewProjection = glm::mat4(1.0f);
+	glm::vec2 pyramidSize = glm::vec2(0.0f);
+	uint32_t pyramidLevels = 0;
+};
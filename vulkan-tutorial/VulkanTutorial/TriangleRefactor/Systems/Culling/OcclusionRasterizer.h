@@ -0,0 +1,319 @@
+#pragma once
+#include <glm\glm.hpp>
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define OCCLUSION_RASTERIZER_SIMD 1
+#include <emmintrin.h>
+#endif
+
+#include <Systems\Culling\Frustum.h>
+#include <Systems\Threading\WorkerPool.h>
+
+/// <summary>
+/// Occlusion culling entirely on the CPU, for devices where the compute based DepthPyramid is slow. A few occluder
+/// meshes are drawn into a small depth buffer, then bounding boxes are tested against it before anything is submitted.
+///
+/// Render sets up every occluder's triangles in parallel, then splits the buffer into horizontal bands that are
+/// rasterized independently, four pixels at a time with SSE. Pixels are covered when their center is, so occluders
+/// should sit inside the geometry they stand for. Triangles reaching in front of the near plane are dropped rather
+/// than clipped, which only ever hides less.
+/// </summary>
+class OcclusionRasterizer
+{
+public:
+	static const uint32_t Width = 256;
+	static const uint32_t Height = 128;
+	static const uint32_t BandHeight = 16;
+	static const uint32_t BandCount = Height / BandHeight;
+
+	OcclusionRasterizer() : depth(Width * Height, 1.0f) {
+
+	}
+
+	/// <summary>
+	/// Object space triangles of an occluder, placed with SetTransform. Returns the occluder's index.
+	/// </summary>
+	uint32_t AddOccluder(std::vector<glm::vec3> positions, std::vector<uint32_t> indices) {
+		if (indices.size() % 3 != 0) {
+			throw std::runtime_error("Occluder indices must form whole triangles");
+		}
+		for (auto index : indices) {
+			if (index >= positions.size()) {
+				throw std::runtime_error("Occluder index points past its vertices");
+			}
+		}
+
+		Occluder occluder;
+		occluder.positions = std::move(positions);
+		occluder.indices = std::move(indices);
+		occluders.push_back(std::move(occluder));
+		return static_cast<uint32_t>(occluders.size() - 1);
+	}
+
+	void SetTransform(uint32_t occluder, const glm::mat4 & world) {
+		if (occluder >= occluders.size()) {
+			throw std::runtime_error("Transform set for an unknown occluder");
+		}
+		occluders[occluder].world = world;
+	}
+
+	uint32_t OccluderCount() const { return static_cast<uint32_t>(occluders.size()); }
+
+	/// <summary>
+	/// Clears the buffer and draws every occluder through viewProjection, depth running from 0 to 1 as in Vulkan.
+	/// Runs on the calling thread without a worker pool.
+	/// </summary>
+	void Render(const glm::mat4 & viewProjection, WorkerPool * workers = nullptr) {
+		this->viewProjection = viewProjection;
+
+		uint32_t triangleCount = 0;
+		for (auto & occluder : occluders) {
+			occluder.firstTriangle = triangleCount;
+			triangleCount += static_cast<uint32_t>(occluder.indices.size() / 3);
+		}
+		triangles.resize(triangleCount);
+
+		auto setupOccluders = [this](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) {
+				setupOccluder(occluders[i]);
+			}
+		};
+		auto rasterizeBands = [this](size_t begin, size_t end) {
+			for (size_t band = begin; band < end; band++) {
+				rasterizeBand(static_cast<uint32_t>(band));
+			}
+		};
+
+		if (workers) {
+			workers->ParallelFor(occluders.size(), 1, setupOccluders);
+			workers->ParallelFor(BandCount, 1, rasterizeBands);
+		}
+		else {
+			setupOccluders(0, occluders.size());
+			rasterizeBands(0, BandCount);
+		}
+	}
+
+	/// <summary>
+	/// False when the box is off screen or every pixel it covers has an occluder in front of its nearest point. Boxes
+	/// reaching in front of the near plane are always visible. Only reads, so boxes can be tested from any thread
+	/// once Render has returned.
+	/// </summary>
+	bool IsVisible(const BoundingBox & box) const {
+		float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+		float nearest = FLT_MAX;
+		for (int corner = 0; corner < 8; corner++) {
+			glm::vec4 point((corner & 1) ? box.max.x : box.min.x, (corner & 2) ? box.max.y : box.min.y, (corner & 4) ? box.max.z : box.min.z, 1.0f);
+			auto clip = viewProjection * point;
+			if (clip.w <= 0.0f || clip.z < 0.0f) {
+				return true;
+			}
+			auto screen = toScreen(clip);
+			minX = std::min(minX, screen.x);
+			maxX = std::max(maxX, screen.x);
+			minY = std::min(minY, screen.y);
+			maxY = std::max(maxY, screen.y);
+			nearest = std::min(nearest, screen.z);
+		}
+
+		// Every pixel the rectangle touches, not only those whose centers it covers.
+		int x0 = static_cast<int>(std::floor(std::max(minX, 0.0f)));
+		int y0 = static_cast<int>(std::floor(std::max(minY, 0.0f)));
+		int x1 = static_cast<int>(std::floor(std::min(maxX, static_cast<float>(Width - 1))));
+		int y1 = static_cast<int>(std::floor(std::min(maxY, static_cast<float>(Height - 1))));
+		if (x0 > x1 || y0 > y1) {
+			return false;
+		}
+
+		for (int y = y0; y <= y1; y++) {
+			const float * row = &depth[y * Width];
+#ifdef OCCLUSION_RASTERIZER_SIMD
+			__m128 boxDepth = _mm_set1_ps(nearest);
+			__m128i first = _mm_set1_epi32(x0 - 1);
+			__m128i last = _mm_set1_epi32(x1 + 1);
+			for (int x = x0 & ~3; x <= x1; x += 4) {
+				__m128i lanes = _mm_add_epi32(_mm_set1_epi32(x), _mm_setr_epi32(0, 1, 2, 3));
+				__m128i covered = _mm_and_si128(_mm_cmpgt_epi32(lanes, first), _mm_cmplt_epi32(lanes, last));
+				__m128 inFront = _mm_cmple_ps(boxDepth, _mm_loadu_ps(row + x));
+				if (_mm_movemask_ps(_mm_and_ps(inFront, _mm_castsi128_ps(covered))) != 0) {
+					return true;
+				}
+			}
+#else
+			for (int x = x0; x <= x1; x++) {
+				if (nearest <= row[x]) {
+					return true;
+				}
+			}
+#endif
+		}
+		return false;
+	}
+
+	bool IsVisible(const BoundingSphere & sphere) const {
+		return IsVisible(BoundingBox::FromSphere(sphere));
+	}
+
+	/// <summary>
+	/// The last Render's depth, Width * Height floats row by row.
+	/// </summary>
+	const float * Depth() const { return depth.data(); }
+
+private:
+	struct Occluder
+	{
+		std::vector<glm::vec3> positions;
+		std::vector<uint32_t> indices;
+		glm::mat4 world = glm::mat4(1.0f);
+		// Set up by Render, only touched by the task that owns the occluder.
+		std::vector<glm::vec4> clip;
+		uint32_t firstTriangle = 0;
+	};
+
+	// Edge functions and the depth plane as functions of the pixel position, inclusive bounds in pixels. A triangle
+	// with nothing to draw has minY > maxY.
+	struct Triangle
+	{
+		float edgeX[3];
+		float edgeY[3];
+		float edgeC[3];
+		float depthX;
+		float depthY;
+		float depthC;
+		int minX;
+		int maxX;
+		int minY;
+		int maxY;
+	};
+
+	static glm::vec3 toScreen(const glm::vec4 & clip) {
+		return glm::vec3((clip.x / clip.w * 0.5f + 0.5f) * Width, (clip.y / clip.w * 0.5f + 0.5f) * Height, clip.z / clip.w);
+	}
+
+	void setupOccluder(Occluder & occluder) {
+		auto transform = viewProjection * occluder.world;
+		occluder.clip.resize(occluder.positions.size());
+		for (size_t i = 0; i < occluder.positions.size(); i++) {
+			occluder.clip[i] = transform * glm::vec4(occluder.positions[i], 1.0f);
+		}
+
+		auto triangle = triangles.data() + occluder.firstTriangle;
+		for (size_t i = 0; i < occluder.indices.size(); i += 3, triangle++) {
+			setupTriangle(occluder.clip[occluder.indices[i]], occluder.clip[occluder.indices[i + 1]], occluder.clip[occluder.indices[i + 2]], *triangle);
+		}
+	}
+
+	static void setupTriangle(const glm::vec4 & clip0, const glm::vec4 & clip1, const glm::vec4 & clip2, Triangle & triangle) {
+		triangle.minY = 1;
+		triangle.maxY = 0;
+
+		const glm::vec4 * clips[] = { &clip0, &clip1, &clip2 };
+		glm::vec3 v[3];
+		for (int i = 0; i < 3; i++) {
+			if (clips[i]->w <= 0.0f || clips[i]->z < 0.0f) return;
+			v[i] = toScreen(*clips[i]);
+		}
+
+		// Either winding is drawn, occluders are seen from both sides.
+		float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[1].y - v[0].y) * (v[2].x - v[0].x);
+		if (std::fabs(area) < 1e-6f) return;
+		if (area < 0.0f) {
+			std::swap(v[1], v[2]);
+			area = -area;
+		}
+
+		// Edge i runs between the other two vertices and is positive on the side of vertex i, reaching area there.
+		for (int i = 0; i < 3; i++) {
+			auto & a = v[(i + 1) % 3];
+			auto & b = v[(i + 2) % 3];
+			triangle.edgeX[i] = a.y - b.y;
+			triangle.edgeY[i] = b.x - a.x;
+			triangle.edgeC[i] = -(triangle.edgeX[i] * a.x + triangle.edgeY[i] * a.y);
+		}
+		triangle.depthX = (triangle.edgeX[0] * v[0].z + triangle.edgeX[1] * v[1].z + triangle.edgeX[2] * v[2].z) / area;
+		triangle.depthY = (triangle.edgeY[0] * v[0].z + triangle.edgeY[1] * v[1].z + triangle.edgeY[2] * v[2].z) / area;
+		triangle.depthC = (triangle.edgeC[0] * v[0].z + triangle.edgeC[1] * v[1].z + triangle.edgeC[2] * v[2].z) / area;
+
+		// Pixels whose centers can fall inside, clamped to the buffer before converting so huge coordinates stay in range.
+		float minX = std::min(v[0].x, std::min(v[1].x, v[2].x)), maxX = std::max(v[0].x, std::max(v[1].x, v[2].x));
+		float minY = std::min(v[0].y, std::min(v[1].y, v[2].y)), maxY = std::max(v[0].y, std::max(v[1].y, v[2].y));
+		triangle.minX = static_cast<int>(std::ceil(std::max(minX - 0.5f, 0.0f)));
+		triangle.maxX = static_cast<int>(std::floor(std::min(maxX - 0.5f, static_cast<float>(Width - 1))));
+		triangle.minY = static_cast<int>(std::ceil(std::max(minY - 0.5f, 0.0f)));
+		triangle.maxY = static_cast<int>(std::floor(std::min(maxY - 0.5f, static_cast<float>(Height - 1))));
+		if (triangle.minX > triangle.maxX) {
+			triangle.minY = 1;
+			triangle.maxY = 0;
+		}
+	}
+
+	void rasterizeBand(uint32_t band) {
+		int bandTop = static_cast<int>(band * BandHeight);
+		int bandBottom = bandTop + static_cast<int>(BandHeight) - 1;
+		std::fill(depth.begin() + bandTop * Width, depth.begin() + (bandBottom + 1) * Width, 1.0f);
+
+		for (auto & triangle : triangles) {
+			int top = std::max(triangle.minY, bandTop);
+			int bottom = std::min(triangle.maxY, bandBottom);
+			for (int y = top; y <= bottom; y++) {
+				rasterizeRow(triangle, y, &depth[y * Width]);
+			}
+		}
+	}
+
+	static void rasterizeRow(const Triangle & triangle, int y, float * row) {
+		float centerY = y + 0.5f;
+		float rowEdges[3];
+		for (int i = 0; i < 3; i++) {
+			rowEdges[i] = triangle.edgeY[i] * centerY + triangle.edgeC[i];
+		}
+		float rowDepth = triangle.depthY * centerY + triangle.depthC;
+
+#ifdef OCCLUSION_RASTERIZER_SIMD
+		// Width is a multiple of 4, so aligning the start down never leaves the row. Lanes outside the bounds are
+		// still tested against the edges and only written when they really are inside.
+		__m128 zero = _mm_setzero_ps();
+		__m128 centerOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+		__m128 edgeX[3], edgeRow[3];
+		for (int i = 0; i < 3; i++) {
+			edgeX[i] = _mm_set1_ps(triangle.edgeX[i]);
+			edgeRow[i] = _mm_set1_ps(rowEdges[i]);
+		}
+		__m128 depthX = _mm_set1_ps(triangle.depthX);
+		__m128 depthRow = _mm_set1_ps(rowDepth);
+
+		for (int x = triangle.minX & ~3; x <= triangle.maxX; x += 4) {
+			__m128 centerX = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), centerOffsets);
+			__m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeX[0], centerX), edgeRow[0]), zero);
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeX[1], centerX), edgeRow[1]), zero));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeX[2], centerX), edgeRow[2]), zero));
+
+			__m128 current = _mm_loadu_ps(row + x);
+			__m128 nearer = _mm_min_ps(current, _mm_add_ps(_mm_mul_ps(depthX, centerX), depthRow));
+			_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, current)));
+		}
+#else
+		for (int x = triangle.minX; x <= triangle.maxX; x++) {
+			float centerX = x + 0.5f;
+			bool inside = true;
+			for (int i = 0; i < 3; i++) {
+				inside = inside && triangle.edgeX[i] * centerX + rowEdges[i] >= 0.0f;
+			}
+			if (inside) {
+				row[x] = std::min(row[x], triangle.depthX * centerX + rowDepth);
+			}
+		}
+#endif
+	}
+
+	std::vector<Occluder> occluders;
+	std::vector<Triangle> triangles;
+	std::vector<float> depth;
+	glm::mat4 viewProjection = glm::mat4(1.0f);
+};
@@ -0,0 +1,281 @@
+#pragma once
+#include <vulkan\vulkan.h>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#include <Exception.h>
+
+/// <summary>
+/// One update-after-bind descriptor set holding every storage buffer and image the renderer uses. Shaders pick their
+/// resources with an index passed in push constants, so a command buffer binds this set once instead of once per draw.
+/// </summary>
+class BindlessTable
+{
+public:
+	static const uint32_t StorageBufferBinding = 0;
+	static const uint32_t ImageBinding = 1;
+
+	static std::vector<const char *> RequiredDeviceExtensions() {
+		return { VK_KHR_MAINTENANCE3_EXTENSION_NAME, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME };
+	}
+
+	/// <summary>
+	/// Needs VK_KHR_get_physical_device_properties2 on the instance. Fills in the features to enable on the device and the
+	/// update-after-bind limits, and returns false when the device can't run the table.
+	/// </summary>
+	static bool QuerySupport(VkInstance instance, VkPhysicalDevice physicalDevice,
+		VkPhysicalDeviceDescriptorIndexingFeaturesEXT * enabledFeatures, VkPhysicalDeviceDescriptorIndexingPropertiesEXT * properties) {
+		auto getFeatures = (PFN_vkGetPhysicalDeviceFeatures2KHR)vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceFeatures2KHR");
+		auto getProperties = (PFN_vkGetPhysicalDeviceProperties2KHR)vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceProperties2KHR");
+		if (getFeatures == nullptr || getProperties == nullptr) {
+			return false;
+		}
+
+		VkPhysicalDeviceDescriptorIndexingFeaturesEXT supported = {};
+		supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+		VkPhysicalDeviceFeatures2KHR features = {};
+		features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+		features.pNext = &supported;
+		getFeatures(physicalDevice, &features);
+
+		if (!supported.runtimeDescriptorArray ||
+			!supported.descriptorBindingPartiallyBound ||
+			!supported.descriptorBindingUpdateUnusedWhilePending ||
+			!supported.descriptorBindingStorageBufferUpdateAfterBind ||
+			!supported.descriptorBindingSampledImageUpdateAfterBind) {
+			return false;
+		}
+
+		*enabledFeatures = {};
+		enabledFeatures->sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+		enabledFeatures->runtimeDescriptorArray = VK_TRUE;
+		enabledFeatures->descriptorBindingPartiallyBound = VK_TRUE;
+		enabledFeatures->descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+		enabledFeatures->descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+		enabledFeatures->descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+		// Only needed when an index differs within a draw, enabled when present so shaders may use nonuniformEXT.
+		enabledFeatures->shaderStorageBufferArrayNonUniformIndexing = supported.shaderStorageBufferArrayNonUniformIndexing;
+		enabledFeatures->shaderSampledImageArrayNonUniformIndexing = supported.shaderSampledImageArrayNonUniformIndexing;
+
+		*properties = {};
+		properties->sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+		VkPhysicalDeviceProperties2KHR deviceProperties = {};
+		deviceProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2_KHR;
+		deviceProperties.pNext = properties;
+		getProperties(physicalDevice, &deviceProperties);
+		return true;
+	}
+
+	/// <summary>
+	/// The requested sizes are clamped to the device's update-after-bind limits, per descriptor type and per stage.
+	/// </summary>
+	void Initialize(VkDevice device, const VkPhysicalDeviceDescriptorIndexingPropertiesEXT & limits, uint32_t maxStorageBuffers, uint32_t maxImages) {
+		this->device = device;
+		storageBuffers.capacity = std::min({ maxStorageBuffers,
+			limits.maxPerStageDescriptorUpdateAfterBindStorageBuffers,
+			limits.maxDescriptorSetUpdateAfterBindStorageBuffers });
+		// Combined image samplers count against both the sampler and the sampled image limits.
+		images.capacity = std::min({ maxImages,
+			limits.maxPerStageDescriptorUpdateAfterBindSampledImages,
+			limits.maxPerStageDescriptorUpdateAfterBindSamplers,
+			limits.maxDescriptorSetUpdateAfterBindSampledImages,
+			limits.maxDescriptorSetUpdateAfterBindSamplers });
+
+		// Both bindings are visible to every stage, so each stage sees the two arrays together. Over that budget the
+		// arrays give up room in proportion to their size.
+		auto perStage = static_cast<uint64_t>(limits.maxPerStageUpdateAfterBindResources);
+		auto total = static_cast<uint64_t>(storageBuffers.capacity) + images.capacity;
+		if (total > perStage) {
+			storageBuffers.capacity = static_cast<uint32_t>(perStage * storageBuffers.capacity / total);
+			images.capacity = static_cast<uint32_t>(perStage - storageBuffers.capacity);
+		}
+		if (storageBuffers.capacity == 0 && images.capacity == 0) {
+			throw std::runtime_error("Bindless descriptor table has no room for any descriptor!");
+		}
+		storageBuffers.used.assign(storageBuffers.capacity, false);
+		images.used.assign(images.capacity, false);
+
+		createSetLayout();
+		createPool();
+		allocateSet();
+	}
+
+	/// <summary>
+	/// Index shaders use to reach the buffer. Writing a free slot is allowed while command buffers using the set are pending.
+	/// </summary>
+	uint32_t AddStorageBuffer(VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE) {
+		auto index = storageBuffers.Acquire();
+
+		VkDescriptorBufferInfo bufferInfo = {};
+		bufferInfo.buffer = buffer;
+		bufferInfo.offset = offset;
+		bufferInfo.range = range;
+
+		auto descriptorWrite = write(StorageBufferBinding, index, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+		descriptorWrite.pBufferInfo = &bufferInfo;
+		vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+		return index;
+	}
+
+	uint32_t AddImage(VkImageView imageView, VkSampler sampler, VkImageLayout imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
+		auto index = images.Acquire();
+
+		VkDescriptorImageInfo imageInfo = {};
+		imageInfo.imageView = imageView;
+		imageInfo.sampler = sampler;
+		imageInfo.imageLayout = imageLayout;
+
+		auto descriptorWrite = write(ImageBinding, index, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		descriptorWrite.pImageInfo = &imageInfo;
+		vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+		return index;
+	}
+
+	/// <summary>
+	/// Makes the index available again. No recorded draw that is still in flight may read it afterwards. Removing an
+	/// index that isn't in use throws, a second release would hand the slot to two resources.
+	/// </summary>
+	void RemoveStorageBuffer(uint32_t index) {
+		storageBuffers.Release(index);
+	}
+
+	void RemoveImage(uint32_t index) {
+		images.Release(index);
+	}
+
+	void Bind(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, VkPipelineLayout layout, uint32_t set = 0) const {
+		vkCmdBindDescriptorSets(commandBuffer, bindPoint, layout, set, 1, &descriptorSet, 0, nullptr);
+	}
+
+	VkDescriptorSetLayout GetSetLayout() const {
+		return setLayout;
+	}
+
+	VkDescriptorSet GetSet() const {
+		return descriptorSet;
+	}
+
+	void Cleanup() {
+		if (device == VK_NULL_HANDLE) return;
+
+		vkDestroyDescriptorPool(device, pool, nullptr);
+		vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+		pool = VK_NULL_HANDLE;
+		setLayout = VK_NULL_HANDLE;
+		descriptorSet = VK_NULL_HANDLE;
+	}
+
+private:
+	struct Slots
+	{
+		uint32_t capacity = 0;
+		uint32_t next = 0;
+		std::vector<uint32_t> released;
+		std::vector<bool> used;
+
+		uint32_t Acquire() {
+			uint32_t index;
+			if (!released.empty()) {
+				index = released.back();
+				released.pop_back();
+			}
+			else if (next == capacity) {
+				throw std::runtime_error("Bindless descriptor table is full!");
+			}
+			else {
+				index = next++;
+			}
+			used[index] = true;
+			return index;
+		}
+
+		void Release(uint32_t index) {
+			if (index >= next || !used[index]) {
+				throw std::runtime_error("Bindless descriptor index released while not in use!");
+			}
+			used[index] = false;
+			released.push_back(index);
+		}
+	};
+
+	VkWriteDescriptorSet write(uint32_t binding, uint32_t index, VkDescriptorType type) const {
+		VkWriteDescriptorSet descriptorWrite = {};
+		descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrite.dstSet = descriptorSet;
+		descriptorWrite.dstBinding = binding;
+		descriptorWrite.dstArrayElement = index;
+		descriptorWrite.descriptorType = type;
+		descriptorWrite.descriptorCount = 1;
+		return descriptorWrite;
+	}
+
+	void createSetLayout() {
+		std::vector<VkDescriptorSetLayoutBinding> bindings(2);
+		bindings[0].binding = StorageBufferBinding;
+		bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[0].descriptorCount = storageBuffers.capacity;
+		bindings[0].stageFlags = VK_SHADER_STAGE_ALL;
+		bindings[1].binding = ImageBinding;
+		bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		bindings[1].descriptorCount = images.capacity;
+		bindings[1].stageFlags = VK_SHADER_STAGE_ALL;
+
+		// Slots are filled as resources arrive and rewritten while earlier frames are still executing.
+		VkDescriptorBindingFlagsEXT flags = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT |
+			VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT |
+			VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT;
+		std::vector<VkDescriptorBindingFlagsEXT> bindingFlags(bindings.size(), flags);
+
+		VkDescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsInfo = {};
+		bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+		bindingFlagsInfo.bindingCount = static_cast<uint32_t>(bindingFlags.size());
+		bindingFlagsInfo.pBindingFlags = bindingFlags.data();
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.pNext = &bindingFlagsInfo;
+		layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+		layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+		layoutInfo.pBindings = bindings.data();
+
+		vkOk(vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &setLayout), "Failed to create bindless descriptor set layout!");
+	}
+
+	void createPool() {
+		// A pool size may not be empty, a binding the device left no room for gets none.
+		std::vector<VkDescriptorPoolSize> poolSizes;
+		if (storageBuffers.capacity > 0) {
+			poolSizes.push_back({ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, storageBuffers.capacity });
+		}
+		if (images.capacity > 0) {
+			poolSizes.push_back({ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, images.capacity });
+		}
+
+		VkDescriptorPoolCreateInfo poolInfo = {};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+		poolInfo.maxSets = 1;
+		poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+		poolInfo.pPoolSizes = poolSizes.data();
+
+		vkOk(vkCreateDescriptorPool(device, &poolInfo, nullptr, &pool), "Failed to create bindless descriptor pool!");
+	}
+
+	void allocateSet() {
+		VkDescriptorSetAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = pool;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &setLayout;
+
+		vkOk(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet), "Failed to allocate bindless descriptor set!");
+	}
+
+	VkDevice device = VK_NULL_HANDLE;
+	VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+	VkDescriptorPool pool = VK_NULL_HANDLE;
+	VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+	Slots storageBuffers;
+	Slots images;
+};
@@ -0,0 +1,136 @@
+#pragma once
+#include <vulkan\vulkan.h>
+#include <vector>
+#include <algorithm>
+
+#include <Exception.h>
+
+struct DescriptorPoolRatio
+{
+	VkDescriptorType type;
+	// Descriptors of this type reserved per set in the pool.
+	float perSet;
+};
+
+/// <summary>
+/// Hands out descriptor sets from a list of pools, creating a larger pool whenever the current one runs out.
+/// Sets are never freed one at a time, Reset returns every pool to the allocator in a single call per pool.
+/// </summary>
+class DescriptorAllocator
+{
+public:
+	void Initialize(VkDevice device, uint32_t setsPerPool = 64, std::vector<DescriptorPoolRatio> ratios = DefaultPoolRatios()) {
+		this->device = device;
+		this->setsPerPool = setsPerPool;
+		this->ratios = std::move(ratios);
+	}
+
+	VkDescriptorSet Allocate(VkDescriptorSetLayout layout) {
+		if (currentPool == VK_NULL_HANDLE) {
+			currentPool = grabPool();
+		}
+
+		VkDescriptorSet descriptorSet;
+		auto result = allocate(currentPool, layout, &descriptorSet);
+		if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL) {
+			currentPool = grabPool();
+			result = allocate(currentPool, layout, &descriptorSet);
+		}
+
+		vkOk(result, "Failed to allocate descriptor set!");
+		return descriptorSet;
+	}
+
+	/// <summary>
+	/// Invalidates every set handed out so far. The caller has to know the GPU is done with them.
+	/// </summary>
+	void Reset() {
+		for (auto pool : usedPools) {
+			vkResetDescriptorPool(device, pool, 0);
+			freePools.push_back(pool);
+		}
+		usedPools.clear();
+		currentPool = VK_NULL_HANDLE;
+	}
+
+	void Cleanup() {
+		for (auto pool : usedPools) {
+			vkDestroyDescriptorPool(device, pool, nullptr);
+		}
+		for (auto pool : freePools) {
+			vkDestroyDescriptorPool(device, pool, nullptr);
+		}
+		usedPools.clear();
+		freePools.clear();
+		currentPool = VK_NULL_HANDLE;
+	}
+
+	static std::vector<DescriptorPoolRatio> DefaultPoolRatios() {
+		return {
+			{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2.0f },
+			{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.0f },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2.0f },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 0.5f },
+			{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4.0f },
+			{ VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1.0f },
+			{ VK_DESCRIPTOR_TYPE_SAMPLER, 0.5f },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1.0f },
+			{ VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 0.5f }
+		};
+	}
+
+private:
+	static const uint32_t maxSetsPerPool = 4096;
+
+	VkResult allocate(VkDescriptorPool pool, VkDescriptorSetLayout layout, VkDescriptorSet * descriptorSet) {
+		VkDescriptorSetAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = pool;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &layout;
+		return vkAllocateDescriptorSets(device, &allocInfo, descriptorSet);
+	}
+
+	VkDescriptorPool grabPool() {
+		VkDescriptorPool pool;
+		if (!freePools.empty()) {
+			pool = freePools.back();
+			freePools.pop_back();
+		}
+		else {
+			pool = createPool(setsPerPool);
+			// Every pool after the first means the estimate was low, the next one is twice as large.
+			setsPerPool = std::min(setsPerPool * 2, maxSetsPerPool);
+		}
+
+		usedPools.push_back(pool);
+		return pool;
+	}
+
+	VkDescriptorPool createPool(uint32_t setCount) {
+		std::vector<VkDescriptorPoolSize> poolSizes;
+		for (auto & ratio : ratios) {
+			VkDescriptorPoolSize poolSize = {};
+			poolSize.type = ratio.type;
+			poolSize.descriptorCount = std::max(1u, static_cast<uint32_t>(ratio.perSet * setCount));
+			poolSizes.push_back(poolSize);
+		}
+
+		VkDescriptorPoolCreateInfo poolInfo = {};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.maxSets = setCount;
+		poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+		poolInfo.pPoolSizes = poolSizes.data();
+
+		VkDescriptorPool pool;
+		vkOk(vkCreateDescriptorPool(device, &poolInfo, nullptr, &pool), "Failed to create descriptor pool!");
+		return pool;
+	}
+
+	VkDevice device = VK_NULL_HANDLE;
+	uint32_t setsPerPool = 64;
+	std::vector<DescriptorPoolRatio> ratios;
+	VkDescriptorPool currentPool = VK_NULL_HANDLE;
+	std::vector<VkDescriptorPool> usedPools;
+	std::vector<VkDescriptorPool> freePools;
+};
@@ -0,0 +1,84 @@
+#pragma once
+#include <vulkan\vulkan.h>
+#include <vector>
+#include <algorithm>
+
+#include <Systems\Descriptors\DescriptorLayoutCache.h>
+
+/// <summary>
+/// Set indices by how often their contents change. Rebinding a set leaves every lower set bound, so the sets that change
+/// least come first: frame data at 0 up to per draw data at 3.
+/// </summary>
+enum DescriptorFrequency : uint32_t
+{
+	FrameSet = 0,
+	PassSet = 1,
+	MaterialSet = 2,
+	DrawSet = 3,
+	DescriptorFrequencyCount = 4
+};
+
+/// <summary>
+/// Binds descriptor sets into one command buffer and drops binds that would not change anything: the same set with the
+/// same dynamic offsets as the one still bound at that index. Switching to a pipeline layout only keeps the sets the
+/// two layouts agree on, which the layout cache can tell for layouts it created.
+/// </summary>
+class DescriptorBinder
+{
+public:
+	DescriptorBinder(VkCommandBuffer commandBuffer, VkPipelineLayout layout, const DescriptorLayoutCache * layoutCache = nullptr,
+		VkPipelineBindPoint bindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS)
+		: commandBuffer(commandBuffer), layout(layout), layoutCache(layoutCache), bindPoint(bindPoint) {
+
+	}
+
+	/// <summary>
+	/// Call after binding a pipeline whose layout may differ from the previous one.
+	/// </summary>
+	void UseLayout(VkPipelineLayout layout) {
+		if (layout == this->layout) return;
+
+		uint32_t kept = layoutCache ? layoutCache->CompatibleSetCount(this->layout, layout) : 0;
+		for (uint32_t set = kept; set < bound.size(); set++) {
+			bound[set] = {};
+		}
+		this->layout = layout;
+	}
+
+	void Bind(uint32_t setIndex, VkDescriptorSet set, uint32_t dynamicOffsetCount = 0, const uint32_t * dynamicOffsets = nullptr) {
+		if (setIndex >= bound.size()) {
+			bound.resize(setIndex + 1);
+		}
+
+		auto & current = bound[setIndex];
+		if (current.set == set && current.dynamicOffsets.size() == dynamicOffsetCount &&
+			std::equal(dynamicOffsets, dynamicOffsets + dynamicOffsetCount, current.dynamicOffsets.begin())) {
+			skipped++;
+			return;
+		}
+
+		vkCmdBindDescriptorSets(commandBuffer, bindPoint, layout, setIndex, 1, &set, dynamicOffsetCount, dynamicOffsets);
+		current.set = set;
+		current.dynamicOffsets.assign(dynamicOffsets, dynamicOffsets + dynamicOffsetCount);
+		binds++;
+	}
+
+	VkPipelineLayout GetLayout() const { return layout; }
+	uint32_t Binds() const { return binds; }
+	uint32_t SkippedBinds() const { return skipped; }
+
+private:
+	struct BoundSet
+	{
+		VkDescriptorSet set = VK_NULL_HANDLE;
+		std::vector<uint32_t> dynamicOffsets;
+	};
+
+	VkCommandBuffer commandBuffer;
+	VkPipelineLayout layout;
+	const DescriptorLayoutCache * layoutCache;
+	VkPipelineBindPoint bindPoint;
+	std::vector<BoundSet> bound = std::vector<BoundSet>(DescriptorFrequencyCount);
+	uint32_t binds = 0;
+	uint32_t skipped = 0;
+};
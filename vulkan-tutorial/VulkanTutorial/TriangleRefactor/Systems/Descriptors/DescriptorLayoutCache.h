@@ -0,0 +1,133 @@
+#pragma once
+#include <vulkan\vulkan.h>
+#include <vector>
+#include <map>
+#include <tuple>
+#include <algorithm>
+
+#include <Exception.h>
+#include <Systems\Shaders\ShaderReflection.h>
+
+/// <summary>
+/// Creates each distinct descriptor set layout and pipeline layout once. Pipelines declaring the same sets and push
+/// constants get the same handles, which keeps their layouts compatible so bound sets survive a pipeline change.
+/// </summary>
+class DescriptorLayoutCache
+{
+public:
+	void Initialize(VkDevice device) {
+		this->device = device;
+	}
+
+	VkDescriptorSetLayout GetSetLayout(std::vector<VkDescriptorSetLayoutBinding> bindings, VkDescriptorSetLayoutCreateFlags flags = 0) {
+		std::sort(bindings.begin(), bindings.end(), [](const VkDescriptorSetLayoutBinding & a, const VkDescriptorSetLayoutBinding & b) {
+			return a.binding < b.binding;
+		});
+
+		SetLayoutKey key;
+		key.first = flags;
+		for (auto & binding : bindings) {
+			key.second.push_back(std::make_tuple(binding.binding, binding.descriptorType, binding.descriptorCount, binding.stageFlags, binding.pImmutableSamplers));
+		}
+
+		auto existing = setLayouts.find(key);
+		if (existing != setLayouts.end()) {
+			return existing->second;
+		}
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.flags = flags;
+		layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+		layoutInfo.pBindings = bindings.data();
+
+		VkDescriptorSetLayout setLayout;
+		vkOk(vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &setLayout), "Failed to create descriptor set layout!");
+		setLayouts[key] = setLayout;
+		return setLayout;
+	}
+
+	/// <summary>
+	/// One layout per set index the reflected stages use, in set order.
+	/// </summary>
+	std::vector<VkDescriptorSetLayout> GetSetLayouts(const PipelineReflection & reflection) {
+		std::vector<VkDescriptorSetLayout> layouts;
+		for (auto & bindings : reflection.SetLayoutBindings()) {
+			layouts.push_back(GetSetLayout(bindings));
+		}
+		return layouts;
+	}
+
+	VkPipelineLayout GetPipelineLayout(const std::vector<VkDescriptorSetLayout> & layouts, const std::vector<VkPushConstantRange> & pushConstantRanges) {
+		auto pipelineLayoutInfo = PipelineLayoutBuilder(static_cast<uint32_t>(layouts.size()), layouts.data())
+			.WithPushConstants(static_cast<uint32_t>(pushConstantRanges.size()), pushConstantRanges.data())
+			->Build();
+		return GetPipelineLayout(pipelineLayoutInfo);
+	}
+
+	VkPipelineLayout GetPipelineLayout(const VkPipelineLayoutCreateInfo & pipelineLayoutInfo) {
+		PipelineLayoutKey key;
+		std::get<0>(key) = pipelineLayoutInfo.flags;
+		std::get<1>(key).assign(pipelineLayoutInfo.pSetLayouts, pipelineLayoutInfo.pSetLayouts + pipelineLayoutInfo.setLayoutCount);
+		for (uint32_t i = 0; i < pipelineLayoutInfo.pushConstantRangeCount; i++) {
+			auto & range = pipelineLayoutInfo.pPushConstantRanges[i];
+			std::get<2>(key).push_back(std::make_tuple(range.stageFlags, range.offset, range.size));
+		}
+
+		auto existing = pipelineLayouts.find(key);
+		if (existing != pipelineLayouts.end()) {
+			return existing->second;
+		}
+
+		VkPipelineLayout pipelineLayout;
+		vkOk(vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout), "Failed to create the pipeline layout!");
+		pipelineLayouts[key] = pipelineLayout;
+		pipelineLayoutKeys[pipelineLayout] = key;
+		return pipelineLayout;
+	}
+
+	/// <summary>
+	/// How many leading sets stay bound when switching from one pipeline layout to the other. Layouts that didn't come from
+	/// this cache are assumed to share nothing.
+	/// </summary>
+	uint32_t CompatibleSetCount(VkPipelineLayout from, VkPipelineLayout to) const {
+		auto fromKey = pipelineLayoutKeys.find(from);
+		auto toKey = pipelineLayoutKeys.find(to);
+		if (fromKey == pipelineLayoutKeys.end() || toKey == pipelineLayoutKeys.end()) return 0;
+
+		// Layouts with different push constant ranges are incompatible at every set.
+		if (std::get<2>(fromKey->second) != std::get<2>(toKey->second)) return 0;
+
+		auto & fromSets = std::get<1>(fromKey->second);
+		auto & toSets = std::get<1>(toKey->second);
+		uint32_t count = 0;
+		while (count < fromSets.size() && count < toSets.size() && fromSets[count] == toSets[count]) {
+			count++;
+		}
+		return count;
+	}
+
+	void Cleanup() {
+		for (auto & pipelineLayout : pipelineLayouts) {
+			vkDestroyPipelineLayout(device, pipelineLayout.second, nullptr);
+		}
+		pipelineLayouts.clear();
+		pipelineLayoutKeys.clear();
+
+		for (auto & setLayout : setLayouts) {
+			vkDestroyDescriptorSetLayout(device, setLayout.second, nullptr);
+		}
+		setLayouts.clear();
+	}
+
+private:
+	typedef std::tuple<uint32_t, VkDescriptorType, uint32_t, VkShaderStageFlags, const VkSampler*> BindingKey;
+	typedef std::pair<VkDescriptorSetLayoutCreateFlags, std::vector<BindingKey>> SetLayoutKey;
+	typedef std::tuple<VkShaderStageFlags, uint32_t, uint32_t> PushConstantKey;
+	typedef std::tuple<VkPipelineLayoutCreateFlags, std::vector<VkDescriptorSetLayout>, std::vector<PushConstantKey>> PipelineLayoutKey;
+
+	VkDevice device = VK_NULL_HANDLE;
+	std::map<SetLayoutKey, VkDescriptorSetLayout> setLayouts;
+	std::map<PipelineLayoutKey, VkPipelineLayout> pipelineLayouts;
+	std::map<VkPipelineLayout, PipelineLayoutKey> pipelineLayoutKeys;
+};
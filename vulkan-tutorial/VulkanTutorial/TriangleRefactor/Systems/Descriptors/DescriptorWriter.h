@@ -0,0 +1,273 @@
+#pragma once
+#include <vulkan\vulkan.h>
+#include <vector>
+#include <cstdint>
+#include <stdexcept>
+
+#include <Exception.h>
+
+static bool isImageDescriptor(VkDescriptorType type) {
+	return type == VK_DESCRIPTOR_TYPE_SAMPLER ||
+		type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER ||
+		type == VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE ||
+		type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE ||
+		type == VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+}
+
+/// <summary>
+/// Entry points of the optional descriptor extensions. A null pointer means the extension isn't enabled on the device.
+/// </summary>
+struct DescriptorFunctions
+{
+	PFN_vkCreateDescriptorUpdateTemplateKHR createUpdateTemplate = nullptr;
+	PFN_vkDestroyDescriptorUpdateTemplateKHR destroyUpdateTemplate = nullptr;
+	PFN_vkUpdateDescriptorSetWithTemplateKHR updateWithTemplate = nullptr;
+	PFN_vkCmdPushDescriptorSetKHR pushDescriptorSet = nullptr;
+	PFN_vkCmdPushDescriptorSetWithTemplateKHR pushWithTemplate = nullptr;
+
+	static DescriptorFunctions Load(VkDevice device, bool updateTemplates, bool pushDescriptors) {
+		DescriptorFunctions functions;
+		if (updateTemplates) {
+			functions.createUpdateTemplate = (PFN_vkCreateDescriptorUpdateTemplateKHR)vkGetDeviceProcAddr(device, "vkCreateDescriptorUpdateTemplateKHR");
+			functions.destroyUpdateTemplate = (PFN_vkDestroyDescriptorUpdateTemplateKHR)vkGetDeviceProcAddr(device, "vkDestroyDescriptorUpdateTemplateKHR");
+			functions.updateWithTemplate = (PFN_vkUpdateDescriptorSetWithTemplateKHR)vkGetDeviceProcAddr(device, "vkUpdateDescriptorSetWithTemplateKHR");
+		}
+		if (pushDescriptors) {
+			functions.pushDescriptorSet = (PFN_vkCmdPushDescriptorSetKHR)vkGetDeviceProcAddr(device, "vkCmdPushDescriptorSetKHR");
+		}
+		if (updateTemplates && pushDescriptors) {
+			functions.pushWithTemplate = (PFN_vkCmdPushDescriptorSetWithTemplateKHR)vkGetDeviceProcAddr(device, "vkCmdPushDescriptorSetWithTemplateKHR");
+		}
+		return functions;
+	}
+
+	bool UpdateTemplates() const { return createUpdateTemplate && destroyUpdateTemplate && updateWithTemplate; }
+	bool PushDescriptors() const { return pushDescriptorSet != nullptr; }
+};
+
+/// <summary>
+/// Collects descriptor writes and hands them to the driver in a single call, either as a set update or as push descriptors.
+/// </summary>
+class DescriptorWriter
+{
+public:
+	DescriptorWriter(VkDescriptorSet set = VK_NULL_HANDLE) : set(set) {
+
+	}
+
+	/// <summary>
+	/// Writes added after this target set, ignored when the writes are pushed.
+	/// </summary>
+	DescriptorWriter* ForSet(VkDescriptorSet set) {
+		this->set = set;
+		return this;
+	}
+
+	DescriptorWriter* WriteBuffer(uint32_t binding, VkDescriptorType type, const VkDescriptorBufferInfo & bufferInfo, uint32_t arrayElement = 0) {
+		pending.push_back({ write(binding, type, arrayElement), bufferInfos.size() });
+		bufferInfos.push_back(bufferInfo);
+		return this;
+	}
+
+	DescriptorWriter* WriteImage(uint32_t binding, VkDescriptorType type, const VkDescriptorImageInfo & imageInfo, uint32_t arrayElement = 0) {
+		pending.push_back({ write(binding, type, arrayElement), imageInfos.size() });
+		imageInfos.push_back(imageInfo);
+		return this;
+	}
+
+	/// <summary>
+	/// One vkUpdateDescriptorSets for everything collected. Passing a set sends every write to it instead of its own target.
+	/// </summary>
+	void Update(VkDevice device, VkDescriptorSet retarget = VK_NULL_HANDLE) {
+		auto writes = resolve(retarget);
+		if (!writes.empty()) {
+			vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+		}
+		Clear();
+	}
+
+	/// <summary>
+	/// Records the writes straight into the command buffer, no set is allocated or bound. The set layout has to be created
+	/// with VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR.
+	/// </summary>
+	void Push(const DescriptorFunctions & functions, VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, VkPipelineLayout layout, uint32_t setIndex) {
+		if (!functions.PushDescriptors()) {
+			throw std::runtime_error("Push descriptors are not enabled on this device");
+		}
+
+		auto writes = resolve(VK_NULL_HANDLE);
+		if (!writes.empty()) {
+			functions.pushDescriptorSet(commandBuffer, bindPoint, layout, setIndex, static_cast<uint32_t>(writes.size()), writes.data());
+		}
+		Clear();
+	}
+
+	void Clear() {
+		pending.clear();
+		bufferInfos.clear();
+		imageInfos.clear();
+	}
+
+private:
+	struct PendingWrite
+	{
+		VkWriteDescriptorSet write;
+		// Index into bufferInfos or imageInfos, pointers are only taken once the vectors stop growing.
+		size_t info;
+	};
+
+	VkWriteDescriptorSet write(uint32_t binding, VkDescriptorType type, uint32_t arrayElement) const {
+		VkWriteDescriptorSet descriptorWrite = {};
+		descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrite.dstSet = set;
+		descriptorWrite.dstBinding = binding;
+		descriptorWrite.dstArrayElement = arrayElement;
+		descriptorWrite.descriptorType = type;
+		descriptorWrite.descriptorCount = 1;
+		return descriptorWrite;
+	}
+
+	std::vector<VkWriteDescriptorSet> resolve(VkDescriptorSet retarget) const {
+		std::vector<VkWriteDescriptorSet> writes;
+		writes.reserve(pending.size());
+		for (auto & pendingWrite : pending) {
+			auto descriptorWrite = pendingWrite.write;
+			if (retarget != VK_NULL_HANDLE) {
+				descriptorWrite.dstSet = retarget;
+			}
+			if (isImageDescriptor(descriptorWrite.descriptorType)) {
+				descriptorWrite.pImageInfo = &imageInfos[pendingWrite.info];
+			}
+			else {
+				descriptorWrite.pBufferInfo = &bufferInfos[pendingWrite.info];
+			}
+			writes.push_back(descriptorWrite);
+		}
+		return writes;
+	}
+
+	VkDescriptorSet set;
+	std::vector<PendingWrite> pending;
+	std::vector<VkDescriptorBufferInfo> bufferInfos;
+	std::vector<VkDescriptorImageInfo> imageInfos;
+};
+
+/// <summary>
+/// Describes where each descriptor sits inside an application struct, so a whole set is written from that struct in one
+/// call. Without VK_KHR_descriptor_update_template the same entries are turned into a batched vkUpdateDescriptorSets.
+/// </summary>
+class DescriptorUpdateTemplate
+{
+public:
+	DescriptorUpdateTemplate* WithBuffer(uint32_t binding, VkDescriptorType type, size_t offset, uint32_t count = 1, size_t stride = sizeof(VkDescriptorBufferInfo)) {
+		entries.push_back({ binding, 0, count, type, offset, stride });
+		return this;
+	}
+
+	DescriptorUpdateTemplate* WithImage(uint32_t binding, VkDescriptorType type, size_t offset, uint32_t count = 1, size_t stride = sizeof(VkDescriptorImageInfo)) {
+		entries.push_back({ binding, 0, count, type, offset, stride });
+		return this;
+	}
+
+	/// <summary>
+	/// Template for sets allocated from setLayout.
+	/// </summary>
+	void Initialize(VkDevice device, const DescriptorFunctions & functions, VkDescriptorSetLayout setLayout) {
+		this->device = device;
+		this->functions = functions;
+		if (!functions.UpdateTemplates()) return;
+
+		auto templateInfo = createInfo(VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET_KHR);
+		templateInfo.descriptorSetLayout = setLayout;
+		vkOk(functions.createUpdateTemplate(device, &templateInfo, nullptr, &updateTemplate), "Failed to create descriptor update template!");
+	}
+
+	/// <summary>
+	/// Template pushed into command buffers at set index setIndex of pipelineLayout. Needs push descriptors, the template
+	/// itself is optional.
+	/// </summary>
+	void InitializeForPush(VkDevice device, const DescriptorFunctions & functions, VkPipelineBindPoint bindPoint, VkPipelineLayout pipelineLayout, uint32_t setIndex) {
+		this->device = device;
+		this->functions = functions;
+		this->bindPoint = bindPoint;
+		this->pipelineLayout = pipelineLayout;
+		this->setIndex = setIndex;
+		pushed = true;
+		if (!functions.pushWithTemplate) return;
+
+		auto templateInfo = createInfo(VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_PUSH_DESCRIPTORS_KHR);
+		templateInfo.pipelineBindPoint = bindPoint;
+		templateInfo.pipelineLayout = pipelineLayout;
+		templateInfo.set = setIndex;
+		vkOk(functions.createUpdateTemplate(device, &templateInfo, nullptr, &updateTemplate), "Failed to create push descriptor template!");
+	}
+
+	/// <summary>
+	/// Writes set from data. A push template can't update a set, its entries go through one batched write instead.
+	/// </summary>
+	void Update(VkDescriptorSet set, const void * data) {
+		if (updateTemplate != VK_NULL_HANDLE && !pushed) {
+			functions.updateWithTemplate(device, set, updateTemplate, data);
+			return;
+		}
+		writer(data).Update(device, set);
+	}
+
+	void Push(VkCommandBuffer commandBuffer, const void * data) {
+		if (updateTemplate != VK_NULL_HANDLE) {
+			functions.pushWithTemplate(commandBuffer, updateTemplate, pipelineLayout, setIndex, data);
+			return;
+		}
+		writer(data).Push(functions, commandBuffer, bindPoint, pipelineLayout, setIndex);
+	}
+
+	/// <summary>
+	/// Binds set where a push template pushes, for devices without push descriptors.
+	/// </summary>
+	void Bind(VkCommandBuffer commandBuffer, VkDescriptorSet set) const {
+		vkCmdBindDescriptorSets(commandBuffer, bindPoint, pipelineLayout, setIndex, 1, &set, 0, nullptr);
+	}
+
+	void Cleanup() {
+		if (updateTemplate != VK_NULL_HANDLE) {
+			functions.destroyUpdateTemplate(device, updateTemplate, nullptr);
+			updateTemplate = VK_NULL_HANDLE;
+		}
+	}
+
+private:
+	VkDescriptorUpdateTemplateCreateInfoKHR createInfo(VkDescriptorUpdateTemplateTypeKHR type) const {
+		VkDescriptorUpdateTemplateCreateInfoKHR templateInfo = {};
+		templateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO_KHR;
+		templateInfo.descriptorUpdateEntryCount = static_cast<uint32_t>(entries.size());
+		templateInfo.pDescriptorUpdateEntries = entries.data();
+		templateInfo.templateType = type;
+		return templateInfo;
+	}
+
+	DescriptorWriter writer(const void * data) const {
+		DescriptorWriter descriptorWriter;
+		auto bytes = static_cast<const char *>(data);
+		for (auto & entry : entries) {
+			for (uint32_t i = 0; i < entry.descriptorCount; i++) {
+				auto element = bytes + entry.offset + entry.stride * i;
+				if (isImageDescriptor(entry.descriptorType)) {
+					descriptorWriter.WriteImage(entry.dstBinding, entry.descriptorType, *reinterpret_cast<const VkDescriptorImageInfo *>(element), entry.dstArrayElement + i);
+				}
+				else {
+					descriptorWriter.WriteBuffer(entry.dstBinding, entry.descriptorType, *reinterpret_cast<const VkDescriptorBufferInfo *>(element), entry.dstArrayElement + i);
+				}
+			}
+		}
+		return descriptorWriter;
+	}
+
+	VkDevice device = VK_NULL_HANDLE;
+	DescriptorFunctions functions;
+	std::vector<VkDescriptorUpdateTemplateEntryKHR> entries;
+	VkDescriptorUpdateTemplateKHR updateTemplate = VK_NULL_HANDLE;
+	VkPipelineBindPoint bindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+	uint32_t setIndex = 0;
+	bool pushed = false;
+};
@@ -0,0 +1,120 @@
+#pragma once
+#include <vulkan\vulkan.h>
+#include <cstring>
+#include <stdexcept>
+
+#include <Exception.h>
+#include <Systems\Graphics\MappedBuffer.h>
+
+/// <summary>
+/// Where one object's uniforms live inside each frame's slice of the shared buffer. Bind it with the allocator's
+/// Offset for the frame being recorded.
+/// </summary>
+struct DynamicUniformRange
+{
+	uint32_t offset;
+	uint32_t size;
+};
+
+/// <summary>
+/// One persistently mapped uniform buffer carved into per-object ranges. Every range is reached through the same
+/// UNIFORM_BUFFER_DYNAMIC descriptor, so any number of objects share one descriptor set and differ only by offset.
+/// Each frame in flight has its own copy of every range, a frame's copy is written once its previous submission has
+/// finished and the frame's command buffer binds that copy.
+/// </summary>
+class DynamicUniformAllocator
+{
+public:
+	/// <summary>
+	/// capacity is the room for ranges in one frame.
+	/// </summary>
+	void Initialize(VkDevice device, VkPhysicalDevice physicalDevice, VkDeviceSize capacity, uint32_t frames) {
+		this->device = device;
+
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+		alignment = properties.limits.minUniformBufferOffsetAlignment;
+		maxRange = properties.limits.maxUniformBufferRange;
+		this->capacity = capacity;
+
+		buffer.Create(device, physicalDevice, capacity, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, frames);
+	}
+
+	DynamicUniformRange Allocate(uint32_t size) {
+		if (size > maxRange) {
+			throw std::runtime_error("Uniform block is larger than maxUniformBufferRange");
+		}
+
+		auto offset = (used + alignment - 1) / alignment * alignment;
+		if (offset + size > capacity) {
+			throw std::runtime_error("Dynamic uniform buffer is full!");
+		}
+
+		used = offset + size;
+		return { static_cast<uint32_t>(offset), size };
+	}
+
+	template <typename T> DynamicUniformRange Allocate() {
+		return Allocate(sizeof(T));
+	}
+
+	/// <summary>
+	/// Writes frame's copy of the range, only once that frame's previous submission has finished.
+	/// </summary>
+	void Write(uint32_t frame, const DynamicUniformRange & range, const void * data) {
+		memcpy(buffer.As<char>(frame) + range.offset, data, range.size);
+	}
+
+	/// <summary>
+	/// Writes every frame's copy, for ranges no recorded command reads yet.
+	/// </summary>
+	void WriteAll(const DynamicUniformRange & range, const void * data) {
+		for (uint32_t frame = 0; frame < buffer.frames; frame++) {
+			Write(frame, range, data);
+		}
+	}
+
+	/// <summary>
+	/// The dynamic offset that reaches frame's copy of the range.
+	/// </summary>
+	uint32_t Offset(const DynamicUniformRange & range, uint32_t frame) const {
+		return static_cast<uint32_t>(buffer.Offset(frame) + range.offset);
+	}
+
+	/// <summary>
+	/// Descriptor contents for frame's copy of the range alone, for a plain uniform buffer binding.
+	/// </summary>
+	VkDescriptorBufferInfo FrameInfo(const DynamicUniformRange & range, uint32_t frame) const {
+		return buffer.DescriptorInfo(Offset(range, frame), range.size);
+	}
+
+	/// <summary>
+	/// Drops every range handed out, for scenes that rebuild their object list.
+	/// </summary>
+	void Reset() {
+		used = 0;
+	}
+
+	/// <summary>
+	/// Descriptor contents for the dynamic binding. The range is the window each dynamic offset shifts, so it is the
+	/// size of the block the shader declares rather than the whole buffer.
+	/// </summary>
+	VkDescriptorBufferInfo DescriptorInfo(uint32_t blockSize) const {
+		return buffer.DescriptorInfo(0, blockSize);
+	}
+
+	void Cleanup() {
+		if (device == VK_NULL_HANDLE) return;
+
+		buffer.Destroy(device);
+		device = VK_NULL_HANDLE;
+	}
+
+private:
+	VkDevice device = VK_NULL_HANDLE;
+	MappedBuffer buffer;
+	VkDeviceSize alignment = 1;
+	VkDeviceSize capacity = 0;
+	VkDeviceSize used = 0;
+	uint32_t maxRange = 0;
+};
@@ -0,0 +1,94 @@
+#pragma once
+#include <vulkan\vulkan.h>
+
+#include <Exception.h>
+#include <Builders\BufferInfoBuilder.h>
+
+/// <summary>
+/// 2D image in device local memory with a view over all of its mips, for attachments and compute targets.
+/// </summary>
+struct DeviceImage
+{
+	VkImage image = VK_NULL_HANDLE;
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkImageView view = VK_NULL_HANDLE;
+	VkFormat format = VK_FORMAT_UNDEFINED;
+	VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+	VkExtent2D extent = {};
+	uint32_t mipLevels = 0;
+
+	void Create(VkDevice device, VkPhysicalDevice physicalDevice, VkFormat format, VkExtent2D extent, uint32_t mipLevels,
+		VkImageUsageFlags usage, VkImageAspectFlags aspect) {
+		this->format = format;
+		this->aspect = aspect;
+		this->extent = extent;
+		this->mipLevels = mipLevels;
+
+		VkImageCreateInfo imageInfo = {};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = format;
+		imageInfo.extent = { extent.width, extent.height, 1 };
+		imageInfo.mipLevels = mipLevels;
+		imageInfo.arrayLayers = 1;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.usage = usage;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		vkOk(vkCreateImage(device, &imageInfo, nullptr, &image), "Failed to create an image");
+
+		VkMemoryRequirements memoryRequirements;
+		vkGetImageMemoryRequirements(device, image, &memoryRequirements);
+
+		VkMemoryAllocateInfo allocateInfo = {};
+		allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocateInfo.allocationSize = memoryRequirements.size;
+		allocateInfo.memoryTypeIndex = findMemoryType(memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, physicalDevice);
+
+		vkOk(vkAllocateMemory(device, &allocateInfo, nullptr, &memory), "Failed to allocate image memory");
+		vkBindImageMemory(device, image, memory, 0);
+		view = CreateView(device, 0, mipLevels);
+	}
+
+	/// <summary>
+	/// View of levelCount mips starting at baseLevel, destroyed by the caller.
+	/// </summary>
+	VkImageView CreateView(VkDevice device, uint32_t baseLevel, uint32_t levelCount) const {
+		VkImageViewCreateInfo viewInfo = {};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = image;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = format;
+		viewInfo.subresourceRange.aspectMask = aspect;
+		viewInfo.subresourceRange.baseMipLevel = baseLevel;
+		viewInfo.subresourceRange.levelCount = levelCount;
+		viewInfo.subresourceRange.baseArrayLayer = 0;
+		viewInfo.subresourceRange.layerCount = 1;
+
+		VkImageView imageView;
+		vkOk(vkCreateImageView(device, &viewInfo, nullptr, &imageView), "Failed to create an image view");
+		return imageView;
+	}
+
+	VkImageSubresourceRange Range(uint32_t baseLevel = 0, uint32_t levelCount = VK_REMAINING_MIP_LEVELS) const {
+		VkImageSubresourceRange range = {};
+		range.aspectMask = aspect;
+		range.baseMipLevel = baseLevel;
+		range.levelCount = levelCount;
+		range.baseArrayLayer = 0;
+		range.layerCount = 1;
+		return range;
+	}
+
+	void Destroy(VkDevice device) {
+		if (image == VK_NULL_HANDLE) return;
+
+		vkDestroyImageView(device, view, nullptr);
+		vkDestroyImage(device, image, nullptr);
+		vkFreeMemory(device, memory, nullptr);
+		image = VK_NULL_HANDLE;
+		memory = VK_NULL_HANDLE;
+		view = VK_NULL_HANDLE;
+	}
+};
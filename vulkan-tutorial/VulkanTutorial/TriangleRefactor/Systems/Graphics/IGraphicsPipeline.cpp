@@ -10,6 +10,7 @@
 #include <VkDeleter.h>
 #include <Exception.h>
 #include <memory>
+#include <iostream>
 static const char alphanum[] =
 "0123456789"
 "!@#$%^&*"
@@ -19,8 +20,9 @@ static const char alphanum[] =
 
 static const int stringLength = sizeof(alphanum) - 1;
 
-void GraphicsPipelineCreator::Initialize(const VRelease<VkDevice> & device, const VkExtent2D & swapChainExtent, const glm::vec2 & dimensions) {
+void GraphicsPipelineCreator::Initialize(const VRelease<VkDevice> & device, const VkExtent2D & swapChainExtent, const glm::vec2 & dimensions, DescriptorLayoutCache * layoutCache) {
 	this->device = device;
+	this->layoutCache = layoutCache;
 	this->swapChainExtent = swapChainExtent;
 	this->dimensions = dimensions;
 }
@@ -33,7 +35,6 @@ GraphicsPipelineCreator * GraphicsPipelineCreator::StartGraphicsPipeline(VkPipel
 	*currentViewPort = ViewportBuilder(dimensions.x, dimensions.y).Build();
 	*currentScissors = ScissorBuilder(swapChainExtent).Build();
 
-	auto pipelineLayoutInfo = PipelineLayoutBuilder().Build();
 	auto viewportStateInfo = ViewportStateBuilder(currentViewPort.get(), currentScissors.get()).Build();
 
 
@@ -42,18 +43,23 @@ GraphicsPipelineCreator * GraphicsPipelineCreator::StartGraphicsPipeline(VkPipel
 		->WithBackCulling()
 		->Build();
 
-	DestoryPipelineLayout();
-	vkOk(vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout), "Failed to create the pipeline layout!");
+	pipelineLayout = layoutCache->GetPipelineLayout(PipelineLayoutBuilder().Build());
 
 	this->currentPipelineBuilder = std::unique_ptr<GraphicsPipelineBuilder>(new GraphicsPipelineBuilder(shaderStages, viewportStateInfo, colorBlending, pipelineLayout, currentRenderPass));
 
 	return this->WithVertexInputState(vertexInput)
-		->WithRasterizationState(rasterizerState);
+		->WithRasterizationState(rasterizerState)
+		->WithDepthStencilState(DepthStencilStateBuilder().Build());
 }
 
 GraphicsPipelineCreator* GraphicsPipelineCreator::WithPipelineLayout(VkPipelineLayoutCreateInfo pipelineLayoutInfo) {
-	DestoryPipelineLayout();
-	vkOk(vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout), "Failed to create the pipeline layout!");
+	pipelineLayout = layoutCache->GetPipelineLayout(pipelineLayoutInfo);
+	currentPipelineBuilder->WithPipelineLayout(pipelineLayout);
+	return this;
+}
+
+GraphicsPipelineCreator* GraphicsPipelineCreator::WithPipelineLayout(const std::vector<VkDescriptorSetLayout> & setLayouts, const std::vector<VkPushConstantRange> & pushConstantRanges) {
+	pipelineLayout = layoutCache->GetPipelineLayout(setLayouts, pushConstantRanges);
 	currentPipelineBuilder->WithPipelineLayout(pipelineLayout);
 	return this;
 }
@@ -83,6 +89,11 @@ GraphicsPipelineCreator* GraphicsPipelineCreator::WithDepthStencilState(VkPipeli
 	return this;
 }
 
+GraphicsPipelineCreator* GraphicsPipelineCreator::WithColorBlendState(VkPipelineColorBlendStateCreateInfo inputState) {
+	currentPipelineBuilder->WithColorBlendState(inputState);
+	return this;
+}
+
 GraphicsPipelineCreator* GraphicsPipelineCreator::WithDynamicState(VkPipelineDynamicStateCreateInfo inputState) {
 	currentPipelineBuilder->WithDynamicState(inputState);
 	return this;
@@ -101,12 +112,290 @@ GraphicsPipelineCreator* GraphicsPipelineCreator::WithBasePipeline(VkPipeline pi
 
 GraphicsPipeline GraphicsPipelineCreator::Create() {
 	GraphicsPipeline pipeline = {};
-	pipeline.id = currentPipelineId;
 	auto pipelineInfo = currentPipelineBuilder->Build();
+
+	PipelineRecipe recipe;
+	recipe.Capture(pipelineInfo);
+	identifyModules(recipe);
+	pipeline.hash = recipe.Hash();
+
+	// Variants that specialize to the same constants are the same pipeline.
+	auto existing = pipelineIds.find(pipeline.hash);
+	if (existing != pipelineIds.end()) {
+		pipeline.id = existing->second;
+		pipeline.pipeline = pipelines[pipeline.id];
+		return pipeline;
+	}
+
+	pipeline.id = currentPipelineId;
 	vkOk(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline.pipeline));
+	recipes[pipeline.id] = recipe;
+	pipelines[pipeline.id] = pipeline.pipeline;
+	pipelineIds[pipeline.hash] = pipeline.id;
 	return pipeline;
 }
 
+std::vector<PipelineSwap> GraphicsPipelineCreator::RebuildWithShaderModules(const std::map<VkShaderModule, VkShaderModule> & replacements) {
+	std::vector<PipelineSwap> swaps;
+	for (auto & recipe : recipes) {
+		bool usesReplacedModule = false;
+		std::vector<VkShaderModule> previousModules;
+		for (auto & stage : recipe.second.shaderStages) {
+			previousModules.push_back(stage.module);
+			auto replacement = replacements.find(stage.module);
+			if (replacement != replacements.end()) {
+				stage.module = replacement->second;
+				usesReplacedModule = true;
+			}
+		}
+
+		if (!usesReplacedModule) continue;
+		auto previousHashes = recipe.second.moduleHashes;
+		identifyModules(recipe.second);
+
+		// A shader that compiles can still fail to link against the rest of the pipeline, keep the old one running if it
+		// does. The recipe goes back to the modules the running pipeline was built from, the next reload starts from those.
+		auto pipelineInfo = recipe.second.Build();
+		VkPipeline rebuiltPipeline;
+		auto result = vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &rebuiltPipeline);
+		if (result != VK_SUCCESS) {
+			std::cerr << "Failed to rebuild pipeline " << recipe.first << ", keeping the previous version" << std::endl;
+			for (size_t i = 0; i < previousModules.size(); i++) {
+				recipe.second.shaderStages[i].module = previousModules[i];
+			}
+			recipe.second.moduleHashes = previousHashes;
+			continue;
+		}
+
+		swaps.push_back({ recipe.first, pipelines[recipe.first], rebuiltPipeline });
+		pipelines[recipe.first] = rebuiltPipeline;
+	}
+
+	if (!swaps.empty()) {
+		rehash();
+	}
+
+	return swaps;
+}
+
+std::map<VkPipeline, VkPipeline> GraphicsPipelineCreator::RecreatePipelines(VkRenderPass renderPass, const VkExtent2D & swapChainExtent, const glm::vec2 & dimensions) {
+	SetRenderpass(renderPass);
+	SetSwapchainExtent(swapChainExtent);
+	SetDimensions(dimensions);
+
+	std::map<VkPipeline, VkPipeline> recreated;
+	for (auto & recipe : recipes) {
+		// Only the state that follows the swap chain changes, everything else is rebuilt exactly as first created.
+		auto & state = recipe.second;
+		state.pipelineInfo.renderPass = renderPass;
+		if (!state.viewports.empty()) state.viewports[0] = ViewportBuilder(dimensions.x, dimensions.y).Build();
+		if (!state.scissors.empty()) state.scissors[0] = ScissorBuilder(swapChainExtent).Build();
+
+		auto pipelineInfo = state.Build();
+		VkPipeline pipeline;
+		vkOk(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline), ("Failed to recreate pipeline " + recipe.first).c_str());
+		vkDestroyPipeline(device, pipelines[recipe.first], nullptr);
+		recreated[pipelines[recipe.first]] = pipeline;
+		pipelines[recipe.first] = pipeline;
+	}
+
+	rehash();
+	return recreated;
+}
+
+void GraphicsPipelineCreator::rehash() {
+	pipelineIds.clear();
+	for (auto & recipe : recipes) {
+		pipelineIds[recipe.second.Hash()] = recipe.first;
+	}
+}
+
+void GraphicsPipelineCreator::RegisterShaderModule(VkShaderModule module, uint64_t codeHash) {
+	moduleHashes[module] = codeHash;
+}
+
+void GraphicsPipelineCreator::ForgetShaderModule(VkShaderModule module) {
+	moduleHashes.erase(module);
+}
+
+void GraphicsPipelineCreator::identifyModules(PipelineRecipe & recipe) const {
+	recipe.moduleHashes.clear();
+	for (auto & stage : recipe.shaderStages) {
+		auto identity = moduleHashes.find(stage.module);
+		recipe.moduleHashes.push_back(identity == moduleHashes.end() ? 0 : identity->second);
+	}
+}
+
+bool GraphicsPipelineCreator::Owns(VkPipeline pipeline) const {
+	for (auto & owned : pipelines) {
+		if (owned.second == pipeline) return true;
+	}
+	return false;
+}
+
+bool GraphicsPipelineCreator::UsesShaderModule(VkShaderModule module) const {
+	for (auto & recipe : recipes) {
+		for (auto & stage : recipe.second.shaderStages) {
+			if (stage.module == module) return true;
+		}
+	}
+	return false;
+}
+
+void GraphicsPipelineCreator::ClearPipelines() {
+	for (auto & pipeline : pipelines) {
+		vkDestroyPipeline(device, pipeline.second, nullptr);
+	}
+	pipelines.clear();
+	recipes.clear();
+	pipelineIds.clear();
+}
+
+void PipelineRecipe::Capture(const VkGraphicsPipelineCreateInfo & info) {
+	pipelineInfo = info;
+	shaderStages.assign(info.pStages, info.pStages + info.stageCount);
+
+	specializations.assign(shaderStages.size(), SpecializationConstants());
+	for (size_t i = 0; i < shaderStages.size(); i++) {
+		auto specialization = shaderStages[i].pSpecializationInfo;
+		if (!specialization) continue;
+
+		auto data = static_cast<const char*>(specialization->pData);
+		specializations[i].entries.assign(specialization->pMapEntries, specialization->pMapEntries + specialization->mapEntryCount);
+		specializations[i].data.assign(data, data + specialization->dataSize);
+	}
+
+	vertexInputState = *info.pVertexInputState;
+	vertexBindings.assign(vertexInputState.pVertexBindingDescriptions, vertexInputState.pVertexBindingDescriptions + vertexInputState.vertexBindingDescriptionCount);
+	vertexAttributes.assign(vertexInputState.pVertexAttributeDescriptions, vertexInputState.pVertexAttributeDescriptions + vertexInputState.vertexAttributeDescriptionCount);
+
+	inputAssemblyState = *info.pInputAssemblyState;
+
+	viewportState = *info.pViewportState;
+	viewports.assign(viewportState.pViewports, viewportState.pViewports + viewportState.viewportCount);
+	scissors.assign(viewportState.pScissors, viewportState.pScissors + viewportState.scissorCount);
+
+	multisampleState = *info.pMultisampleState;
+	// One mask word per 32 samples.
+	size_t sampleMaskWords = (static_cast<size_t>(multisampleState.rasterizationSamples) + 31) / 32;
+	if (multisampleState.pSampleMask) {
+		sampleMask.assign(multisampleState.pSampleMask, multisampleState.pSampleMask + sampleMaskWords);
+	}
+	else {
+		sampleMask.clear();
+	}
+	rasterizationState = *info.pRasterizationState;
+
+	depthStencilState = info.pDepthStencilState ? *info.pDepthStencilState : VkPipelineDepthStencilStateCreateInfo{};
+
+	colorBlendState = info.pColorBlendState ? *info.pColorBlendState : VkPipelineColorBlendStateCreateInfo{};
+	colorBlendAttachments.assign(colorBlendState.pAttachments, colorBlendState.pAttachments + colorBlendState.attachmentCount);
+
+	dynamicState = info.pDynamicState ? *info.pDynamicState : VkPipelineDynamicStateCreateInfo{};
+	dynamicStates.assign(dynamicState.pDynamicStates, dynamicState.pDynamicStates + dynamicState.dynamicStateCount);
+}
+
+VkGraphicsPipelineCreateInfo PipelineRecipe::Build() {
+	for (size_t i = 0; i < shaderStages.size(); i++) {
+		shaderStages[i].pSpecializationInfo = specializations[i].Info();
+	}
+	vertexInputState.pVertexBindingDescriptions = vertexBindings.data();
+	vertexInputState.pVertexAttributeDescriptions = vertexAttributes.data();
+	viewportState.pViewports = viewports.data();
+	viewportState.pScissors = scissors.data();
+	multisampleState.pSampleMask = sampleMask.empty() ? nullptr : sampleMask.data();
+	colorBlendState.pAttachments = colorBlendAttachments.data();
+	dynamicState.pDynamicStates = dynamicStates.data();
+
+	auto info = pipelineInfo;
+	info.pStages = shaderStages.data();
+	info.pVertexInputState = &vertexInputState;
+	info.pInputAssemblyState = &inputAssemblyState;
+	info.pViewportState = &viewportState;
+	info.pMultisampleState = &multisampleState;
+	info.pRasterizationState = &rasterizationState;
+	info.pDepthStencilState = pipelineInfo.pDepthStencilState ? &depthStencilState : nullptr;
+	info.pColorBlendState = pipelineInfo.pColorBlendState ? &colorBlendState : nullptr;
+	info.pDynamicState = pipelineInfo.pDynamicState ? &dynamicState : nullptr;
+	return info;
+}
+
+// Fields are hashed one at a time, hashing whole structs would take in padding and pointers.
+static uint64_t hashFields(uint64_t hash) {
+	return hash;
+}
+
+template <typename T, typename... Rest> static uint64_t hashFields(uint64_t hash, const T & field, const Rest &... rest) {
+	return hashFields(hashValue(field, hash), rest...);
+}
+
+template <typename T, typename F> static uint64_t hashEach(const std::vector<T> & values, uint64_t hash, F hashElement) {
+	hash = hashValue(static_cast<uint64_t>(values.size()), hash);
+	for (auto & value : values) {
+		hash = hashElement(value, hash);
+	}
+	return hash;
+}
+
+static uint64_t hashStencil(const VkStencilOpState & stencil, uint64_t hash) {
+	return hashFields(hash, stencil.failOp, stencil.passOp, stencil.depthFailOp, stencil.compareOp, stencil.compareMask, stencil.writeMask, stencil.reference);
+}
+
+uint64_t PipelineRecipe::Hash() {
+	uint64_t hash = fnvOffsetBasis;
+	for (size_t i = 0; i < shaderStages.size(); i++) {
+		hash = hashValue(shaderStages[i].stage, hash);
+		// A module nobody identified can only be told apart by its handle.
+		hash = moduleHashes.size() > i && moduleHashes[i] != 0 ? hashValue(moduleHashes[i], hash) : hashValue(shaderStages[i].module, hash);
+		hash = hashString(shaderStages[i].pName, hash);
+		hash = specializations[i].Hash(hash);
+	}
+
+	hash = hashValue(vertexInputState.flags, hash);
+	hash = hashEach(vertexBindings, hash, [](const VkVertexInputBindingDescription & binding, uint64_t hash) {
+		return hashFields(hash, binding.binding, binding.stride, binding.inputRate);
+	});
+	hash = hashEach(vertexAttributes, hash, [](const VkVertexInputAttributeDescription & attribute, uint64_t hash) {
+		return hashFields(hash, attribute.location, attribute.binding, attribute.format, attribute.offset);
+	});
+
+	hash = hashFields(hash, inputAssemblyState.flags, inputAssemblyState.topology, inputAssemblyState.primitiveRestartEnable);
+	hash = hashEach(viewports, hash, [](const VkViewport & viewport, uint64_t hash) {
+		return hashFields(hash, viewport.x, viewport.y, viewport.width, viewport.height, viewport.minDepth, viewport.maxDepth);
+	});
+	hash = hashEach(scissors, hash, [](const VkRect2D & scissor, uint64_t hash) {
+		return hashFields(hash, scissor.offset.x, scissor.offset.y, scissor.extent.width, scissor.extent.height);
+	});
+
+	auto & multisample = multisampleState;
+	hash = hashFields(hash, multisample.flags, multisample.rasterizationSamples, multisample.sampleShadingEnable, multisample.minSampleShading,
+		multisample.alphaToCoverageEnable, multisample.alphaToOneEnable);
+	hash = hashEach(sampleMask, hash, [](VkSampleMask mask, uint64_t hash) { return hashValue(mask, hash); });
+
+	auto & rasterization = rasterizationState;
+	hash = hashFields(hash, rasterization.flags, rasterization.depthClampEnable, rasterization.rasterizerDiscardEnable, rasterization.polygonMode,
+		rasterization.cullMode, rasterization.frontFace, rasterization.depthBiasEnable, rasterization.depthBiasConstantFactor,
+		rasterization.depthBiasClamp, rasterization.depthBiasSlopeFactor, rasterization.lineWidth);
+
+	auto & depthStencil = depthStencilState;
+	hash = hashFields(hash, depthStencil.flags, depthStencil.depthTestEnable, depthStencil.depthWriteEnable, depthStencil.depthCompareOp,
+		depthStencil.depthBoundsTestEnable, depthStencil.stencilTestEnable, depthStencil.minDepthBounds, depthStencil.maxDepthBounds);
+	hash = hashStencil(depthStencil.front, hash);
+	hash = hashStencil(depthStencil.back, hash);
+
+	hash = hashFields(hash, colorBlendState.flags, colorBlendState.logicOpEnable, colorBlendState.logicOp, colorBlendState.blendConstants[0],
+		colorBlendState.blendConstants[1], colorBlendState.blendConstants[2], colorBlendState.blendConstants[3]);
+	hash = hashEach(colorBlendAttachments, hash, [](const VkPipelineColorBlendAttachmentState & blend, uint64_t hash) {
+		return hashFields(hash, blend.blendEnable, blend.srcColorBlendFactor, blend.dstColorBlendFactor, blend.colorBlendOp,
+			blend.srcAlphaBlendFactor, blend.dstAlphaBlendFactor, blend.alphaBlendOp, blend.colorWriteMask);
+	});
+	hash = hashValue(dynamicState.flags, hash);
+	hash = hashEach(dynamicStates, hash, [](VkDynamicState state, uint64_t hash) { return hashValue(state, hash); });
+
+	return hashFields(hash, pipelineInfo.flags, pipelineInfo.layout, pipelineInfo.renderPass, pipelineInfo.subpass,
+		pipelineInfo.pDepthStencilState != nullptr, pipelineInfo.pColorBlendState != nullptr, pipelineInfo.pDynamicState != nullptr);
+}
+
 void GraphicsPipelineCreator::SetDimensions(glm::vec2 dimensions) {
 	this->dimensions = dimensions;
 }
@@ -127,14 +416,16 @@ VkPipelineLayout GraphicsPipelineCreator::GetPipelineLayout() {
 	return pipelineLayout;
 }
 
-void GraphicsPipelineCreator::SetRenderpass(VkRenderPass renderPass) {
-	currentRenderPass = renderPass;
+VkPipeline GraphicsPipelineCreator::GetPipeline(const std::string & id) const {
+	auto pipeline = pipelines.find(id);
+	if (pipeline == pipelines.end()) {
+		throw std::runtime_error("Unknown graphics pipeline " + id);
+	}
+	return pipeline->second;
 }
 
-void GraphicsPipelineCreator::DestoryPipelineLayout() {
-	if (pipelineLayout) {
-		vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
-	}
+void GraphicsPipelineCreator::SetRenderpass(VkRenderPass renderPass) {
+	currentRenderPass = renderPass;
 }
 
 
@@ -153,5 +444,5 @@ std::string GraphicsPipelineCreator::generateId(unsigned int length) {
 }
 
 void GraphicsPipelineCreator::Cleanup() {
-	vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+	pipelineLayout = VK_NULL_HANDLE;
 }
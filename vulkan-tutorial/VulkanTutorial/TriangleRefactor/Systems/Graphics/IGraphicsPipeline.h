@@ -8,25 +8,75 @@
 #include <VkRelease.h>
 #include <VkDeleter.h>
 #include <Exception.h>
+#include <Systems\Descriptors\DescriptorLayoutCache.h>
 #include <memory>
 
 struct GraphicsPipeline
 {
 	VkPipeline pipeline;
 	std::string id;
+	uint64_t hash;
+};
+
+struct PipelineSwap
+{
+	std::string id;
+	VkPipeline oldPipeline;
+	VkPipeline newPipeline;
+};
+
+/// <summary>
+/// Owned copy of the create info a pipeline was built from, so it can be rebuilt after the caller's state is gone.
+/// </summary>
+struct PipelineRecipe
+{
+	void Capture(const VkGraphicsPipelineCreateInfo & info);
+	VkGraphicsPipelineCreateInfo Build();
+	/// <summary>
+	/// Covers everything the pipeline is built from, specialization constants included, field by field so padding
+	/// and pointers never reach it. Stages are identified by their SPIR-V rather than the module handle.
+	/// </summary>
+	uint64_t Hash();
+
+	std::vector<VkPipelineShaderStageCreateInfo> shaderStages;
+	std::vector<SpecializationConstants> specializations;
+	// Hash of each stage's SPIR-V, 0 for modules the creator was never told about.
+	std::vector<uint64_t> moduleHashes;
+	std::vector<VkSampleMask> sampleMask;
+	std::vector<VkVertexInputBindingDescription> vertexBindings;
+	std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+	std::vector<VkViewport> viewports;
+	std::vector<VkRect2D> scissors;
+	std::vector<VkPipelineColorBlendAttachmentState> colorBlendAttachments;
+	std::vector<VkDynamicState> dynamicStates;
+
+	VkGraphicsPipelineCreateInfo pipelineInfo;
+	VkPipelineVertexInputStateCreateInfo vertexInputState;
+	VkPipelineInputAssemblyStateCreateInfo inputAssemblyState;
+	VkPipelineViewportStateCreateInfo viewportState;
+	VkPipelineMultisampleStateCreateInfo multisampleState;
+	VkPipelineRasterizationStateCreateInfo rasterizationState;
+	VkPipelineDepthStencilStateCreateInfo depthStencilState;
+	VkPipelineColorBlendStateCreateInfo colorBlendState;
+	VkPipelineDynamicStateCreateInfo dynamicState;
 };
 
 class GraphicsPipelineCreator {
 public:
 	void Cleanup();
-	void Initialize(const VRelease<VkDevice> & device, const VkExtent2D & swapChainExtent, const glm::vec2 & dimensions);
+	void Initialize(const VRelease<VkDevice> & device, const VkExtent2D & swapChainExtent, const glm::vec2 & dimensions, DescriptorLayoutCache * layoutCache);
 	GraphicsPipelineCreator * StartGraphicsPipeline(VkPipelineVertexInputStateCreateInfo vertexInput, const std::vector<VkPipelineShaderStageCreateInfo> & shaderStages);
 	GraphicsPipelineCreator* WithPipelineLayout(VkPipelineLayoutCreateInfo pipelineLayoutInfo);
+	GraphicsPipelineCreator* WithPipelineLayout(const std::vector<VkDescriptorSetLayout> & setLayouts, const std::vector<VkPushConstantRange> & pushConstantRanges);
 	GraphicsPipelineCreator* WithVertexInputState(VkPipelineVertexInputStateCreateInfo inputState);
 	GraphicsPipelineCreator* WithInputAssemblyState(VkPipelineInputAssemblyStateCreateInfo inputState);
 	GraphicsPipelineCreator* WithMultisampleState(VkPipelineMultisampleStateCreateInfo inputState);
 	GraphicsPipelineCreator* WithRasterizationState(VkPipelineRasterizationStateCreateInfo inputState);
 	GraphicsPipelineCreator* WithDepthStencilState(VkPipelineDepthStencilStateCreateInfo inputState);
+	/// <summary>
+	/// The attachments pointed to only need to live until Create, the recipe keeps its own copy.
+	/// </summary>
+	GraphicsPipelineCreator* WithColorBlendState(VkPipelineColorBlendStateCreateInfo inputState);
 	GraphicsPipelineCreator* WithDynamicState(VkPipelineDynamicStateCreateInfo inputState);
 	GraphicsPipelineCreator* WithSubpass(uint32_t subpass);
 	GraphicsPipelineCreator* WithBasePipeline(VkPipeline pipelineHandle, uint32_t pipelineIndex);
@@ -41,27 +91,71 @@ public:
 	VkRenderPass GetRenderPass();
 
 	VkPipelineLayout GetPipelineLayout();
+	/// <summary>
+	/// Current handle for a pipeline id, which changes when hot reload rebuilds the pipeline.
+	/// </summary>
+	VkPipeline GetPipeline(const std::string & id) const;
 
 	void SetRenderpass(VkRenderPass renderPass);
 
-private:
-	void DestoryPipelineLayout();
+	/// <summary>
+	/// Rebuilds every pipeline created with one of the replaced modules. The old pipelines are returned rather than
+	/// destroyed, they may still be referenced by command buffers in flight.
+	/// </summary>
+	std::vector<PipelineSwap> RebuildWithShaderModules(const std::map<VkShaderModule, VkShaderModule> & replacements);
+
+	/// <summary>
+	/// True for pipelines this creator built and will destroy.
+	/// </summary>
+	bool Owns(VkPipeline pipeline) const;
+
+	/// <summary>
+	/// Records which SPIR-V a module was created from, so pipelines built from equal code hash equally whatever module
+	/// handle they were given.
+	/// </summary>
+	void RegisterShaderModule(VkShaderModule module, uint64_t codeHash);
+	void ForgetShaderModule(VkShaderModule module);
+
+	/// <summary>
+	/// Rebuilds every pipeline from its recipe for a new render pass and swap chain size, keeping the ids. The device
+	/// must be idle, the old pipelines are destroyed. Returns the old handles mapped to the new ones.
+	/// </summary>
+	std::map<VkPipeline, VkPipeline> RecreatePipelines(VkRenderPass renderPass, const VkExtent2D & swapChainExtent, const glm::vec2 & dimensions);
 
+	/// <summary>
+	/// True while a recipe still builds from the module, so a rebuild could need it again.
+	/// </summary>
+	bool UsesShaderModule(VkShaderModule module) const;
+
+	/// <summary>
+	/// Destroys every pipeline created so far. The device must be idle, nothing may still reference them.
+	/// </summary>
+	void ClearPipelines();
+
+private:
 	std::unique_ptr<VkViewport> currentViewPort = std::unique_ptr<VkViewport>(new VkViewport);
 	std::unique_ptr<VkRect2D> currentScissors = std::unique_ptr<VkRect2D>(new VkRect2D);
 
 
 	VRelease<VkDevice> device;
+	// Layouts come from the cache and are shared between pipelines, the creator never destroys them.
+	DescriptorLayoutCache * layoutCache = nullptr;
 	VkPipelineLayout pipelineLayout = {};
 
 	VkRenderPass currentRenderPass;
 	VkPipelineColorBlendStateCreateInfo colorBlending = ColorBlendStateBuilder().Build();
 	std::map<std::string, VkPipeline> pipelines;
+	std::map<std::string, PipelineRecipe> recipes;
+	std::map<uint64_t, std::string> pipelineIds;
+	std::map<VkShaderModule, uint64_t> moduleHashes;
 	std::string currentPipelineId;
 	std::unique_ptr<GraphicsPipelineBuilder> currentPipelineBuilder;
 	glm::vec2 dimensions;
 	VkExtent2D swapChainExtent;
 
+	void identifyModules(PipelineRecipe & recipe) const;
+	void rehash();
+
 	static char genRandom();
 	static std::string generateId(unsigned int length = 10);
 };
\ No newline at end of file
@@ -4,12 +4,30 @@
 #include<functional>
 #include <glm\glm.hpp>
 #include <memory>
+#include <set>
 
 #include "VkDeleter.h"
 #include "VkRelease.h"
 #include "VulkanDebug.h"
+#include "VulkanValidation.h"
 #include "Builders\BufferInfoBuilder.h"
+#include "Builders\InstanceBuilder.h"
+#include "Builders\FrameBufferInfoBuilder.h"
+#include "Builders\RenderpassBuilder.h"
+#include "Builders\SwapchainInfoBuilder.h"
 #include <Systems\Graphics\IGraphicsPipeline.h>
+#include <Systems\Graphics\PushConstants.h>
+#include <Systems\Graphics\DeviceImage.h>
+#include <Systems\Threading\WorkerPool.h>
+#include <Systems\Shaders\ShaderCompiler.h>
+#include <Systems\Shaders\ShaderWatcher.h>
+#include <Systems\Shaders\ShaderReflection.h>
+#include <Systems\Descriptors\DescriptorLayoutCache.h>
+#include <Systems\Descriptors\DescriptorAllocator.h>
+#include <Systems\Descriptors\BindlessTable.h>
+#include <Systems\Descriptors\DescriptorWriter.h>
+#include <Systems\Descriptors\DescriptorBinder.h>
+#include <Systems\Rendering\IndirectDrawList.h>
 
 struct Buffer
 {
@@ -30,8 +48,39 @@ struct ShaderStage
 
 	}
 
+	ShaderStage(VkShaderStageFlagBits flag, const char * name, std::vector<std::string> defines) : shaderFlag(flag), filename(name), defines(std::move(defines)) {
+
+	}
+
+	ShaderStage(VkShaderStageFlagBits flag, const char * name, SpecializationConstants specialization) : shaderFlag(flag), filename(name), specialization(std::move(specialization)) {
+
+	}
+
+	ShaderStage(VkShaderStageFlagBits flag, const char * name, std::vector<std::string> defines, SpecializationConstants specialization)
+		: shaderFlag(flag), filename(name), defines(std::move(defines)), specialization(std::move(specialization)) {
+
+	}
+
 	VkShaderStageFlagBits shaderFlag = VK_SHADER_STAGE_VERTEX_BIT;
+	/// <summary>
+	/// GLSL source compiled through the shader cache, or an already compiled .spv file.
+	/// </summary>
 	const char * filename;
+	std::vector<std::string> defines;
+	/// <summary>
+	/// Applied when the pipeline is created, one SPIR-V module serves every variant.
+	/// </summary>
+	SpecializationConstants specialization;
+};
+
+/// <summary>
+/// A compute pipeline and the layouts reflected from its shader. Owned by the graphics system.
+/// </summary>
+struct ComputePipeline
+{
+	VkPipeline pipeline;
+	VkPipelineLayout layout;
+	std::vector<VkDescriptorSetLayout> setLayouts;
 };
 
 class IVulkanGraphicsSystem
@@ -53,10 +102,48 @@ public:
 	virtual void RecreateSwapChain(glm::vec2 dimensions) = 0;
 	virtual void SetValidationLayers(std::vector<const char *> layers) = 0;
 	virtual void SetDeviceExtensions(std::vector<const char *> extensions) = 0;
+	/// <summary>
+	/// Commands recorded into every frame's command buffer before its render pass begins, where compute work that
+	/// feeds the pass is dispatched. Must be set before Initialize.
+	/// </summary>
+	virtual void SetPrePassCommands(std::function<void(VkCommandBuffer)> createPrePassCommands) = 0;
+	/// <summary>
+	/// Commands recorded after the render pass ends, where work that reads its attachments goes. Must be set before Initialize.
+	/// </summary>
+	virtual void SetPostPassCommands(std::function<void(VkCommandBuffer)> createPostPassCommands) = 0;
+	/// <summary>
+	/// Called from Draw with the frame about to be submitted, once that frame's previous submission has finished and
+	/// before its command buffer is recorded again. Data the GPU reads per frame is written to the frame's own slice here.
+	/// </summary>
+	virtual void SetFrameUpdate(std::function<void(uint32_t)> updateFrame) = 0;
+	/// <summary>
+	/// How many frames can be in flight at once, one per swap chain image. Fixed at Initialize, per frame data is sized by it.
+	/// </summary>
+	virtual uint32_t GetFrameCount() const = 0;
+	/// <summary>
+	/// The frame whose command buffer is being recorded, only callable from the recording callbacks.
+	/// </summary>
+	virtual uint32_t GetRecordingFrame() const = 0;
+	/// <summary>
+	/// Has every frame's command buffer recorded again before its next submission, for recordings built from data that
+	/// changes, such as a sorted draw list. Called from the frame update, the frame about to be submitted is recorded
+	/// again straight away.
+	/// </summary>
+	virtual void InvalidateCommandBuffers() = 0;
+	/// <summary>
+	/// Asks for a bindless table of the given size, must be called before Initialize. Devices without descriptor indexing
+	/// still initialize, GetBindlessTable then returns nullptr and descriptor sets have to be bound per draw.
+	/// </summary>
+	virtual void EnableBindless(uint32_t maxStorageBuffers, uint32_t maxImages) = 0;
+	virtual BindlessTable * GetBindlessTable() = 0;
 	virtual VkShaderModule CreateShaderModule(const char * filename) = 0;
 	virtual VkPhysicalDevice GetPhysicalDevice() const = 0;
 	virtual void WaitUntilDeviceIdle() const = 0;
 	virtual void WaitUntilGraphicsQueueIdle() const = 0;
+	/// <summary>
+	/// Records commands into a one time command buffer, submits it and waits for the graphics queue to finish it.
+	/// </summary>
+	virtual void ExecuteImmediately(const std::function<void(VkCommandBuffer)> & recordCommands) = 0;
 	virtual Buffer CreateBuffer(VkBufferCreateInfo bufferInfo, VkMemoryPropertyFlagBits properties = (VkMemoryPropertyFlagBits)(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) = 0;
 
 	virtual VkRenderPass CreateRenderPass() = 0;
@@ -64,10 +151,65 @@ public:
 	virtual VkRenderPass CreateRenderPass(VkRenderPassCreateInfo renderPassInfo) = 0;
 	virtual void SetRenderpass(VkRenderPass renderPass) = 0;
 	virtual VkRenderPass GetRenderPass() const = 0;
+	/// <summary>
+	/// The render pass's depth attachment. It is recreated with the swap chain and left in
+	/// DEPTH_STENCIL_READ_ONLY_OPTIMAL at the end of the pass, so post pass commands can sample it.
+	/// </summary>
+	virtual const DeviceImage & GetDepthImage() const = 0;
+	/// <summary>
+	/// Bumped every time the swap chain and everything sized to it is recreated, with the device idle.
+	/// </summary>
+	virtual uint64_t GetSwapChainGeneration() const = 0;
 	virtual std::vector<VkPipelineShaderStageCreateInfo> CreateShaderStages(const std::vector<ShaderStage> & shaderStages) = 0;
+	/// <summary>
+	/// Same as CreateShaderStages, and adds what each module declares to reflection while its SPIR-V is mapped.
+	/// </summary>
+	virtual std::vector<VkPipelineShaderStageCreateInfo> CreateShaderStages(const std::vector<ShaderStage> & shaderStages, PipelineReflection * reflection) = 0;
+	/// <summary>
+	/// Set layouts for the reflected stages, shared with every other pipeline declaring identical sets. Owned by the graphics system.
+	/// </summary>
+	virtual std::vector<VkDescriptorSetLayout> GetDescriptorSetLayouts(const PipelineReflection & reflection) = 0;
+	/// <summary>
+	/// Set that lives as long as the graphics system.
+	/// </summary>
+	virtual VkDescriptorSet AllocateDescriptorSet(VkDescriptorSetLayout layout) = 0;
+	/// <summary>
+	/// Set for the command buffer being recorded, only callable from the draw commands callback. It is recycled in bulk
+	/// the next time that command buffer is recorded, so it never has to be freed.
+	/// </summary>
+	virtual VkDescriptorSet AllocateFrameDescriptorSet(VkDescriptorSetLayout layout) = 0;
+	/// <summary>
+	/// Layout for sets written with PushDescriptorSet. It carries the push descriptor flag only when the device supports it.
+	/// </summary>
+	virtual VkDescriptorSetLayout GetPushDescriptorSetLayout(const std::vector<VkDescriptorSetLayoutBinding> & bindings) = 0;
+	/// <summary>
+	/// Records the set an update template made with InitializeForPush describes, from data, in one call: pushed where
+	/// supported. Otherwise a frame descriptor set of setLayout is allocated, written in a single batch and bound, so
+	/// this is only callable from the recording callbacks.
+	/// </summary>
+	virtual void PushDescriptorSet(VkCommandBuffer commandBuffer, VkDescriptorSetLayout setLayout, DescriptorUpdateTemplate & updateTemplate,
+		const void * data) = 0;
+	virtual const DescriptorFunctions & GetDescriptorFunctions() const = 0;
+	/// <summary>
+	/// Binder for the command buffer being recorded, starting from the layout of the bound pipeline.
+	/// </summary>
+	virtual DescriptorBinder CreateDescriptorBinder(VkCommandBuffer commandBuffer) const = 0;
+	/// <summary>
+	/// Indirect draw features enabled on the device, Supported() is false when IndirectDrawList can't be used.
+	/// </summary>
+	virtual const IndirectDrawSupport & GetIndirectDrawSupport() const = 0;
 	virtual VkPipeline CreateGraphicsPipeline(VkPipelineVertexInputStateCreateInfo vertexInput, const std::vector<VkPipelineShaderStageCreateInfo> & shaderStages) = 0;
 	virtual VkPipeline CreateGraphicsPipeline(VkPipelineVertexInputStateCreateInfo vertexInput, const std::vector<VkPipelineShaderStageCreateInfo> & shaderStages, VkPipelineLayoutCreateInfo pipelineInfo) = 0;
 	virtual void SetGraphicsPipeline(VkPipeline pipeline) = 0;
+	/// <summary>
+	/// Builds a compute pipeline from one shader, with its layout reflected and shared through the layout cache.
+	/// Compute shaders are not hot reloaded.
+	/// </summary>
+	virtual ComputePipeline CreateComputePipeline(const ShaderStage & shaderStage) = 0;
+	/// <summary>
+	/// Pipelines can be rebuilt by hot reload, look them up by id when recording instead of keeping the handle.
+	/// </summary>
+	virtual VkPipeline GetGraphicsPipeline(const std::string & id) const = 0;
 
 	virtual const VRelease<VkDevice> & GetDevice() const = 0;
 	virtual VkCommandPool GetCommandPool() const = 0;
@@ -76,13 +218,21 @@ public:
 	virtual TransferBuffer MapToLocalMemory(uint32_t bufferSize, void * data, VkBufferUsageFlagBits usage = (VkBufferUsageFlagBits)(VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT)) = 0;
 	virtual void MapToLocalMemory(TransferBuffer buffer, void * data) = 0;
 	virtual GraphicsPipelineCreator * StartGraphicsPipeline(VkPipelineVertexInputStateCreateInfo vertexInput, const std::vector<VkPipelineShaderStageCreateInfo> & shaderStages) = 0;
+	/// <summary>
+	/// Watches the shader sources under directory and swaps rebuilt pipelines in between frames when they change.
+	/// </summary>
+	virtual void EnableShaderHotReload(const std::string & directory) = 0;
+	/// <summary>
+	/// The system's worker threads, shared with CPU side work such as culling.
+	/// </summary>
+	virtual WorkerPool & GetWorkerPool() = 0;
 };
 
 
 class VulkanGraphicsSystem : public IVulkanGraphicsSystem
 {
 public:
-	VulkanGraphicsSystem() : graphicsPipelineCreator(new GraphicsPipelineCreator())
+	VulkanGraphicsSystem() : graphicsPipelineCreator(new GraphicsPipelineCreator()), shaderCompiler(workers)
 	{
 	}
 
@@ -105,13 +255,22 @@ public:
 			renderpass.Release();
 		}
 
-		vkDestroyPipeline(device, graphicsPipeline, nullptr);
+		if (!graphicsPipelineCreator->Owns(graphicsPipeline)) {
+			vkDestroyPipeline(device, graphicsPipeline, nullptr);
+		}
+		graphicsPipelineCreator->ClearPipelines();
+		destroyRetiredPipelines(std::numeric_limits<uint64_t>::max());
+		for (auto computePipeline : computePipelines) {
+			vkDestroyPipeline(device, computePipeline, nullptr);
+		}
 
 		swapChain.Release();
-		pipelineLayout.Release();
 		commandPool.Release();
 		imageAvailableSemaphore.Release();
 		renderFinishedSemaphore.Release();
+		for (auto fence : inFlightFences) {
+			fence.Release();
+		}
 
 		for (auto swapChainFrameBuffer : swapChainFramebuffers) {
 			swapChainFrameBuffer.Release();
@@ -119,8 +278,15 @@ public:
 		for (auto swapChainImageView : swapChainImageViews) {
 			swapChainImageView.Release();
 		}
+		depthImage.Destroy(device);
 
 		graphicsPipelineCreator->Cleanup();
+		descriptorAllocator.Cleanup();
+		for (auto & frameDescriptorAllocator : frameDescriptorAllocators) {
+			frameDescriptorAllocator.Cleanup();
+		}
+		descriptorLayoutCache.Cleanup();
+		bindlessTable.Cleanup();
 
 		device.Release();
 		callback.Release();
@@ -145,17 +311,26 @@ public:
 		createSurface(instance, &surface);
 		pickPhysicalDevice();
 		createLogicalDevice();
+		descriptorFunctions = DescriptorFunctions::Load(device, descriptorTemplatesSupported, pushDescriptorsSupported);
+		descriptorLayoutCache.Initialize(device);
+		descriptorAllocator.Initialize(device);
+		if (bindlessSupported) {
+			bindlessTable.Initialize(device, bindlessLimits, bindlessStorageBuffers, bindlessImages);
+		}
 		createSwapChain();
+		frameCount = static_cast<uint32_t>(swapChainImages.size());
 		createImageViews();
+		createDepthResources();
 		//currentRenderPass = CreateRenderPass();
 		graphicsPipelineCreator->SetRenderpass(CreateRenderPass());
-		graphicsPipelineCreator->Initialize(device,swapChainExtent,glm::vec2(width,height));
+		graphicsPipelineCreator->Initialize(device,swapChainExtent,glm::vec2(width,height), &descriptorLayoutCache);
 		createGraphicsPipeline(device);
 		createFramebuffers();
 		createCommandPool();
 		createVertexBuffers();
 		createCommandBuffers();
 		createSemaphores();
+		createFences();
 	}
 
 	virtual GraphicsPipelineCreator * StartGraphicsPipeline(VkPipelineVertexInputStateCreateInfo vertexInput, const std::vector<VkPipelineShaderStageCreateInfo> & shaderStages) override {
@@ -193,6 +368,17 @@ public:
 		memcpy(newData, data, (size_t)buffer.size);
 		vkUnmapMemory(device, buffer.stagingBuffer.bufferMemory);
 		
+		ExecuteImmediately([&buffer](VkCommandBuffer commandBuffer) {
+			VkBufferCopy copyRegion = {};
+			copyRegion.srcOffset = 0;
+			copyRegion.dstOffset = 0;
+			copyRegion.size = buffer.size;
+
+			vkCmdCopyBuffer(commandBuffer, buffer.stagingBuffer.buffer, buffer.mainBuffer.buffer, 1, &copyRegion);
+		});
+	}
+
+	virtual void ExecuteImmediately(const std::function<void(VkCommandBuffer)> & recordCommands) override {
 		VkCommandBufferAllocateInfo allocInfo = {};
 		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
 		allocInfo.commandPool = commandPool;
@@ -207,13 +393,7 @@ public:
 		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
 		vkBeginCommandBuffer(commandBuffer, &beginInfo);
-
-		VkBufferCopy copyRegion = {};
-		copyRegion.srcOffset = 0;
-		copyRegion.dstOffset = 0;
-		copyRegion.size = buffer.size;
-
-		vkCmdCopyBuffer(commandBuffer, buffer.stagingBuffer.buffer, buffer.mainBuffer.buffer, 1, &copyRegion);
+		recordCommands(commandBuffer);
 		vkEndCommandBuffer(commandBuffer);
 
 		VkSubmitInfo submitInfo = {};
@@ -225,8 +405,8 @@ public:
 		WaitUntilGraphicsQueueIdle();
 
 		vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
-
 	}
+
 	virtual VkPipelineLayout GetPipelineLayout() const override{
 		return graphicsPipelineCreator->GetPipelineLayout();
 	}
@@ -255,10 +435,12 @@ public:
 		return transferBuffer;
 	}
 
+	virtual void EnableShaderHotReload(const std::string & directory) override {
+		shaderWatcher = std::unique_ptr<ShaderWatcher>(new ShaderWatcher(directory));
+	}
+
 	virtual VkShaderModule CreateShaderModule(const char * filename) override {
-		shaderModules.push_back({ device,vkDestroyShaderModule });
-		vkOk(vkCreateShaderModule(device, &ShaderModuleInfoBuilder(readFile(filename)).Build(), nullptr, &shaderModules[shaderModules.size() - 1]));
-		return shaderModules[shaderModules.size() - 1];
+		return createShaderModule(openSpirv(filename));
 	}
 
 	virtual VkCommandPool GetCommandPool() const override{
@@ -270,9 +452,24 @@ public:
 	}
 
 	void Draw() {
+		applyShaderReloads();
+
 		uint32_t imageIndex;
 		vkAcquireNextImageKHR(device, swapChain, std::numeric_limits<uint64_t>::max(), imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
 
+		// The image's last submission has to finish before its command buffer is submitted again or re-recorded.
+		VkFence frameFence = inFlightFences[imageIndex];
+		vkWaitForFences(device, 1, &frameFence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+		if (updateFrame) {
+			updateFrame(imageIndex);
+		}
+		vkResetFences(device, 1, &frameFence);
+
+		if (recordedGenerations[imageIndex] != pipelineGeneration) {
+			recordCommandBuffer(imageIndex);
+			destroyRetiredPipelines(*std::min_element(recordedGenerations.begin(), recordedGenerations.end()));
+		}
+
 		VkSubmitInfo submitInfo = {};
 		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
@@ -289,7 +486,7 @@ public:
 		submitInfo.signalSemaphoreCount = 1;
 		submitInfo.pSignalSemaphores = signalSemaphores;
 
-		vkOk(vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE), "Failed to submit draw command buffer!");
+		vkOk(vkQueueSubmit(graphicsQueue, 1, &submitInfo, frameFence), "Failed to submit draw command buffer!");
 
 		VkPresentInfoKHR presentInfo = {};
 		presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -327,18 +524,99 @@ public:
 		deviceExtensions = std::move(extensions);
 	}
 
+	WorkerPool & GetWorkerPool() override {
+		return workers;
+	}
+
+	void SetPrePassCommands(std::function<void(VkCommandBuffer)> createPrePassCommands) override {
+		this->createPrePassCommands = createPrePassCommands;
+	}
+
+	void SetPostPassCommands(std::function<void(VkCommandBuffer)> createPostPassCommands) override {
+		this->createPostPassCommands = createPostPassCommands;
+	}
+
+	void SetFrameUpdate(std::function<void(uint32_t)> updateFrame) override {
+		this->updateFrame = updateFrame;
+	}
+
+	uint32_t GetFrameCount() const override {
+		return frameCount;
+	}
+
+	uint32_t GetRecordingFrame() const override {
+		if (recordingFrame < 0) {
+			throw std::runtime_error("The recording frame is only known while a command buffer is recorded");
+		}
+		return static_cast<uint32_t>(recordingFrame);
+	}
+
+	void InvalidateCommandBuffers() override {
+		pipelineGeneration++;
+	}
+
+	void EnableBindless(uint32_t maxStorageBuffers, uint32_t maxImages) override {
+		bindlessRequested = true;
+		bindlessStorageBuffers = maxStorageBuffers;
+		bindlessImages = maxImages;
+	}
+
+	BindlessTable * GetBindlessTable() override {
+		return bindlessSupported ? &bindlessTable : nullptr;
+	}
+
+	VkDescriptorSetLayout GetPushDescriptorSetLayout(const std::vector<VkDescriptorSetLayoutBinding> & bindings) override {
+		VkDescriptorSetLayoutCreateFlags flags = descriptorFunctions.PushDescriptors() ? VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR : 0;
+		return descriptorLayoutCache.GetSetLayout(bindings, flags);
+	}
+
+	void PushDescriptorSet(VkCommandBuffer commandBuffer, VkDescriptorSetLayout setLayout, DescriptorUpdateTemplate & updateTemplate,
+		const void * data) override {
+		if (descriptorFunctions.PushDescriptors()) {
+			updateTemplate.Push(commandBuffer, data);
+			return;
+		}
+
+		auto descriptorSet = AllocateFrameDescriptorSet(setLayout);
+		updateTemplate.Update(descriptorSet, data);
+		updateTemplate.Bind(commandBuffer, descriptorSet);
+	}
+
+	const DescriptorFunctions & GetDescriptorFunctions() const override {
+		return descriptorFunctions;
+	}
+
+	DescriptorBinder CreateDescriptorBinder(VkCommandBuffer commandBuffer) const override {
+		return DescriptorBinder(commandBuffer, GetPipelineLayout(), &descriptorLayoutCache);
+	}
+
+	const IndirectDrawSupport & GetIndirectDrawSupport() const override {
+		return indirectDrawSupport;
+	}
+
 	void RecreateSwapChain(glm::vec2 dimensions) override{
 		width = static_cast<uint32_t>(dimensions.x);
 		height = static_cast<uint32_t>(dimensions.y);
-		vkDestroyPipeline(device, graphicsPipeline, nullptr);
 		vkDeviceWaitIdle(device);
+		destroyRetiredPipelines(std::numeric_limits<uint64_t>::max());
 
 		createSwapChain();
+		if (swapChainImages.size() != frameCount) {
+			throw std::runtime_error("The recreated swap chain has a different image count, per frame data was sized for the first one");
+		}
 		createImageViews();
-		CreateRenderPass();
-		createGraphicsPipeline(device);
+		createDepthResources();
+		swapChainGeneration++;
+
+		// Pipelines are rebuilt from their recipes under the same ids, the application doesn't describe them again.
+		auto recreated = graphicsPipelineCreator->RecreatePipelines(CreateRenderPass(), swapChainExtent, glm::vec2(width, height));
+		auto boundPipeline = recreated.find(graphicsPipeline);
+		if (boundPipeline != recreated.end()) {
+			graphicsPipeline = boundPipeline->second;
+		}
 		createFramebuffers();
 		createCommandBuffers();
+		createFences();
 	}
 
 	void AddGraphicsPipeline()
@@ -356,6 +634,14 @@ public:
 
 	virtual VkRenderPass GetRenderPass() const { return graphicsPipelineCreator->GetRenderPass(); }
 
+	const DeviceImage & GetDepthImage() const override {
+		return depthImage;
+	}
+
+	uint64_t GetSwapChainGeneration() const override {
+		return swapChainGeneration;
+	}
+
 	virtual VkRenderPass CreateRenderPass(const VkAttachmentDescription & colorAttachment,const  VkSubpassDescription & subpassDescription, VkSubpassDependency const & subpassDepdency) override {
 		auto renderPassInfo = RenderpassInfoBuilder(&colorAttachment, &subpassDescription, &subpassDepdency).Build();
 		return CreateRenderPass(renderPassInfo);
@@ -368,12 +654,42 @@ public:
 	}
 
 	virtual VkRenderPass CreateRenderPass() override {
-		auto colorAttachment = AttachmentDescriptionBuilder(swapChainImageFormat).Build();
+		// Depth is stored and left readable for passes that build on it, such as the occlusion culling pyramid.
+		VkAttachmentDescription attachments[] = {
+			AttachmentDescriptionBuilder(swapChainImageFormat).Build(),
+			AttachmentDescriptionBuilder(depthImage.format)
+				.WithFinalImageLayout(VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL)
+				->Build()
+		};
 		auto colorAttachmentRef = AttachmentReferenceBuilder().Build();
-		auto subPass = SubpassDescriptionBuilder(&colorAttachmentRef).Build();
-		auto subpassDependancy = SubpassDependencyBuilder().Build();
-
-		return CreateRenderPass(colorAttachment, subPass, subpassDependancy);
+		auto depthAttachmentRef = AttachmentReferenceBuilder()
+			.WithAttachmentIndex(1)
+			->WithImageLayout(VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
+			->Build();
+		auto subPass = SubpassDescriptionBuilder(&colorAttachmentRef)
+			.WithDepthStencilAttachment(&depthAttachmentRef)
+			->Build();
+		VkSubpassDependency subpassDependencies[] = {
+			SubpassDependencyBuilder()
+				.WithDstStageMask(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT)
+				->WithDstAccessMask(VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT)
+				->Build(),
+			// Post pass compute work reads the depth written here.
+			SubpassDependencyBuilder()
+				.WithSrcSubpass(0)
+				->WithDstSubpass(VK_SUBPASS_EXTERNAL)
+				->WithSrcStageMask(VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT)
+				->WithSrcAccessMask(VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT)
+				->WithDstStageMask(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+				->WithDstAccessMask(VK_ACCESS_SHADER_READ_BIT)
+				->Build()
+		};
+
+		auto renderPassInfo = RenderpassInfoBuilder(attachments, &subPass, subpassDependencies)
+			.WithAttachmentCount(2)
+			->WithSubpassDepdencyCount(2)
+			->Build();
+		return CreateRenderPass(renderPassInfo);
 	}
 
 	virtual VkPipeline CreateGraphicsPipeline(VkPipelineVertexInputStateCreateInfo vertexInput, const std::vector<VkPipelineShaderStageCreateInfo> & shaderStages) override{
@@ -406,21 +722,109 @@ public:
 		graphicsPipeline = pipeline;
 	}
 
+	VkPipeline GetGraphicsPipeline(const std::string & id) const override {
+		return graphicsPipelineCreator->GetPipeline(id);
+	}
+
+	ComputePipeline CreateComputePipeline(const ShaderStage & shaderStage) override {
+		if (shaderStage.shaderFlag != VK_SHADER_STAGE_COMPUTE_BIT) {
+			throw std::runtime_error("Compute pipelines take a compute shader stage");
+		}
+
+		auto spirvFile = compileShaderStages({ shaderStage })[0];
+		auto spirv = openSpirv(spirvFile);
+		PipelineReflection reflection;
+		reflection.Add(ShaderReflection(spirv.Words(), spirv.WordCount(), shaderStage.shaderFlag));
+		auto module = createShaderModule(spirv);
+
+		ComputePipeline computePipeline = {};
+		computePipeline.setLayouts = descriptorLayoutCache.GetSetLayouts(reflection);
+		computePipeline.layout = descriptorLayoutCache.GetPipelineLayout(computePipeline.setLayouts, reflection.PushConstantRanges());
+
+		VkComputePipelineCreateInfo pipelineInfo = {};
+		pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipelineInfo.stage = ShaderStageBuilder()
+			.AddStage(VK_SHADER_STAGE_COMPUTE_BIT, module, internSpecialization(shaderStage.specialization))
+			->BuildStages()[0];
+		pipelineInfo.layout = computePipeline.layout;
+
+		vkOk(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &computePipeline.pipeline), "Failed to create compute pipeline");
+		computePipelines.push_back(computePipeline.pipeline);
+
+		// Nothing rebuilds compute pipelines, the module isn't needed once this one exists.
+		destroyShaderModule(module);
+		return computePipeline;
+	}
+
 	std::vector<VkPipelineShaderStageCreateInfo> CreateShaderStages(const std::vector<ShaderStage> & shaderStages) override {
+		return CreateShaderStages(shaderStages, nullptr);
+	}
+
+	std::vector<VkPipelineShaderStageCreateInfo> CreateShaderStages(const std::vector<ShaderStage> & shaderStages, PipelineReflection * reflection) override {
+		auto spirvFiles = compileShaderStages(shaderStages);
+
 		ShaderStageBuilder shaderStageBuilder;
-		for (auto shaderStage : shaderStages) {
-			auto module = this->CreateShaderModule(shaderStage.filename);
-			shaderStageBuilder.AddStage(shaderStage.shaderFlag, module);
+		for (size_t i = 0; i < shaderStages.size(); i++) {
+			auto spirvFile = openSpirv(spirvFiles[i]);
+			auto module = createShaderModule(spirvFile);
+			shaderStageBuilder.AddStage(shaderStages[i].shaderFlag, module, internSpecialization(shaderStages[i].specialization));
+
+			if (reflection) {
+				reflection->Add(ShaderReflection(spirvFile.Words(), spirvFile.WordCount(), shaderStages[i].shaderFlag));
+			}
+
+			if (!ShaderCompiler::IsSpirv(shaderStages[i].filename)) {
+				moduleSources.insert({ module, ShaderSource(shaderStages[i].filename, shaderStages[i].defines) });
+			}
 		}
 
 		return shaderStageBuilder.BuildStages();
 	}
 
+	std::vector<VkDescriptorSetLayout> GetDescriptorSetLayouts(const PipelineReflection & reflection) override {
+		return descriptorLayoutCache.GetSetLayouts(reflection);
+	}
+
+	VkDescriptorSet AllocateDescriptorSet(VkDescriptorSetLayout layout) override {
+		return descriptorAllocator.Allocate(layout);
+	}
+
+	VkDescriptorSet AllocateFrameDescriptorSet(VkDescriptorSetLayout layout) override {
+		if (recordingFrame < 0) {
+			throw std::runtime_error("Frame descriptor sets can only be allocated while recording draw commands");
+		}
+		return frameDescriptorAllocators[recordingFrame].Allocate(layout);
+	}
+
 	void SetRenderpass(VkRenderPass renderPass) override {
 		graphicsPipelineCreator->SetRenderpass(renderPass);
 	}
 
 private:
+	// Rejects files that can't be SPIR-V before anything reads their words.
+	static MappedFile openSpirv(const std::string & filename) {
+		MappedFile spirvFile(filename);
+		ShaderModuleInfoBuilder::Validate(spirvFile.Size(), filename);
+		return spirvFile;
+	}
+
+	// Equal SPIR-V shares one module, so describing a pipeline again doesn't leave a module per call behind.
+	VkShaderModule createShaderModule(const MappedFile & spirvFile) {
+		auto moduleInfo = ShaderModuleInfoBuilder(spirvFile).Build();
+		auto codeHash = hashBytes(spirvFile.Data(), spirvFile.Size(), hashValue(static_cast<uint64_t>(spirvFile.Size())));
+		auto existing = modulesByCode.find(codeHash);
+		if (existing != modulesByCode.end()) {
+			return existing->second;
+		}
+
+		shaderModules.push_back({ device,vkDestroyShaderModule });
+		vkOk(vkCreateShaderModule(device, &moduleInfo, nullptr, &shaderModules[shaderModules.size() - 1]), "Failed to create shader module!");
+		VkShaderModule module = shaderModules[shaderModules.size() - 1];
+		modulesByCode[codeHash] = module;
+		graphicsPipelineCreator->RegisterShaderModule(module, codeHash);
+		return module;
+	}
+
 
 	VkPipeline CreateGraphicsPipeline(
 		VkPipelineVertexInputStateCreateInfo vertexInput,
@@ -430,7 +834,7 @@ private:
 		VkPipelineColorBlendStateCreateInfo colorBlending) {
 
 		
-		vkOk(vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout), "Failed to create the pipeline layout!");
+		auto pipelineLayout = descriptorLayoutCache.GetPipelineLayout(pipelineLayoutInfo);
 		graphicsPipelineCreator->SetPipelineLayout(pipelineLayout);
 		auto rasterizerState = RasterizationStateBuilder()
 			.WithCounterClockwiseFace()
@@ -440,6 +844,7 @@ private:
 			colorBlending, pipelineLayout, this->GetRenderPass())
 			.WithVertexInputState(vertexInput)
 			->WithRasterizationState(rasterizerState)
+			->WithDepthStencilState(DepthStencilStateBuilder().Build())
 			->Build();
 
 		auto pipeline = CreateGraphicsPipeline(pipelineInfo);
@@ -447,6 +852,136 @@ private:
 		return pipeline;
 	}
 
+	/// <summary>
+	/// Keeps one copy of each distinct set of constants alive for as long as the system, stage infos point into it.
+	/// </summary>
+	const VkSpecializationInfo * internSpecialization(const SpecializationConstants & constants) {
+		if (constants.Empty()) return nullptr;
+
+		auto hash = constants.Hash();
+		auto candidates = specializations.equal_range(hash);
+		for (auto candidate = candidates.first; candidate != candidates.second; ++candidate) {
+			if (candidate->second.Equals(constants)) return candidate->second.Info();
+		}
+		return specializations.insert({ hash, constants })->second.Info();
+	}
+
+	std::vector<std::string> compileShaderStages(const std::vector<ShaderStage> & shaderStages) {
+		// Queue every stage before waiting on any of them so the stages compile in parallel.
+		std::vector<std::shared_future<std::string>> pending;
+		for (auto & shaderStage : shaderStages) {
+			if (ShaderCompiler::IsSpirv(shaderStage.filename)) {
+				std::promise<std::string> precompiled;
+				precompiled.set_value(shaderStage.filename);
+				pending.push_back(precompiled.get_future().share());
+			}
+			else {
+				pending.push_back(shaderCompiler.CompileAsync(ShaderSource(shaderStage.filename, shaderStage.defines)));
+			}
+		}
+
+		std::vector<std::string> spirvFiles;
+		for (auto & spirvFile : pending) {
+			spirvFiles.push_back(spirvFile.get());
+		}
+		return spirvFiles;
+	}
+
+	/// <summary>
+	/// Picks up finished recompiles and swaps in the pipelines that use them. Only called between frames, the old pipelines
+	/// are retired until every command buffer that could still reference them has been re-recorded.
+	/// </summary>
+	void applyShaderReloads() {
+		if (!shaderWatcher) return;
+
+		for (auto & changedFile : shaderWatcher->PollChanges()) {
+			for (auto & moduleSource : moduleSources) {
+				auto dependencies = shaderCompiler.GetDependencies(moduleSource.second.filename);
+				bool affected = std::any_of(dependencies.begin(), dependencies.end(), [&changedFile](const std::string & dependency) {
+					return ShaderWatcher::Normalize(dependency) == changedFile;
+				});
+				if (affected) {
+					pendingReloads[moduleSource.first] = shaderCompiler.CompileAsync(moduleSource.second);
+				}
+			}
+		}
+
+		std::map<VkShaderModule, VkShaderModule> replacements;
+		for (auto reload = pendingReloads.begin(); reload != pendingReloads.end();) {
+			if (reload->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+				++reload;
+				continue;
+			}
+
+			try {
+				// A change that compiles to the same SPIR-V, such as an edited comment, comes back as the same module.
+				auto module = CreateShaderModule(reload->second.get().c_str());
+				if (module != reload->first) {
+					moduleSources.insert({ module, moduleSources.at(reload->first) });
+					replacements[reload->first] = module;
+				}
+			}
+			catch (const std::runtime_error & e) {
+				std::cerr << e.what() << std::endl;
+			}
+			reload = pendingReloads.erase(reload);
+		}
+
+		if (replacements.empty()) return;
+
+		auto swaps = graphicsPipelineCreator->RebuildWithShaderModules(replacements);
+		if (!swaps.empty()) {
+			pipelineGeneration++;
+		}
+
+		for (auto & swap : swaps) {
+			if (graphicsPipeline == swap.oldPipeline) {
+				graphicsPipeline = swap.newPipeline;
+			}
+			retiredPipelines.push_back({ swap.oldPipeline, pipelineGeneration });
+		}
+
+		// Modules are only read while a pipeline is created. A failed rebuild keeps the old module in its recipe, so
+		// whichever of the pair no recipe refers to any more can go straight away.
+		for (auto & replacement : replacements) {
+			for (auto module : { replacement.first, replacement.second }) {
+				if (!graphicsPipelineCreator->UsesShaderModule(module)) {
+					moduleSources.erase(module);
+					destroyShaderModule(module);
+				}
+			}
+		}
+	}
+
+	void destroyRetiredPipelines(uint64_t completedGeneration) {
+		auto retired = std::partition(retiredPipelines.begin(), retiredPipelines.end(), [completedGeneration](const RetiredPipeline & pipeline) {
+			return pipeline.generation > completedGeneration;
+		});
+
+		for (auto pipeline = retired; pipeline != retiredPipelines.end(); ++pipeline) {
+			vkDestroyPipeline(device, pipeline->pipeline, nullptr);
+		}
+		retiredPipelines.erase(retired, retiredPipelines.end());
+	}
+
+	void destroyShaderModule(VkShaderModule module) {
+		for (auto cached = modulesByCode.begin(); cached != modulesByCode.end(); ++cached) {
+			if (cached->second == module) {
+				modulesByCode.erase(cached);
+				break;
+			}
+		}
+		graphicsPipelineCreator->ForgetShaderModule(module);
+
+		for (auto shaderModule = shaderModules.begin(); shaderModule != shaderModules.end(); ++shaderModule) {
+			if (static_cast<VkShaderModule>(*shaderModule) == module) {
+				shaderModule->Release();
+				shaderModules.erase(shaderModule);
+				return;
+			}
+		}
+	}
+
 	VkPipeline CreateGraphicsPipeline(VkGraphicsPipelineCreateInfo graphicsCreateInfo) {
 		VkPipeline pipeline;
 		vkOk(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &graphicsCreateInfo, nullptr, &pipeline));
@@ -469,6 +1004,11 @@ private:
 		}
 
 		auto exten = VulkanValidation::getRequiredExtensions();
+		// Descriptor indexing features can only be queried through the properties2 entry points, and push descriptors require it.
+		properties2Enabled = VulkanValidation::checkInstanceExtensionSupport(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+		if (properties2Enabled) {
+			exten.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+		}
 		instanceBuilder.WithEnabledExtensions(exten.size(), exten.data());
 		auto instanceInfo = instanceBuilder.Build();
 		vkOk(vkCreateInstance(&instanceInfo, nullptr, &instance), "Failed to create instance!");
@@ -482,12 +1022,30 @@ private:
 		vkOk(vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphore), "Failed to create semaphores!");
 	}
 
+	void createFences() {
+		for (auto fence : inFlightFences) {
+			fence.Release();
+		}
+
+		VkFenceCreateInfo fenceInfo = {};
+		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+		inFlightFences.clear();
+		inFlightFences.resize(commandBuffers.size(), { device, vkDestroyFence });
+		for (auto & fence : inFlightFences) {
+			vkOk(vkCreateFence(device, &fenceInfo, nullptr, &fence), "Failed to create fences!");
+		}
+	}
+
 	void createCommandBuffers() {
 		if (commandBuffers.size() > 0) {
 			vkFreeCommandBuffers(device, commandPool, commandBuffers.size(), commandBuffers.data());
 		}
 
 		commandBuffers.resize(swapChainFramebuffers.size());
+		recordedGenerations.assign(commandBuffers.size(), pipelineGeneration);
+		createFrameDescriptorAllocators();
 		VkCommandBufferAllocateInfo allocInfo = {};
 		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
 		allocInfo.commandPool = commandPool;
@@ -497,33 +1055,66 @@ private:
 		vkOk(vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()), "Failed to allocate command buffers");
 
 		for (unsigned int i = 0; i < commandBuffers.size(); i++) {
-			VkCommandBufferBeginInfo beginInfo = {};
-			beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-			beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
-			beginInfo.pInheritanceInfo = nullptr;
+			recordCommandBuffer(i);
+		}
+
+	}
+
+	void createFrameDescriptorAllocators() {
+		// Only called while the device is idle, nothing in flight can still use the sets.
+		for (auto & frameDescriptorAllocator : frameDescriptorAllocators) {
+			frameDescriptorAllocator.Cleanup();
+		}
+
+		frameDescriptorAllocators.clear();
+		frameDescriptorAllocators.resize(commandBuffers.size());
+		for (auto & frameDescriptorAllocator : frameDescriptorAllocators) {
+			frameDescriptorAllocator.Initialize(device, 16);
+		}
+	}
+
+	void recordCommandBuffer(unsigned int i) {
+		VkCommandBufferBeginInfo beginInfo = {};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+		beginInfo.pInheritanceInfo = nullptr;
+
+		vkBeginCommandBuffer(commandBuffers[i], &beginInfo);
+
+		// The buffer's previous submission has completed, so have the frame sets it used.
+		frameDescriptorAllocators[i].Reset();
+		recordingFrame = static_cast<int>(i);
+		if (createPrePassCommands) {
+			createPrePassCommands(commandBuffers[i]);
+		}
 
-			vkBeginCommandBuffer(commandBuffers[i], &beginInfo);
+		VkRenderPassBeginInfo renderPassInfo = {};
+		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		renderPassInfo.renderPass = graphicsPipelineCreator->GetRenderPass();
+		renderPassInfo.framebuffer = swapChainFramebuffers[i];
 
-			VkRenderPassBeginInfo renderPassInfo = {};
-			renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-			renderPassInfo.renderPass = graphicsPipelineCreator->GetRenderPass();
-			renderPassInfo.framebuffer = swapChainFramebuffers[i];
+		renderPassInfo.renderArea.offset = { 0,0 };
+		renderPassInfo.renderArea.extent = swapChainExtent;
 
-			renderPassInfo.renderArea.offset = { 0,0 };
-			renderPassInfo.renderArea.extent = swapChainExtent;
+		VkClearValue clearValues[2] = {};
+		clearValues[0].color = { 0.0f,0.0f,0.0f,1.0f };
+		clearValues[1].depthStencil = { 1.0f, 0 };
+		renderPassInfo.clearValueCount = 2;
+		renderPassInfo.pClearValues = clearValues;
 
-			VkClearValue clearColor = { 0.0f,0.0f,0.0f,1.0f };
-			renderPassInfo.clearValueCount = 1;
-			renderPassInfo.pClearValues = &clearColor;
+		vkCmdBeginRenderPass(commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+		auto commandBuffer = commandBuffers[i];
 
-			vkCmdBeginRenderPass(commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-			vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
-			auto commandBuffer = commandBuffers[i];
-			createDrawCommands(commandBuffer);
-			vkCmdEndRenderPass(commandBuffers[i]);
-			vkOk(vkEndCommandBuffer(commandBuffers[i]), "Failed to record command buffer");
+		createDrawCommands(commandBuffer);
+		vkCmdEndRenderPass(commandBuffers[i]);
+		if (createPostPassCommands) {
+			createPostPassCommands(commandBuffer);
 		}
+		recordingFrame = -1;
+		vkOk(vkEndCommandBuffer(commandBuffers[i]), "Failed to record command buffer");
 
+		recordedGenerations[i] = pipelineGeneration;
 	}
 
 	void createCommandPool() {
@@ -531,7 +1122,8 @@ private:
 		VkCommandPoolCreateInfo poolInfo = {};
 		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 		poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily;
-		poolInfo.flags = 0;
+		// Command buffers are re-recorded one at a time when a pipeline is hot swapped.
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
 		vkOk(vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool));
 	}
@@ -541,8 +1133,8 @@ private:
 		swapChainFramebuffers.resize(swapChainImageViews.size(), { device, vkDestroyFramebuffer });
 
 		for (unsigned int i = 0; i < swapChainImageViews.size(); i++) {
-			VkImageView attachments[] = { swapChainImageViews[i] };
-			auto frameBufferInfoBuilder = FrameBufferInfoBuilder(graphicsPipelineCreator->GetRenderPass(), swapChainExtent, attachments, 1);
+			VkImageView attachments[] = { swapChainImageViews[i], depthImage.view };
+			auto frameBufferInfoBuilder = FrameBufferInfoBuilder(graphicsPipelineCreator->GetRenderPass(), swapChainExtent, attachments, 2);
 			vkOk(vkCreateFramebuffer(device, &frameBufferInfoBuilder.Build(), nullptr, &swapChainFramebuffers[i]), "Failed to create framebuffer");
 		}
 	}
@@ -555,6 +1147,28 @@ private:
 		}
 	}
 
+	/// <summary>
+	/// One depth buffer serves every swap chain image, submissions run in order and the pass clears it.
+	/// </summary>
+	void createDepthResources() {
+		// Only called while the device is idle.
+		depthImage.Destroy(device);
+		depthImage.Create(device, physicalDevice, findDepthFormat(), swapChainExtent, 1,
+			VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_ASPECT_DEPTH_BIT);
+	}
+
+	VkFormat findDepthFormat() const {
+		VkFormatFeatureFlags required = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+		for (auto format : { VK_FORMAT_D32_SFLOAT, VK_FORMAT_X8_D24_UNORM_PACK32, VK_FORMAT_D16_UNORM }) {
+			VkFormatProperties properties;
+			vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+			if ((properties.optimalTilingFeatures & required) == required) {
+				return format;
+			}
+		}
+		throw std::runtime_error("No sampleable depth format is supported");
+	}
+
 	void createSwapChain() {
 		auto createInfo = SwapchainInfoKHRBuilder(physicalDevice, surface, width, height)
 			.WithOldSwapchain(swapChain)
@@ -583,25 +1197,48 @@ private:
 		std::vector<VkPhysicalDevice> devices(deviceCount);
 		vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
 
+		// Any device that can present to the surface will do, a discrete GPU is preferred when there is one.
 		for (const auto & device : devices) {
-			if (isDeviceSuitable(device)) {
+			if (!isDeviceSuitable(device)) continue;
+
+			VkPhysicalDeviceProperties deviceProperties;
+			vkGetPhysicalDeviceProperties(device, &deviceProperties);
+			bool discrete = deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU;
+			if (physicalDevice == VK_NULL_HANDLE || discrete) {
 				physicalDevice = device;
-				break;
 			}
+			if (discrete) break;
 		}
 
 		if (physicalDevice == VK_NULL_HANDLE) {
 			throw std::runtime_error("Failed to find a suitable GPU!");
 		}
 
+		bindlessSupported = bindlessRequested &&
+			VulkanValidation::checkDeviceExtensionSupport(physicalDevice, BindlessTable::RequiredDeviceExtensions()) &&
+			BindlessTable::QuerySupport(instance, physicalDevice, &bindlessFeatures, &bindlessLimits);
+		if (bindlessRequested && !bindlessSupported) {
+			std::cerr << "Descriptor indexing is not supported, falling back to per draw descriptor sets" << std::endl;
+		}
+
+		descriptorTemplatesSupported = VulkanValidation::checkDeviceExtensionSupport(physicalDevice, { VK_KHR_DESCRIPTOR_UPDATE_TEMPLATE_EXTENSION_NAME });
+		pushDescriptorsSupported = properties2Enabled &&
+			VulkanValidation::checkDeviceExtensionSupport(physicalDevice, { VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME });
+
+		VkPhysicalDeviceFeatures features;
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceFeatures(physicalDevice, &features);
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+		indirectDrawSupport.multiDrawIndirect = features.multiDrawIndirect == VK_TRUE;
+		indirectDrawSupport.firstInstance = features.drawIndirectFirstInstance == VK_TRUE;
+		indirectDrawSupport.maxDrawIndirectCount = properties.limits.maxDrawIndirectCount;
+		drawIndirectCountSupported = VulkanValidation::checkDeviceExtensionSupport(physicalDevice, { VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME });
+
 	}
 
+	// Nothing here draws with geometry shaders, and integrated GPUs run every path. Optional features such as
+	// indirect draws are queried once the device is picked.
 	bool isDeviceSuitable(VkPhysicalDevice device) {
-		VkPhysicalDeviceProperties deviceProperties;
-		VkPhysicalDeviceFeatures deviceFeatures;
-		vkGetPhysicalDeviceProperties(device, &deviceProperties);
-		vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
-
 		bool extensionsSupported = VulkanValidation::checkDeviceExtensionSupport(device, deviceExtensions);
 		bool swapChainAdequate = false;
 
@@ -610,9 +1247,7 @@ private:
 			swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
 		}
 
-		return deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU &&
-			deviceFeatures.geometryShader &&
-			findQueueFamilies(device, surface).isComplete() &&
+		return findQueueFamilies(device, surface).isComplete() &&
 			extensionsSupported &&
 			swapChainAdequate;
 	}
@@ -635,14 +1270,31 @@ private:
 		}
 
 		VkPhysicalDeviceFeatures deviceFeatures = {};
+		deviceFeatures.multiDrawIndirect = indirectDrawSupport.multiDrawIndirect;
+		deviceFeatures.drawIndirectFirstInstance = indirectDrawSupport.firstInstance;
 		VkDeviceCreateInfo createInfo = {};
 		createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 		createInfo.pQueueCreateInfos = queueCreateInfos.data();
 		createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
 		createInfo.pEnabledFeatures = &deviceFeatures;
 
-		createInfo.enabledExtensionCount = deviceExtensions.size();
-		createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+		auto extensions = deviceExtensions;
+		if (bindlessSupported) {
+			auto bindlessExtensions = BindlessTable::RequiredDeviceExtensions();
+			extensions.insert(extensions.end(), bindlessExtensions.begin(), bindlessExtensions.end());
+			createInfo.pNext = &bindlessFeatures;
+		}
+		if (descriptorTemplatesSupported) {
+			extensions.push_back(VK_KHR_DESCRIPTOR_UPDATE_TEMPLATE_EXTENSION_NAME);
+		}
+		if (pushDescriptorsSupported) {
+			extensions.push_back(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+		}
+		if (drawIndirectCountSupported) {
+			extensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+		}
+		createInfo.enabledExtensionCount = extensions.size();
+		createInfo.ppEnabledExtensionNames = extensions.data();
 
 		if (enableValidationLayers) {
 			createInfo.enabledLayerCount = validationLayers.size();
@@ -655,10 +1307,18 @@ private:
 		vkOk(vkCreateDevice(physicalDevice, &createInfo, nullptr, &device), "Failed to create logical device");
 		vkGetDeviceQueue(device, indices.graphicsFamily, 0, &graphicsQueue);
 		vkGetDeviceQueue(device, indices.presentFamily, 0, &presentQueue);
+
+		if (drawIndirectCountSupported) {
+			indirectDrawSupport.drawIndexedIndirectCount =
+				(PFN_vkCmdDrawIndexedIndirectCountKHR)vkGetDeviceProcAddr(device, "vkCmdDrawIndexedIndirectCountKHR");
+		}
 	}
 
 	std::function<void(VkDevice)> createGraphicsPipeline;
 	std::function<void(VkCommandBuffer)> createDrawCommands;
+	std::function<void(VkCommandBuffer)> createPrePassCommands;
+	std::function<void(VkCommandBuffer)> createPostPassCommands;
+	std::function<void(uint32_t)> updateFrame;
 	uint32_t width;
 	uint32_t height;
 	VRelease<VkInstance> instance{ vkDestroyInstance };
@@ -671,7 +1331,6 @@ private:
 	//VkRenderPass currentRenderPass;
 	std::vector<VRelease<VkRenderPass>> renderpasses;
 
-	VRelease<VkPipelineLayout> pipelineLayout{ device, vkDestroyPipelineLayout };
 	VRelease<VkCommandPool> commandPool{ device, vkDestroyCommandPool };
 	VRelease<VkSemaphore> imageAvailableSemaphore{ device, vkDestroySemaphore };
 	VRelease<VkSemaphore> renderFinishedSemaphore{ device, vkDestroySemaphore };
@@ -682,11 +1341,33 @@ private:
 	std::vector<VRelease<VkBuffer>> vertexBuffers;
 	std::vector<VRelease<VkBuffer>> vertexMemoryBuffers;
 	std::vector<VRelease<VkShaderModule>> shaderModules;
+	std::vector<VRelease<VkFence>> inFlightFences;
+
+	struct RetiredPipeline
+	{
+		VkPipeline pipeline;
+		uint64_t generation;
+	};
+
+	// Bumped whenever pipelines are swapped or recordings invalidated, a command buffer recorded at an older generation
+	// may still use a retired pipeline.
+	uint64_t pipelineGeneration = 0;
+	uint64_t swapChainGeneration = 0;
+	std::vector<uint64_t> recordedGenerations;
+	std::vector<RetiredPipeline> retiredPipelines;
+	std::vector<VkPipeline> computePipelines;
+	std::map<VkShaderModule, ShaderSource> moduleSources;
+	// Keyed by hash, equal hashes are told apart by comparing the constants.
+	std::multimap<uint64_t, SpecializationConstants> specializations;
+	std::map<uint64_t, VkShaderModule> modulesByCode;
+	std::map<VkShaderModule, std::shared_future<std::string>> pendingReloads;
+	std::unique_ptr<ShaderWatcher> shaderWatcher;
 
 
 	std::vector<VkImage> swapChainImages;
 	VkFormat swapChainImageFormat;
 	VkExtent2D swapChainExtent;
+	DeviceImage depthImage;
 	VkQueue graphicsQueue;
 	VkQueue presentQueue;
 	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
@@ -695,4 +1376,25 @@ private:
 	std::vector<const char *> validationLayers;
 	std::vector<const char *> deviceExtensions;
 	std::unique_ptr<GraphicsPipelineCreator> graphicsPipelineCreator;
+	DescriptorLayoutCache descriptorLayoutCache;
+	DescriptorAllocator descriptorAllocator;
+	std::vector<DescriptorAllocator> frameDescriptorAllocators;
+	int recordingFrame = -1;
+	uint32_t frameCount = 0;
+	bool bindlessRequested = false;
+	bool bindlessSupported = false;
+	uint32_t bindlessStorageBuffers = 0;
+	uint32_t bindlessImages = 0;
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT bindlessFeatures = {};
+	VkPhysicalDeviceDescriptorIndexingPropertiesEXT bindlessLimits = {};
+	BindlessTable bindlessTable;
+	bool properties2Enabled = false;
+	bool descriptorTemplatesSupported = false;
+	bool pushDescriptorsSupported = false;
+	DescriptorFunctions descriptorFunctions;
+	bool drawIndirectCountSupported = false;
+	IndirectDrawSupport indirectDrawSupport;
+	// Members are destroyed bottom up: the pool drains and joins while the compiler its queued compiles use still exists.
+	ShaderCompiler shaderCompiler;
+	WorkerPool workers;
 };
\ No newline at end of file
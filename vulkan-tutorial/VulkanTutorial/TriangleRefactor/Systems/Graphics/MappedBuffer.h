@@ -0,0 +1,152 @@
+#pragma once
+#include <vulkan\vulkan.h>
+#include <algorithm>
+#include <stdexcept>
+
+#include <Exception.h>
+#include <Builders\BufferInfoBuilder.h>
+
+/// <summary>
+/// Buffer in host visible, coherent memory that stays mapped for its whole life, written by the CPU without flushes
+/// and read by shaders or indirect draws.
+///
+/// Created with more than one frame it holds a slice of size bytes per frame in flight, each aligned for use as a
+/// descriptor or dynamic offset. The CPU only writes the slice of a frame whose previous submission has finished, so
+/// frames still executing never see a half written slice.
+/// </summary>
+struct MappedBuffer
+{
+	VkBuffer buffer = VK_NULL_HANDLE;
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	void * mapped = nullptr;
+	// Bytes of one frame's slice, and the distance between the starts of two slices.
+	VkDeviceSize size = 0;
+	VkDeviceSize stride = 0;
+	uint32_t frames = 1;
+
+	void Create(VkDevice device, VkPhysicalDevice physicalDevice, VkDeviceSize size, VkBufferUsageFlags usage, uint32_t frames = 1) {
+		this->size = size;
+		this->frames = frames;
+		stride = frames > 1 ? alignTo(size, sliceAlignment(physicalDevice, usage)) : size;
+
+		auto bufferInfo = BufferInfoBuilder(static_cast<uint32_t>(stride * frames), static_cast<VkBufferUsageFlagBits>(usage)).Build();
+		vkOk(vkCreateBuffer(device, &bufferInfo, nullptr, &buffer), "Failed to create a mapped buffer");
+
+		VkMemoryRequirements memoryRequirements;
+		vkGetBufferMemoryRequirements(device, buffer, &memoryRequirements);
+
+		VkMemoryAllocateInfo allocateInfo = {};
+		allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocateInfo.allocationSize = memoryRequirements.size;
+		allocateInfo.memoryTypeIndex = findMemoryType(memoryRequirements.memoryTypeBits,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, physicalDevice);
+
+		vkOk(vkAllocateMemory(device, &allocateInfo, nullptr, &memory), "Failed to allocate mapped buffer memory");
+		vkBindBufferMemory(device, buffer, memory, 0);
+		vkOk(vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &mapped), "Failed to map a buffer");
+	}
+
+	template <typename T> T * As(uint32_t frame = 0) const {
+		return reinterpret_cast<T *>(static_cast<char *>(mapped) + Offset(frame));
+	}
+
+	/// <summary>
+	/// Where frame's slice starts in the buffer.
+	/// </summary>
+	VkDeviceSize Offset(uint32_t frame) const {
+		if (frame >= frames) {
+			throw std::runtime_error("Mapped buffer has no slice for this frame");
+		}
+		return stride * frame;
+	}
+
+	VkDescriptorBufferInfo DescriptorInfo(VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE) const {
+		VkDescriptorBufferInfo bufferInfo = {};
+		bufferInfo.buffer = buffer;
+		bufferInfo.offset = offset;
+		bufferInfo.range = range;
+		return bufferInfo;
+	}
+
+	/// <summary>
+	/// Descriptor contents for frame's slice alone.
+	/// </summary>
+	VkDescriptorBufferInfo FrameInfo(uint32_t frame) const {
+		return DescriptorInfo(Offset(frame), size);
+	}
+
+	void Destroy(VkDevice device) {
+		if (buffer == VK_NULL_HANDLE) return;
+
+		vkUnmapMemory(device, memory);
+		vkDestroyBuffer(device, buffer, nullptr);
+		vkFreeMemory(device, memory, nullptr);
+		buffer = VK_NULL_HANDLE;
+		memory = VK_NULL_HANDLE;
+		mapped = nullptr;
+	}
+
+private:
+	static VkDeviceSize alignTo(VkDeviceSize value, VkDeviceSize alignment) {
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	// Slices start where any of the buffer's uses may bind them. 16 bytes also keep indirect commands and vectors aligned.
+	static VkDeviceSize sliceAlignment(VkPhysicalDevice physicalDevice, VkBufferUsageFlags usage) {
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+		VkDeviceSize alignment = 16;
+		if (usage & VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT) {
+			alignment = std::max(alignment, properties.limits.minUniformBufferOffsetAlignment);
+		}
+		if (usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT) {
+			alignment = std::max(alignment, properties.limits.minStorageBufferOffsetAlignment);
+		}
+		return alignment;
+	}
+};
+
+/// <summary>
+/// Buffer in device local memory for data only the GPU writes and reads, such as compute output.
+/// </summary>
+struct DeviceBuffer
+{
+	VkBuffer buffer = VK_NULL_HANDLE;
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize size = 0;
+
+	void Create(VkDevice device, VkPhysicalDevice physicalDevice, VkDeviceSize size, VkBufferUsageFlags usage) {
+		this->size = size;
+		auto bufferInfo = BufferInfoBuilder(static_cast<uint32_t>(size), static_cast<VkBufferUsageFlagBits>(usage)).Build();
+		vkOk(vkCreateBuffer(device, &bufferInfo, nullptr, &buffer), "Failed to create a device buffer");
+
+		VkMemoryRequirements memoryRequirements;
+		vkGetBufferMemoryRequirements(device, buffer, &memoryRequirements);
+
+		VkMemoryAllocateInfo allocateInfo = {};
+		allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocateInfo.allocationSize = memoryRequirements.size;
+		allocateInfo.memoryTypeIndex = findMemoryType(memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, physicalDevice);
+
+		vkOk(vkAllocateMemory(device, &allocateInfo, nullptr, &memory), "Failed to allocate device buffer memory");
+		vkBindBufferMemory(device, buffer, memory, 0);
+	}
+
+	VkDescriptorBufferInfo DescriptorInfo(VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE) const {
+		VkDescriptorBufferInfo bufferInfo = {};
+		bufferInfo.buffer = buffer;
+		bufferInfo.offset = offset;
+		bufferInfo.range = range;
+		return bufferInfo;
+	}
+
+	void Destroy(VkDevice device) {
+		if (buffer == VK_NULL_HANDLE) return;
+
+		vkDestroyBuffer(device, buffer, nullptr);
+		vkFreeMemory(device, memory, nullptr);
+		buffer = VK_NULL_HANDLE;
+		memory = VK_NULL_HANDLE;
+	}
+};
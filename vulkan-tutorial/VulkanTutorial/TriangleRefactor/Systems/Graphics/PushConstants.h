@@ -0,0 +1,42 @@
+#pragma once
+#include <vulkan\vulkan.h>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+
+// The smallest maxPushConstantsSize the spec allows, a block within it works on every device.
+static const uint32_t guaranteedPushConstantsSize = 128;
+
+/// <summary>
+/// Typed push constant block for per-draw data such as model matrices or material indices. Range() goes into the
+/// pipeline layout and Push() into the command buffer, so the layout and what gets recorded can't drift apart.
+/// </summary>
+template <typename T> class PushConstants
+{
+	static_assert(std::is_trivially_copyable<T>::value, "Push constants are copied into the command buffer byte for byte");
+	static_assert(sizeof(T) % 4 == 0, "Push constant blocks must be a multiple of 4 bytes");
+	static_assert(sizeof(T) <= guaranteedPushConstantsSize, "Push constant block is larger than every device guarantees");
+
+public:
+	PushConstants(VkShaderStageFlags stages, uint32_t offset = 0) : stages(stages), offset(offset) {
+		if (offset % 4 != 0 || offset + sizeof(T) > guaranteedPushConstantsSize) {
+			throw std::runtime_error("Push constant block does not fit the guaranteed push constant range");
+		}
+	}
+
+	VkPushConstantRange Range() const {
+		VkPushConstantRange range = {};
+		range.stageFlags = stages;
+		range.offset = offset;
+		range.size = sizeof(T);
+		return range;
+	}
+
+	void Push(VkCommandBuffer commandBuffer, VkPipelineLayout layout, const T & value) const {
+		vkCmdPushConstants(commandBuffer, layout, stages, offset, sizeof(T), &value);
+	}
+
+private:
+	VkShaderStageFlags stages;
+	uint32_t offset;
+};
@@ -0,0 +1,189 @@
+#pragma once
+#include <vulkan\vulkan.h>
+#include <algorithm>
+#include <stdexcept>
+
+#include <Systems\Graphics\MappedBuffer.h>
+#include <Systems\Rendering\Mesh.h>
+
+/// <summary>
+/// What the device offers for indirect drawing. Draw IDs travel in firstInstance, so without drawIndirectFirstInstance
+/// there is no indirect path at all.
+/// </summary>
+struct IndirectDrawSupport
+{
+	bool multiDrawIndirect = false;
+	bool firstInstance = false;
+	uint32_t maxDrawIndirectCount = 1;
+	// Loaded when VK_KHR_draw_indirect_count is enabled.
+	PFN_vkCmdDrawIndexedIndirectCountKHR drawIndexedIndirectCount = nullptr;
+
+	bool Supported() const { return firstInstance; }
+	bool DrawCount() const { return drawIndexedIndirectCount != nullptr; }
+};
+
+/// <summary>
+/// Issues up to maxDraws indexed draws from commands, starting at commandsOffset. With the draw count extension the
+/// number is read from countBuffer at countOffset when the GPU gets there, otherwise recordedCount draws are baked into
+/// the command buffer.
+/// </summary>
+static void recordIndexedIndirect(VkCommandBuffer commandBuffer, const IndirectDrawSupport & support, VkBuffer commands,
+	VkDeviceSize commandsOffset, VkBuffer countBuffer, VkDeviceSize countOffset, uint32_t maxDraws, uint32_t recordedCount) {
+	const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+	if (support.DrawCount()) {
+		support.drawIndexedIndirectCount(commandBuffer, commands, commandsOffset, countBuffer, countOffset,
+			std::min(maxDraws, support.maxDrawIndirectCount), stride);
+		return;
+	}
+
+	// Without multiDrawIndirect every indirect call is limited to one draw.
+	uint32_t batchSize = support.multiDrawIndirect ? std::max(support.maxDrawIndirectCount, 1u) : 1;
+	for (uint32_t first = 0; first < recordedCount; first += batchSize) {
+		vkCmdDrawIndexedIndirect(commandBuffer, commands, commandsOffset + first * stride, std::min(batchSize, recordedCount - first), stride);
+	}
+}
+
+/// <summary>
+/// A pass worth of draws kept on the GPU: one VkDrawIndexedIndirectCommand per draw, the draw count, and a storage
+/// buffer of per object data T. Draw n is recorded with firstInstance n, so its shader finds its data at
+/// objects[gl_InstanceIndex]. Every draw in a list reads the same vertex and index buffers.
+///
+/// Recording is one vkCmdDrawIndexedIndirectCountKHR when the device has it, and the count is read when the GPU gets
+/// there, so draws can be added or dropped without recording again. Without it the count is baked in at record time.
+///
+/// Every frame in flight has its own copy of the commands, count and objects. Per frame changes go to the copy of a
+/// frame whose previous submission has finished, from the frame update. Adding and clearing draws writes every copy,
+/// so it is only done while no frame using the list is in flight.
+/// </summary>
+template <typename T> class IndirectDrawList
+{
+public:
+	void Initialize(VkDevice device, VkPhysicalDevice physicalDevice, const IndirectDrawSupport & support, uint32_t maxDraws, uint32_t frames) {
+		if (!support.Supported()) {
+			throw std::runtime_error("Indirect draws need the drawIndirectFirstInstance feature");
+		}
+
+		this->device = device;
+		this->support = support;
+		capacity = maxDraws;
+		commands.Create(device, physicalDevice, sizeof(VkDrawIndexedIndirectCommand) * maxDraws,
+			VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, frames);
+		count.Create(device, physicalDevice, sizeof(uint32_t), VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, frames);
+		objects.Create(device, physicalDevice, sizeof(T) * maxDraws, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, frames);
+		Clear();
+	}
+
+	/// <summary>
+	/// Appends a draw of mesh to every frame's copy and returns its draw ID.
+	/// </summary>
+	uint32_t Add(const Mesh & mesh, const T & data) {
+		if (drawCount == capacity) {
+			throw std::runtime_error("Indirect draw list is full!");
+		}
+		if (drawCount == 0) {
+			vertexBuffer = mesh.vertexBuffer;
+			indexBuffer = mesh.indexBuffer;
+			indexType = mesh.indexType;
+		}
+		else if (mesh.vertexBuffer != vertexBuffer || mesh.indexBuffer != indexBuffer || mesh.indexType != indexType) {
+			throw std::runtime_error("Every mesh in an indirect draw list must share its vertex and index buffers");
+		}
+
+		auto drawId = drawCount++;
+		for (uint32_t frame = 0; frame < commands.frames; frame++) {
+			auto & command = commands.As<VkDrawIndexedIndirectCommand>(frame)[drawId];
+			command.indexCount = mesh.indexCount;
+			command.instanceCount = 1;
+			command.firstIndex = mesh.firstIndex;
+			command.vertexOffset = mesh.vertexOffset;
+			command.firstInstance = drawId;
+			objects.As<T>(frame)[drawId] = data;
+			*count.As<uint32_t>(frame) = drawCount;
+		}
+		return drawId;
+	}
+
+	/// <summary>
+	/// Writes the draw's data into frame's copy. Only call it once frame's previous submission has finished.
+	/// </summary>
+	void Update(uint32_t frame, uint32_t drawId, const T & data) {
+		if (drawId >= drawCount) {
+			throw std::runtime_error("Updated a draw the list doesn't hold");
+		}
+		objects.As<T>(frame)[drawId] = data;
+	}
+
+	/// <summary>
+	/// Points the draw at another range of the shared buffers in frame's copy, as when its detail level changes. The
+	/// same rules as Update apply.
+	/// </summary>
+	void SetMesh(uint32_t frame, uint32_t drawId, const Mesh & mesh) {
+		if (drawId >= drawCount) {
+			throw std::runtime_error("Updated a draw the list doesn't hold");
+		}
+		if (mesh.vertexBuffer != vertexBuffer || mesh.indexBuffer != indexBuffer || mesh.indexType != indexType) {
+			throw std::runtime_error("Every mesh in an indirect draw list must share its vertex and index buffers");
+		}
+
+		auto & command = commands.As<VkDrawIndexedIndirectCommand>(frame)[drawId];
+		command.indexCount = mesh.indexCount;
+		command.firstIndex = mesh.firstIndex;
+		command.vertexOffset = mesh.vertexOffset;
+	}
+
+	void Clear() {
+		drawCount = 0;
+		for (uint32_t frame = 0; frame < count.frames; frame++) {
+			*count.As<uint32_t>(frame) = 0;
+		}
+	}
+
+	/// <summary>
+	/// Binds the shared buffers and issues frame's copy of the whole list. The pipeline and the set holding
+	/// ObjectsInfo(frame) must be bound.
+	/// </summary>
+	void Record(VkCommandBuffer commandBuffer, uint32_t frame) const {
+		BindBuffers(commandBuffer);
+		recordIndexedIndirect(commandBuffer, support, commands.buffer, commands.Offset(frame), count.buffer, count.Offset(frame), capacity, drawCount);
+	}
+
+	/// <summary>
+	/// Binds the vertex and index buffers every draw in the list reads, for passes that issue commands of their own.
+	/// </summary>
+	void BindBuffers(VkCommandBuffer commandBuffer) const {
+		if (vertexBuffer == VK_NULL_HANDLE) return;
+
+		VkDeviceSize offset = 0;
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer, &offset);
+		vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, indexType);
+	}
+
+	uint32_t Count() const { return drawCount; }
+	uint32_t Capacity() const { return capacity; }
+	const IndirectDrawSupport & Support() const { return support; }
+	uint32_t Frames() const { return objects.frames; }
+	VkDescriptorBufferInfo ObjectsInfo(uint32_t frame) const { return objects.FrameInfo(frame); }
+	VkDescriptorBufferInfo CommandsInfo(uint32_t frame) const { return commands.FrameInfo(frame); }
+	VkDescriptorBufferInfo CountInfo(uint32_t frame) const { return count.FrameInfo(frame); }
+
+	void Cleanup() {
+		if (device == VK_NULL_HANDLE) return;
+
+		commands.Destroy(device);
+		count.Destroy(device);
+		objects.Destroy(device);
+		device = VK_NULL_HANDLE;
+	}
+
+private:
+	VkDevice device = VK_NULL_HANDLE;
+	IndirectDrawSupport support;
+	MappedBuffer commands;
+	MappedBuffer count;
+	MappedBuffer objects;
+	uint32_t capacity = 0;
+	uint32_t drawCount = 0;
+	VkBuffer vertexBuffer = VK_NULL_HANDLE;
+	VkBuffer indexBuffer = VK_NULL_HANDLE;
+	VkIndexType indexType = VK_INDEX_TYPE_UINT16;
+};
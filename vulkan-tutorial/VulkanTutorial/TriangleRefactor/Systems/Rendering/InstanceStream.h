@@ -0,0 +1,98 @@
+#pragma once
+#include <vulkan\vulkan.h>
+#include <cstring>
+#include <vector>
+#include <stdexcept>
+
+#include <Systems\Graphics\MappedBuffer.h>
+#include <Systems\Rendering\Mesh.h>
+
+/// <summary>
+/// Where a run of instances lives inside each frame's slice of the stream. The buffer is bound at offset, so the first
+/// instance of the run is instance 0 of the draw.
+/// </summary>
+struct InstanceRange
+{
+	VkDeviceSize offset;
+	uint32_t count;
+};
+
+/// <summary>
+/// Persistently mapped vertex buffer of per instance data, read through a VK_VERTEX_INPUT_RATE_INSTANCE binding.
+/// Ranges are reserved when the draws are recorded and rewritten whenever the instances move, so thousands of copies of
+/// a mesh cost one draw and one memcpy. Every frame in flight has its own copy of every range, written from the frame
+/// update and bound by that frame's command buffer.
+/// With a RenderQueue, write one range in Instances() order and bind it before recording: instance rate attributes
+/// start at the batch's firstInstance, so every batch reads its own slice.
+/// </summary>
+template <typename T> class InstanceStream
+{
+public:
+	void Initialize(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t maxInstances, uint32_t frames, uint32_t binding = 1) {
+		this->device = device;
+		this->binding = binding;
+		capacity = maxInstances;
+		instances.Create(device, physicalDevice, sizeof(T) * maxInstances, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, frames);
+	}
+
+	InstanceRange Allocate(uint32_t count) {
+		if (used + count > capacity) {
+			throw std::runtime_error("Instance stream is full!");
+		}
+
+		InstanceRange range = { sizeof(T) * used, count };
+		used += count;
+		return range;
+	}
+
+	/// <summary>
+	/// Writes frame's copy of the range. Only call it once frame's previous submission has finished.
+	/// </summary>
+	void Write(uint32_t frame, const InstanceRange & range, const T * data, uint32_t count) {
+		if (count > range.count) {
+			throw std::runtime_error("More instances written than the range holds");
+		}
+		memcpy(instances.As<char>(frame) + range.offset, data, sizeof(T) * count);
+	}
+
+	void Write(uint32_t frame, const InstanceRange & range, const std::vector<T> & data) {
+		Write(frame, range, data.data(), static_cast<uint32_t>(data.size()));
+	}
+
+	void Bind(VkCommandBuffer commandBuffer, uint32_t frame, const InstanceRange & range) const {
+		VkDeviceSize offset = instances.Offset(frame) + range.offset;
+		vkCmdBindVertexBuffers(commandBuffer, binding, 1, &instances.buffer, &offset);
+	}
+
+	/// <summary>
+	/// Records one draw of every instance in frame's copy of range. The mesh's own buffers must already be bound.
+	/// </summary>
+	void Draw(VkCommandBuffer commandBuffer, uint32_t frame, const Mesh & mesh, const InstanceRange & range) const {
+		Bind(commandBuffer, frame, range);
+		vkCmdDrawIndexed(commandBuffer, mesh.indexCount, range.count, mesh.firstIndex, mesh.vertexOffset, 0);
+	}
+
+	/// <summary>
+	/// Drops every range handed out, for scenes that rebuild their draw list.
+	/// </summary>
+	void Reset() {
+		used = 0;
+	}
+
+	uint32_t GetBinding() const { return binding; }
+	uint32_t GetCapacity() const { return capacity; }
+
+	void Cleanup() {
+		if (device == VK_NULL_HANDLE) return;
+
+		instances.Destroy(device);
+		device = VK_NULL_HANDLE;
+	}
+
+private:
+	VkDevice device = VK_NULL_HANDLE;
+	MappedBuffer instances;
+	uint32_t binding = 1;
+	uint32_t capacity = 0;
+	uint32_t used = 0;
+};
@@ -0,0 +1,202 @@
+#pragma once
+#include <vulkan\vulkan.h>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include <Systems\Graphics\IVulkanGraphicsSystem.h>
+#include <Systems\Descriptors\DescriptorBinder.h>
+#include <Systems\Descriptors\DescriptorWriter.h>
+#include <Systems\Descriptors\DynamicUniformAllocator.h>
+
+/// <summary>
+/// What every instance of a material shares: the pipeline, its layout and one parameter set. The set points at the
+/// shared parameter buffer through a dynamic uniform descriptor, instances only differ by their offset into it.
+/// </summary>
+struct MaterialTemplate
+{
+	std::string name;
+	std::string pipelineId;
+	VkPipelineLayout layout;
+	VkDescriptorSet parameterSet;
+	uint32_t parameterSize;
+	// Creation order, draws are grouped by it.
+	uint32_t index;
+	// Drawn over what is behind it, so its draws are ordered back to front rather than by state.
+	bool blended;
+};
+
+struct MaterialInstance
+{
+	const MaterialTemplate * materialTemplate;
+	DynamicUniformRange parameters;
+	uint32_t index;
+};
+
+/// <summary>
+/// Owns material templates, their instances and the buffer every instance's parameter block is packed into.
+/// Parameters are bound at MaterialSet, binding 0, as a UNIFORM_BUFFER_DYNAMIC.
+///
+/// Every frame in flight has its own copy of the parameters. Changes are kept on the CPU and reach each frame's copy
+/// when Update is called for that frame, from the frame update.
+/// </summary>
+class MaterialSystem
+{
+public:
+	void Initialize(IVulkanGraphicsSystem * graphicsSystem, VkDeviceSize parameterCapacity = 256 * 1024) {
+		auto frames = graphicsSystem->GetFrameCount();
+		if (frames > 32) {
+			throw std::runtime_error("Material parameters track at most 32 frames in flight");
+		}
+		this->graphicsSystem = graphicsSystem;
+		allFrames = frames == 32 ? ~0u : (1u << frames) - 1;
+		parameters.Initialize(graphicsSystem->GetDevice(), graphicsSystem->GetPhysicalDevice(), parameterCapacity, frames);
+	}
+
+	bool IsInitialized() const {
+		return graphicsSystem != nullptr;
+	}
+
+	/// <summary>
+	/// Registers a template, or re-points an existing one at a pipeline built again under the same name so the
+	/// instances created from it stay valid. parameterSetLayout may be null for materials without parameters, blended
+	/// is set for pipelines that blend with what was drawn before them.
+	/// </summary>
+	MaterialTemplate * CreateTemplate(const std::string & name, const GraphicsPipeline & pipeline, VkPipelineLayout layout,
+		VkDescriptorSetLayout parameterSetLayout, uint32_t parameterSize, bool blended = false) {
+		auto existing = templatesByName.find(name);
+		if (existing != templatesByName.end()) {
+			if (existing->second->parameterSize != parameterSize || existing->second->blended != blended) {
+				throw std::runtime_error("Material " + name + " was recreated with a different parameter block or blending");
+			}
+			existing->second->pipelineId = pipeline.id;
+			existing->second->layout = layout;
+			return existing->second;
+		}
+
+		MaterialTemplate materialTemplate = {};
+		materialTemplate.name = name;
+		materialTemplate.pipelineId = pipeline.id;
+		materialTemplate.layout = layout;
+		materialTemplate.parameterSize = parameterSize;
+		materialTemplate.index = static_cast<uint32_t>(templates.size());
+		materialTemplate.blended = blended;
+
+		if (parameterSetLayout != VK_NULL_HANDLE && parameterSize > 0) {
+			materialTemplate.parameterSet = graphicsSystem->AllocateDescriptorSet(parameterSetLayout);
+			DescriptorWriter(materialTemplate.parameterSet)
+				.WriteBuffer(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, parameters.DescriptorInfo(parameterSize))
+				->Update(graphicsSystem->GetDevice());
+		}
+
+		templates.push_back(materialTemplate);
+		templatesByName[name] = &templates.back();
+		return &templates.back();
+	}
+
+	MaterialInstance * CreateInstance(const MaterialTemplate * materialTemplate, const void * parameterData) {
+		MaterialInstance instance = {};
+		instance.materialTemplate = materialTemplate;
+		instance.index = static_cast<uint32_t>(instances.size());
+		if (materialTemplate->parameterSize > 0) {
+			instance.parameters = parameters.Allocate(materialTemplate->parameterSize);
+			// No recorded command reads a new range yet, every frame's copy can be written straight away.
+			parameters.WriteAll(instance.parameters, parameterData);
+		}
+
+		auto bytes = static_cast<const char *>(parameterData);
+		parameterCopies.push_back(std::vector<char>(bytes, bytes + materialTemplate->parameterSize));
+		pendingFrames.push_back(0);
+		instances.push_back(instance);
+		return &instances.back();
+	}
+
+	template <typename T> MaterialInstance * CreateInstance(const MaterialTemplate * materialTemplate, const T & parameterData) {
+		checkSize(materialTemplate, sizeof(T));
+		return CreateInstance(materialTemplate, static_cast<const void *>(&parameterData));
+	}
+
+	/// <summary>
+	/// Takes effect in each frame as Update reaches it, frames already in flight keep the values they started with.
+	/// </summary>
+	template <typename T> void SetParameters(const MaterialInstance * instance, const T & parameterData) {
+		checkSize(instance->materialTemplate, sizeof(T));
+		memcpy(parameterCopies[instance->index].data(), &parameterData, sizeof(T));
+		if (pendingFrames[instance->index] == 0) {
+			changed.push_back(instance->index);
+		}
+		pendingFrames[instance->index] = allFrames;
+	}
+
+	/// <summary>
+	/// The values last given to the instance, whether or not every frame has them yet.
+	/// </summary>
+	template <typename T> T GetParameters(const MaterialInstance * instance) const {
+		checkSize(instance->materialTemplate, sizeof(T));
+		T parameterData;
+		memcpy(&parameterData, parameterCopies[instance->index].data(), sizeof(T));
+		return parameterData;
+	}
+
+	/// <summary>
+	/// Writes the changed parameters into frame's copy. Only once frame's previous submission has finished.
+	/// </summary>
+	void Update(uint32_t frame) {
+		auto frameBit = 1u << frame;
+		size_t kept = 0;
+		for (auto index : changed) {
+			if (pendingFrames[index] & frameBit) {
+				parameters.Write(frame, instances[index].parameters, parameterCopies[index].data());
+				pendingFrames[index] &= ~frameBit;
+			}
+			if (pendingFrames[index] != 0) {
+				changed[kept++] = index;
+			}
+		}
+		changed.resize(kept);
+	}
+
+	/// <summary>
+	/// Dynamic offset of the instance's parameters for the frame being recorded.
+	/// </summary>
+	uint32_t ParameterOffset(const MaterialInstance & instance) const {
+		return parameters.Offset(instance.parameters, graphicsSystem->GetRecordingFrame());
+	}
+
+	VkPipeline GetPipeline(const MaterialTemplate & materialTemplate) const {
+		return graphicsSystem->GetGraphicsPipeline(materialTemplate.pipelineId);
+	}
+
+	void Cleanup() {
+		parameters.Cleanup();
+		parameterCopies.clear();
+		pendingFrames.clear();
+		changed.clear();
+		instances.clear();
+		templatesByName.clear();
+		templates.clear();
+	}
+
+private:
+	static void checkSize(const MaterialTemplate * materialTemplate, size_t size) {
+		if (size != materialTemplate->parameterSize) {
+			throw std::runtime_error("Parameters don't match the block of material " + materialTemplate->name);
+		}
+	}
+
+	IVulkanGraphicsSystem * graphicsSystem = nullptr;
+	DynamicUniformAllocator parameters;
+	// Deques so the pointers handed out stay valid as materials are added.
+	std::deque<MaterialTemplate> templates;
+	std::deque<MaterialInstance> instances;
+	std::map<std::string, MaterialTemplate *> templatesByName;
+	// By instance index: the latest parameters, and the frames whose copy doesn't have them yet.
+	std::vector<std::vector<char>> parameterCopies;
+	std::vector<uint32_t> pendingFrames;
+	std::vector<uint32_t> changed;
+	uint32_t allFrames = 0;
+};
@@ -0,0 +1,18 @@
+#pragma once
+#include <vulkan\vulkan.h>
+#include <cstdint>
+
+/// <summary>
+/// Geometry a draw reads: which buffers to bind and the range of indices to draw from them. index identifies the mesh
+/// in sort keys, draws of the same mesh are merged into one instanced draw.
+/// </summary>
+struct Mesh
+{
+	VkBuffer vertexBuffer;
+	VkBuffer indexBuffer;
+	VkIndexType indexType;
+	uint32_t indexCount;
+	uint32_t firstIndex;
+	int32_t vertexOffset;
+	uint32_t index;
+};
@@ -0,0 +1,133 @@
+#pragma once
+#include <glm\glm.hpp>
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+
+#include <Systems\Rendering\Mesh.h>
+#include <Systems\Rendering\MeshSimplifier.h>
+#include <Systems\Culling\Frustum.h>
+
+/// <summary>
+/// Where one level's triangles sit in the shared index data, and how far it strays from the full mesh in the mesh's
+/// own units.
+/// </summary>
+struct LodRange
+{
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	float error;
+};
+
+/// <summary>
+/// Index data of every level of a mesh, the full mesh first. All levels index the same vertices, so one vertex buffer
+/// and this one index buffer hold the whole chain.
+/// </summary>
+template <typename I> struct LodIndices
+{
+	std::vector<I> indices;
+	std::vector<LodRange> levels;
+};
+
+/// <summary>
+/// Builds the level chain when a mesh is imported, each level aiming for ratio of the previous one's triangles. Every
+/// level is simplified from the full mesh so its error is measured against what was authored. The chain stops early
+/// once a level can't get meaningfully smaller, flat or tiny meshes may keep only the full one.
+/// </summary>
+template <typename V, typename I> static LodIndices<I> GenerateLods(const std::vector<V> & vertices, const std::vector<I> & indices,
+	uint32_t maxLevels = 4, float ratio = 0.5f) {
+	LodIndices<I> lods;
+	lods.indices = indices;
+	lods.levels.push_back({ 0, static_cast<uint32_t>(indices.size()), 0.0f });
+
+	// Vertices equal apart from their position share an attributes key, so the simplifier can tell seams apart.
+	std::vector<glm::vec3> positions(vertices.size());
+	std::vector<uint32_t> attributes(vertices.size());
+	std::unordered_map<std::string, uint32_t> keys;
+	for (size_t i = 0; i < vertices.size(); i++) {
+		positions[i] = vertices[i].position;
+		auto vertex = vertices[i];
+		vertex.position = glm::vec3(0.0f);
+		std::string bytes(reinterpret_cast<const char *>(&vertex), sizeof(vertex));
+		attributes[i] = keys.insert({ bytes, static_cast<uint32_t>(keys.size()) }).first->second;
+	}
+
+	auto target = static_cast<float>(indices.size());
+	for (uint32_t level = 1; level < maxLevels; level++) {
+		target *= ratio;
+		float error = 0.0f;
+		auto simplified = MeshSimplifier::Simplify(positions, indices, static_cast<size_t>(target), FLT_MAX, error, attributes);
+
+		// A level that saves less than a tenth of the one before it costs memory and buys nothing.
+		auto previous = lods.levels.back();
+		if (simplified.empty() || simplified.size() * 10 > previous.indexCount * 9) break;
+
+		lods.levels.push_back({ static_cast<uint32_t>(lods.indices.size()), static_cast<uint32_t>(simplified.size()),
+			std::max(error, previous.error) });
+		lods.indices.insert(lods.indices.end(), simplified.begin(), simplified.end());
+	}
+	return lods;
+}
+
+/// <summary>
+/// Camera terms for turning an error in world units into pixels. pixelsPerUnit is how many pixels a unit long segment
+/// facing the camera covers at distance one.
+/// </summary>
+struct LodCamera
+{
+	glm::vec3 position;
+	float pixelsPerUnit;
+	// Largest error allowed on screen, in pixels.
+	float pixelThreshold;
+
+	static LodCamera FromPerspective(const glm::vec3 & position, float verticalFov, float viewportHeight, float pixelThreshold = 1.0f) {
+		return { position, viewportHeight / (2.0f * std::tan(verticalFov * 0.5f)), pixelThreshold };
+	}
+};
+
+/// <summary>
+/// Every level of one mesh as a drawable Mesh, coarsest last.
+/// </summary>
+struct LodMesh
+{
+	std::vector<Mesh> levels;
+	std::vector<float> errors;
+
+	/// <summary>
+	/// Wraps uploaded LodIndices. Levels take consecutive mesh indices from firstMeshIndex, so draws only merge with
+	/// draws of the same level.
+	/// </summary>
+	template <typename I> static LodMesh Create(const Mesh & fullMesh, const LodIndices<I> & lods, uint32_t firstMeshIndex) {
+		LodMesh lodMesh;
+		for (size_t level = 0; level < lods.levels.size(); level++) {
+			auto mesh = fullMesh;
+			mesh.firstIndex = fullMesh.firstIndex + lods.levels[level].firstIndex;
+			mesh.indexCount = lods.levels[level].indexCount;
+			mesh.index = firstMeshIndex + static_cast<uint32_t>(level);
+			lodMesh.levels.push_back(mesh);
+			lodMesh.errors.push_back(lods.levels[level].error);
+		}
+		return lodMesh;
+	}
+
+	/// <summary>
+	/// The coarsest level whose error projects to no more than the camera's threshold. The distance is taken to the
+	/// nearest point of the bounds, and scale converts the mesh's units to world units.
+	/// </summary>
+	uint32_t Select(const BoundingSphere & worldBounds, float scale, const LodCamera & camera) const {
+		auto & sphere = worldBounds.centerRadius;
+		auto offset = glm::vec3(sphere.x, sphere.y, sphere.z) - camera.position;
+		float distance = std::sqrt(glm::dot(offset, offset)) - sphere.w;
+		if (distance <= 0.0f) return 0;
+
+		auto level = static_cast<uint32_t>(levels.size() - 1);
+		while (level > 0 && errors[level] * scale / distance * camera.pixelsPerUnit > camera.pixelThreshold) {
+			level--;
+		}
+		return level;
+	}
+};
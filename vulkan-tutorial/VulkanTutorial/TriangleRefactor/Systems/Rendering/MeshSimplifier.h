@@ -0,0 +1,350 @@
+#pragma once
+#include <glm\glm.hpp>
+#include <vector>
+#include <queue>
+#include <unordered_map>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+/// <summary>
+/// Symmetric 4x4 error quadric of Garland and Heckbert, the sum of squared distances to a set of planes.
+/// </summary>
+struct Quadric
+{
+	// Upper triangle of the matrix row by row: aa ab ac ad bb bc bd cc cd dd.
+	double terms[10] = {};
+
+	static Quadric FromPlane(const glm::vec3 & normal, float distance, double weight) {
+		double a = normal.x, b = normal.y, c = normal.z, d = distance;
+		Quadric quadric;
+		double values[10] = { a * a, a * b, a * c, a * d, b * b, b * c, b * d, c * c, c * d, d * d };
+		for (int i = 0; i < 10; i++) {
+			quadric.terms[i] = values[i] * weight;
+		}
+		return quadric;
+	}
+
+	Quadric & operator+=(const Quadric & other) {
+		for (int i = 0; i < 10; i++) {
+			terms[i] += other.terms[i];
+		}
+		return *this;
+	}
+
+	double Error(const glm::vec3 & point) const {
+		double x = point.x, y = point.y, z = point.z;
+		auto & q = terms;
+		return q[0] * x * x + 2 * q[1] * x * y + 2 * q[2] * x * z + 2 * q[3] * x
+			+ q[4] * y * y + 2 * q[5] * y * z + 2 * q[6] * y
+			+ q[7] * z * z + 2 * q[8] * z
+			+ q[9];
+	}
+};
+
+/// <summary>
+/// Reduces an indexed triangle list by collapsing edges, cheapest quadric error first. Vertices are never moved or
+/// created, a collapse folds one vertex into a neighbour, so the result indexes the original vertex buffer and can sit
+/// in the same buffers as the full mesh.
+///
+/// Vertices at the same position are welded for the topology, so attribute seams don't tear open. A collapse moves
+/// each corner to the vertex at the target on its own side of any seam, and is skipped when a side has none there.
+/// Open borders carry extra planes that keep the outline in place, and collapses that would flip a triangle are
+/// skipped.
+/// </summary>
+class MeshSimplifier
+{
+public:
+	/// <summary>
+	/// Collapses until at most targetIndexCount indices remain or the next collapse would move the surface further
+	/// than maxError. error receives a bound on the largest distance introduced, in the units of positions, held at
+	/// a few times the real distance along borders. Vertices with the same attributes key carry the same attributes
+	/// apart from their position, without keys every vertex is taken to differ from every other one.
+	/// </summary>
+	template <typename I> static std::vector<I> Simplify(const std::vector<glm::vec3> & positions, const std::vector<I> & indices,
+		size_t targetIndexCount, float maxError, float & error, const std::vector<uint32_t> & attributes = {}) {
+		if (indices.size() % 3 != 0) {
+			throw std::runtime_error("Simplified meshes must be whole triangles");
+		}
+		if (!attributes.empty() && attributes.size() != positions.size()) {
+			throw std::runtime_error("Simplified mesh needs one attributes key per vertex");
+		}
+
+		MeshSimplifier simplifier(positions, attributes);
+		for (size_t i = 0; i < indices.size(); i += 3) {
+			simplifier.addTriangle(indices[i], indices[i + 1], indices[i + 2]);
+		}
+		simplifier.collapse(targetIndexCount / 3, static_cast<double>(maxError) * maxError);
+		error = static_cast<float>(std::sqrt(simplifier.appliedError));
+
+		std::vector<I> result;
+		result.reserve(simplifier.liveTriangles * 3);
+		for (auto & triangle : simplifier.triangles) {
+			if (!triangle.removed) {
+				for (int corner = 0; corner < 3; corner++) {
+					result.push_back(static_cast<I>(triangle.vertices[corner]));
+				}
+			}
+		}
+		return result;
+	}
+
+private:
+	// Borders are held with planes this much stronger than the surface's own.
+	static const int BorderWeight = 10;
+
+	struct Triangle
+	{
+		// Vertices in the caller's buffer, and the welded vertex each one currently belongs to.
+		uint32_t vertices[3];
+		uint32_t welded[3];
+		bool removed;
+	};
+
+	struct Collapse
+	{
+		double cost;
+		uint32_t from;
+		uint32_t to;
+		uint32_t fromVersion;
+		uint32_t toVersion;
+
+		bool operator>(const Collapse & other) const { return cost > other.cost; }
+	};
+
+	struct PositionHash
+	{
+		size_t operator()(const glm::vec3 & position) const {
+			uint32_t bits[3];
+			memcpy(bits, &position, sizeof(bits));
+			return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+		}
+	};
+
+	struct PositionEqual
+	{
+		bool operator()(const glm::vec3 & a, const glm::vec3 & b) const {
+			return a.x == b.x && a.y == b.y && a.z == b.z;
+		}
+	};
+
+	MeshSimplifier(const std::vector<glm::vec3> & positions, const std::vector<uint32_t> & attributes) : positions(positions) {
+		// Each distinct position becomes one welded vertex, represented by the first vertex found there.
+		std::unordered_map<glm::vec3, uint32_t, PositionHash, PositionEqual> first;
+		weldedOf.resize(positions.size());
+		attributesOf.resize(positions.size());
+		for (uint32_t i = 0; i < positions.size(); i++) {
+			auto found = first.insert({ positions[i], i });
+			weldedOf[i] = found.first->second;
+			attributesOf[i] = attributes.empty() ? i : attributes[i];
+		}
+		quadrics.resize(positions.size());
+		vertexTriangles.resize(positions.size());
+		versions.assign(positions.size(), 0);
+		removedVertices.assign(positions.size(), false);
+	}
+
+	void addTriangle(uint32_t a, uint32_t b, uint32_t c) {
+		if (a >= positions.size() || b >= positions.size() || c >= positions.size()) {
+			throw std::runtime_error("Simplified mesh index points past its vertices");
+		}
+		Triangle triangle = { { a, b, c }, { weldedOf[a], weldedOf[b], weldedOf[c] }, false };
+		if (triangle.welded[0] == triangle.welded[1] || triangle.welded[1] == triangle.welded[2] || triangle.welded[2] == triangle.welded[0]) {
+			return;
+		}
+
+		auto index = static_cast<uint32_t>(triangles.size());
+		triangles.push_back(triangle);
+		liveTriangles++;
+		for (auto vertex : triangle.welded) {
+			vertexTriangles[vertex].push_back(index);
+		}
+
+		// Planes are unweighted, so the square root of a quadric's error bounds the distance to every plane it holds.
+		auto & p0 = positions[triangle.welded[0]];
+		auto & p1 = positions[triangle.welded[1]];
+		auto & p2 = positions[triangle.welded[2]];
+		auto normal = glm::cross(p1 - p0, p2 - p0);
+		float length = glm::length(normal);
+		if (length <= 0.0f) return;
+		normal = normal / length;
+		auto quadric = Quadric::FromPlane(normal, -glm::dot(normal, p0), 1.0);
+		for (auto vertex : triangle.welded) {
+			quadrics[vertex] += quadric;
+		}
+	}
+
+	void collapse(size_t targetTriangles, double maxCost) {
+		addBorderQuadrics();
+
+		for (uint32_t t = 0; t < triangles.size(); t++) {
+			for (int corner = 0; corner < 3; corner++) {
+				pushCollapse(triangles[t].welded[corner], triangles[t].welded[(corner + 1) % 3]);
+				pushCollapse(triangles[t].welded[(corner + 1) % 3], triangles[t].welded[corner]);
+			}
+		}
+
+		while (liveTriangles > targetTriangles && !candidates.empty()) {
+			auto candidate = candidates.top();
+			candidates.pop();
+			if (candidate.cost > maxCost) break;
+			if (removedVertices[candidate.from] || removedVertices[candidate.to] ||
+				versions[candidate.from] != candidate.fromVersion || versions[candidate.to] != candidate.toVersion) {
+				continue;
+			}
+			if (flipsTriangle(candidate.from, candidate.to) || !matchSeams(candidate.from, candidate.to)) continue;
+
+			apply(candidate.from, candidate.to);
+			appliedError = std::max(appliedError, candidate.cost);
+		}
+	}
+
+	// Edges used by one triangle only get a plane through the edge, perpendicular to the triangle.
+	void addBorderQuadrics() {
+		std::unordered_map<uint64_t, uint32_t> edgeUses;
+		auto key = [](uint32_t a, uint32_t b) { return static_cast<uint64_t>(std::min(a, b)) << 32 | std::max(a, b); };
+		for (auto & triangle : triangles) {
+			for (int corner = 0; corner < 3; corner++) {
+				edgeUses[key(triangle.welded[corner], triangle.welded[(corner + 1) % 3])]++;
+			}
+		}
+
+		for (auto & triangle : triangles) {
+			auto & p0 = positions[triangle.welded[0]];
+			auto normal = glm::cross(positions[triangle.welded[1]] - p0, positions[triangle.welded[2]] - p0);
+			if (glm::length(normal) <= 0.0f) continue;
+			normal = glm::normalize(normal);
+
+			for (int corner = 0; corner < 3; corner++) {
+				auto a = triangle.welded[corner], b = triangle.welded[(corner + 1) % 3];
+				if (edgeUses[key(a, b)] != 1) continue;
+
+				auto edge = positions[b] - positions[a];
+				auto borderNormal = glm::cross(edge, normal);
+				float length = glm::length(borderNormal);
+				if (length <= 0.0f) continue;
+				borderNormal = borderNormal / length;
+				auto quadric = Quadric::FromPlane(borderNormal, -glm::dot(borderNormal, positions[a]), BorderWeight);
+				quadrics[a] += quadric;
+				quadrics[b] += quadric;
+			}
+		}
+	}
+
+	void pushCollapse(uint32_t from, uint32_t to) {
+		Quadric combined = quadrics[from];
+		combined += quadrics[to];
+		candidates.push({ std::max(combined.Error(positions[to]), 0.0), from, to, versions[from], versions[to] });
+	}
+
+	// True when moving from onto to would turn a triangle around from over or squash it to a line.
+	bool flipsTriangle(uint32_t from, uint32_t to) const {
+		for (auto t : vertexTriangles[from]) {
+			auto & triangle = triangles[t];
+			if (triangle.removed) continue;
+			if (triangle.welded[0] == to || triangle.welded[1] == to || triangle.welded[2] == to) continue;
+
+			glm::vec3 before[3], after[3];
+			for (int corner = 0; corner < 3; corner++) {
+				before[corner] = positions[triangle.welded[corner]];
+				after[corner] = triangle.welded[corner] == from ? positions[to] : before[corner];
+			}
+			auto oldNormal = glm::cross(before[1] - before[0], before[2] - before[0]);
+			auto newNormal = glm::cross(after[1] - after[0], after[2] - after[0]);
+			float newLength = glm::length(newNormal);
+			if (newLength <= 1e-12f || glm::dot(oldNormal, newNormal) <= 0.0f) return true;
+		}
+		return false;
+	}
+
+	// Fills seamTargets with the vertex at to for each of from's attributes. The triangles on the collapsed edge pair
+	// them up, one per side of a seam running along it. False when a side pairs with two different ones, the seam
+	// crosses the edge there, or when a triangle around from has no pair on its side and would tear the seam open.
+	bool matchSeams(uint32_t from, uint32_t to) {
+		seamTargets.clear();
+		for (auto t : vertexTriangles[from]) {
+			auto & triangle = triangles[t];
+			if (triangle.removed) continue;
+
+			int fromCorner = -1, toCorner = -1;
+			for (int corner = 0; corner < 3; corner++) {
+				if (triangle.welded[corner] == from) fromCorner = corner;
+				if (triangle.welded[corner] == to) toCorner = corner;
+			}
+			if (toCorner < 0) continue;
+
+			auto target = triangle.vertices[toCorner];
+			auto paired = seamTargets.insert({ attributesOf[triangle.vertices[fromCorner]], target });
+			if (attributesOf[paired.first->second] != attributesOf[target]) return false;
+		}
+
+		for (auto t : vertexTriangles[from]) {
+			auto & triangle = triangles[t];
+			if (triangle.removed) continue;
+			for (int corner = 0; corner < 3; corner++) {
+				if (triangle.welded[corner] == from && seamTargets.find(attributesOf[triangle.vertices[corner]]) == seamTargets.end()) {
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	// Runs after matchSeams has accepted the collapse and filled seamTargets.
+	void apply(uint32_t from, uint32_t to) {
+		removedVertices[from] = true;
+		versions[from]++;
+		versions[to]++;
+		quadrics[to] += quadrics[from];
+
+		for (auto t : vertexTriangles[from]) {
+			auto & triangle = triangles[t];
+			if (triangle.removed) continue;
+
+			bool sharesEdge = false;
+			for (int corner = 0; corner < 3; corner++) {
+				sharesEdge = sharesEdge || triangle.welded[corner] == to;
+			}
+			if (sharesEdge) {
+				triangle.removed = true;
+				liveTriangles--;
+				continue;
+			}
+
+			for (int corner = 0; corner < 3; corner++) {
+				if (triangle.welded[corner] == from) {
+					triangle.welded[corner] = to;
+					triangle.vertices[corner] = seamTargets[attributesOf[triangle.vertices[corner]]];
+				}
+			}
+			vertexTriangles[to].push_back(t);
+		}
+		vertexTriangles[from].clear();
+
+		// The target's quadric changed, every edge around it has a new cost.
+		for (auto t : vertexTriangles[to]) {
+			auto & triangle = triangles[t];
+			if (triangle.removed) continue;
+			for (auto neighbour : triangle.welded) {
+				if (neighbour == to) continue;
+				pushCollapse(to, neighbour);
+				pushCollapse(neighbour, to);
+			}
+		}
+	}
+
+	const std::vector<glm::vec3> & positions;
+	std::vector<uint32_t> weldedOf;
+	std::vector<uint32_t> attributesOf;
+	std::unordered_map<uint32_t, uint32_t> seamTargets;
+	std::vector<Quadric> quadrics;
+	std::vector<Triangle> triangles;
+	std::vector<std::vector<uint32_t>> vertexTriangles;
+	std::vector<uint32_t> versions;
+	std::vector<bool> removedVertices;
+	std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> candidates;
+	size_t liveTriangles = 0;
+	double appliedError = 0.0;
+};
@@ -0,0 +1,244 @@
+#pragma once
+#include <vulkan\vulkan.h>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <stdexcept>
+
+#include <Systems\Descriptors\DescriptorBinder.h>
+#include <Systems\Rendering\MaterialSystem.h>
+#include <Systems\Rendering\Mesh.h>
+#include <Systems\Sorting\RadixSort.h>
+
+/// <summary>
+/// Packs what a draw needs bound into 64 bits, most expensive state change first, so sorting the keys groups draws
+/// that share state:
+///   63..60 pass | 59..48 pipeline | 47..32 material | 31..16 mesh | 15..0 depth
+/// Depth is last so draws that only differ by it still end up next to each other and can be instanced, within a
+/// group they are ordered front to back.
+/// </summary>
+struct SortKey
+{
+	static const uint32_t PassBits = 4;
+	static const uint32_t PipelineBits = 12;
+	static const uint32_t MaterialBits = 16;
+	static const uint32_t MeshBits = 16;
+	static const uint32_t DepthBits = 16;
+
+	static const uint32_t DepthShift = 0;
+	static const uint32_t MeshShift = DepthShift + DepthBits;
+	static const uint32_t MaterialShift = MeshShift + MeshBits;
+	static const uint32_t PipelineShift = MaterialShift + MaterialBits;
+	static const uint32_t PassShift = PipelineShift + PipelineBits;
+
+	/// <summary>
+	/// depth is the normalized view depth, 0 at the near plane and 1 at the far one.
+	/// </summary>
+	static uint64_t Pack(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t mesh, float depth) {
+		return field(pass, PassBits, "pass") << PassShift
+			| field(pipeline, PipelineBits, "pipeline") << PipelineShift
+			| field(material, MaterialBits, "material") << MaterialShift
+			| field(mesh, MeshBits, "mesh") << MeshShift
+			| static_cast<uint64_t>(QuantizeDepth(depth)) << DepthShift;
+	}
+
+	static uint32_t QuantizeDepth(float depth) {
+		float clamped = std::min(std::max(depth, 0.0f), 1.0f);
+		return static_cast<uint32_t>(clamped * ((1 << DepthBits) - 1) + 0.5f);
+	}
+
+	static uint32_t GetPass(uint64_t key) { return unpack(key, PassShift, PassBits); }
+	static uint32_t GetPipeline(uint64_t key) { return unpack(key, PipelineShift, PipelineBits); }
+	static uint32_t GetMaterial(uint64_t key) { return unpack(key, MaterialShift, MaterialBits); }
+	static uint32_t GetMesh(uint64_t key) { return unpack(key, MeshShift, MeshBits); }
+	static uint32_t GetDepth(uint64_t key) { return unpack(key, DepthShift, DepthBits); }
+
+	/// <summary>
+	/// The key without its depth, draws for which this is equal can share one instanced draw.
+	/// </summary>
+	static uint64_t State(uint64_t key) { return key >> DepthBits; }
+
+private:
+	static uint64_t field(uint32_t value, uint32_t bits, const char * name) {
+		if (value >> bits) {
+			throw std::runtime_error(std::string("Sort key ") + name + " index doesn't fit in its bits");
+		}
+		return value;
+	}
+
+	static uint32_t unpack(uint64_t key, uint32_t shift, uint32_t bits) {
+		return static_cast<uint32_t>(key >> shift) & ((1u << bits) - 1);
+	}
+};
+
+/// <summary>
+/// One instanced draw: instanceCount consecutive entries of Instances() starting at firstInstance, all with the same mesh and
+/// material.
+/// </summary>
+struct RenderBatch
+{
+	uint32_t pass;
+	const MaterialInstance * material;
+	const Mesh * mesh;
+	uint32_t firstInstance;
+	uint32_t instanceCount;
+};
+
+/// <summary>
+/// Collects a frame's draws, sorts them by key and records them with as few state changes as the order allows: the
+/// pipeline is bound when the template changes, the parameter offset when the material does and the buffers when the
+/// mesh does. Submissions that share pass, material and mesh become one instanced draw, its instances are told apart
+/// in the shader by gl_InstanceIndex, which starts at the batch's firstInstance.
+///
+/// Blended draws can't be reordered by state, they are sorted back to front on their own and recorded after every
+/// opaque pass. Neighbours that happen to share material and mesh still become one draw, instances keep their order.
+/// </summary>
+class RenderQueue
+{
+public:
+	// Reported as the pass of blended batches.
+	static const uint32_t BlendedPass = (1 << SortKey::PassBits) - 1;
+
+	// Called after every pipeline switch, so sets below MaterialSet survive layouts that aren't compatible.
+	typedef std::function<void(DescriptorBinder &)> BindSharedSets;
+	// Binds whatever the batch needs above MaterialSet, the queue issues the draw after it returns.
+	typedef std::function<void(VkCommandBuffer, DescriptorBinder &, const RenderBatch &)> PrepareBatch;
+
+	void Submit(uint32_t pass, const MaterialInstance * material, const Mesh * mesh, uint32_t object, float depth = 0.0f) {
+		auto key = SortKey::Pack(pass, material->materialTemplate->index, material->index, mesh->index, depth);
+		keys.push_back(key);
+		order.push_back(static_cast<uint32_t>(draws.size()));
+		draws.push_back({ material, mesh, object });
+	}
+
+	/// <summary>
+	/// viewDepth is the distance along the view direction in any unit, larger is farther away.
+	/// </summary>
+	void SubmitBlended(const MaterialInstance * material, const Mesh * mesh, uint32_t object, float viewDepth) {
+		blendedKeys.push_back(~SortableFloat(viewDepth));
+		blendedOrder.push_back(static_cast<uint32_t>(draws.size()));
+		draws.push_back({ material, mesh, object });
+	}
+
+	void Clear() {
+		keys.clear();
+		order.clear();
+		blendedKeys.clear();
+		blendedOrder.clear();
+		draws.clear();
+		instances.clear();
+		batches.clear();
+		sorted = false;
+	}
+
+	/// <summary>
+	/// Orders the submissions and merges them into batches. Record calls it when it hasn't been, call it earlier to
+	/// fill per instance data from Instances() before recording, or to sort large queues on the worker pool.
+	/// </summary>
+	void Sort(WorkerPool * workers = nullptr) {
+		if (sorted) return;
+
+		sorter.Sort(keys, order, workers);
+		blendedSorter.Sort(blendedKeys, blendedOrder, workers);
+
+		instances.clear();
+		batches.clear();
+		for (size_t i = 0; i < order.size(); i++) {
+			auto & draw = draws[order[i]];
+			bool merges = i > 0 && SortKey::State(keys[i]) == SortKey::State(keys[i - 1]);
+			if (merges) {
+				batches.back().instanceCount++;
+			}
+			else {
+				batches.push_back({ SortKey::GetPass(keys[i]), draw.material, draw.mesh, static_cast<uint32_t>(i), 1 });
+			}
+			instances.push_back(draw.object);
+		}
+
+		for (size_t i = 0; i < blendedOrder.size(); i++) {
+			auto & draw = draws[blendedOrder[i]];
+			bool merges = i > 0 && batches.back().material == draw.material && batches.back().mesh == draw.mesh;
+			if (merges) {
+				batches.back().instanceCount++;
+			}
+			else {
+				batches.push_back({ BlendedPass, draw.material, draw.mesh, static_cast<uint32_t>(instances.size()), 1 });
+			}
+			instances.push_back(draw.object);
+		}
+		sorted = true;
+	}
+
+	void Record(VkCommandBuffer commandBuffer, DescriptorBinder & binder, const MaterialSystem & materials,
+		const BindSharedSets & bindSharedSets, const PrepareBatch & prepareBatch) {
+		Sort();
+
+		const MaterialTemplate * boundTemplate = nullptr;
+		const MaterialInstance * boundMaterial = nullptr;
+		const Mesh * boundMesh = nullptr;
+		pipelineBinds = 0;
+		meshBinds = 0;
+		for (auto & batch : batches) {
+			auto materialTemplate = batch.material->materialTemplate;
+			if (materialTemplate != boundTemplate) {
+				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, materials.GetPipeline(*materialTemplate));
+				binder.UseLayout(materialTemplate->layout);
+				if (bindSharedSets) bindSharedSets(binder);
+				boundTemplate = materialTemplate;
+				boundMaterial = nullptr;
+				pipelineBinds++;
+			}
+
+			if (batch.material != boundMaterial && materialTemplate->parameterSet != VK_NULL_HANDLE) {
+				auto parameterOffset = materials.ParameterOffset(*batch.material);
+				binder.Bind(MaterialSet, materialTemplate->parameterSet, 1, &parameterOffset);
+			}
+			boundMaterial = batch.material;
+
+			auto mesh = batch.mesh;
+			if (boundMesh == nullptr || mesh->vertexBuffer != boundMesh->vertexBuffer) {
+				VkDeviceSize offset = 0;
+				vkCmdBindVertexBuffers(commandBuffer, 0, 1, &mesh->vertexBuffer, &offset);
+				meshBinds++;
+			}
+			if (boundMesh == nullptr || mesh->indexBuffer != boundMesh->indexBuffer || mesh->indexType != boundMesh->indexType) {
+				vkCmdBindIndexBuffer(commandBuffer, mesh->indexBuffer, 0, mesh->indexType);
+			}
+			boundMesh = mesh;
+
+			if (prepareBatch) prepareBatch(commandBuffer, binder, batch);
+			vkCmdDrawIndexed(commandBuffer, mesh->indexCount, batch.instanceCount, mesh->firstIndex, mesh->vertexOffset, batch.firstInstance);
+		}
+	}
+
+	/// <summary>
+	/// The submitted objects in draw order, batch b draws entries [firstInstance, firstInstance + instanceCount).
+	/// </summary>
+	const std::vector<uint32_t> & Instances() const { return instances; }
+	const std::vector<RenderBatch> & Batches() const { return batches; }
+	uint32_t PipelineBinds() const { return pipelineBinds; }
+	uint32_t MeshBinds() const { return meshBinds; }
+
+private:
+	struct Draw
+	{
+		const MaterialInstance * material;
+		const Mesh * mesh;
+		uint32_t object;
+	};
+
+	std::vector<uint64_t> keys;
+	// Indices into draws, permuted alongside keys.
+	std::vector<uint32_t> order;
+	std::vector<uint32_t> blendedKeys;
+	std::vector<uint32_t> blendedOrder;
+	std::vector<Draw> draws;
+	std::vector<uint32_t> instances;
+	std::vector<RenderBatch> batches;
+	RadixSorter<uint64_t> sorter;
+	RadixSorter<uint32_t> blendedSorter;
+	bool sorted = false;
+	uint32_t pipelineBinds = 0;
+	uint32_t meshBinds = 0;
+};
@@ -0,0 +1,224 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <tuple>
+#include <cstdint>
+#include <stdexcept>
+
+/// <summary>
+/// Handle to an entity. The generation changes every time an index is reused, so a handle kept past Destroy never
+/// reaches the entity that took its place.
+/// </summary>
+struct Entity
+{
+	uint32_t index;
+	uint32_t generation;
+
+	bool operator==(const Entity & other) const { return index == other.index && generation == other.generation; }
+	bool operator!=(const Entity & other) const { return !(*this == other); }
+};
+
+static const Entity NoEntity = { UINT32_MAX, 0 };
+static const uint32_t NoComponent = UINT32_MAX;
+
+class ComponentPoolBase
+{
+public:
+	virtual ~ComponentPoolBase() {}
+
+	bool Has(Entity entity) const {
+		return entity.index < sparse.size() && sparse[entity.index] != NoComponent && entities[sparse[entity.index]] == entity;
+	}
+
+	/// <summary>
+	/// Owners of the components, in the same order as the component array.
+	/// </summary>
+	const std::vector<Entity> & Entities() const { return entities; }
+	uint32_t Size() const { return static_cast<uint32_t>(entities.size()); }
+
+	virtual void Remove(Entity entity) = 0;
+
+protected:
+	std::vector<uint32_t> sparse;
+	std::vector<Entity> entities;
+};
+
+/// <summary>
+/// Sparse set of one component type. Components sit packed in one array however entities come and go: sparse maps an
+/// entity index to its slot in the packed array, and removing a component moves the last one into the hole.
+/// </summary>
+template <typename T> class ComponentPool : public ComponentPoolBase
+{
+public:
+	T & Add(Entity entity, const T & component) {
+		if (Has(entity)) {
+			return components[sparse[entity.index]] = component;
+		}
+
+		if (entity.index >= sparse.size()) {
+			sparse.resize(entity.index + 1, NoComponent);
+		}
+		sparse[entity.index] = static_cast<uint32_t>(entities.size());
+		entities.push_back(entity);
+		components.push_back(component);
+		return components.back();
+	}
+
+	virtual void Remove(Entity entity) override {
+		if (!Has(entity)) return;
+
+		auto slot = sparse[entity.index];
+		auto last = static_cast<uint32_t>(entities.size() - 1);
+		if (slot != last) {
+			entities[slot] = entities[last];
+			components[slot] = std::move(components[last]);
+			sparse[entities[slot].index] = slot;
+		}
+		entities.pop_back();
+		components.pop_back();
+		sparse[entity.index] = NoComponent;
+	}
+
+	T & Get(Entity entity) {
+		if (!Has(entity)) {
+			throw std::runtime_error("Entity doesn't have the requested component");
+		}
+		return components[sparse[entity.index]];
+	}
+
+	T * Find(Entity entity) {
+		return Has(entity) ? &components[sparse[entity.index]] : nullptr;
+	}
+
+	/// <summary>
+	/// The packed components, Entities()[i] owns Data()[i].
+	/// </summary>
+	T * Data() { return components.data(); }
+	const T * Data() const { return components.data(); }
+
+private:
+	std::vector<T> components;
+};
+
+/// <summary>
+/// Entities and their components, each component type in its own ComponentPool. Systems either walk one pool's packed
+/// array directly or use Each, which walks the smallest of the pools involved and looks the rest up by entity.
+/// </summary>
+class EntityRegistry
+{
+public:
+	Entity Create() {
+		if (!freeIndices.empty()) {
+			auto index = freeIndices.back();
+			freeIndices.pop_back();
+			return { index, generations[index] };
+		}
+
+		generations.push_back(0);
+		return { static_cast<uint32_t>(generations.size() - 1), 0 };
+	}
+
+	/// <summary>
+	/// Removes every component of the entity and retires the handle.
+	/// </summary>
+	void Destroy(Entity entity) {
+		if (!IsAlive(entity)) return;
+
+		for (auto & pool : pools) {
+			if (pool) pool->Remove(entity);
+		}
+		generations[entity.index]++;
+		freeIndices.push_back(entity.index);
+	}
+
+	bool IsAlive(Entity entity) const {
+		return entity.index < generations.size() && generations[entity.index] == entity.generation;
+	}
+
+	/// <summary>
+	/// The current handle of index, for code that keeps bare entity indices such as a RenderQueue's objects.
+	/// </summary>
+	Entity EntityAt(uint32_t index) const {
+		if (index >= generations.size()) {
+			throw std::runtime_error("Entity index was never created");
+		}
+		return { index, generations[index] };
+	}
+
+	template <typename T> T & Add(Entity entity, const T & component) {
+		if (!IsAlive(entity)) {
+			throw std::runtime_error("Component added to a destroyed entity");
+		}
+		return Pool<T>().Add(entity, component);
+	}
+
+	template <typename T> void Remove(Entity entity) {
+		Pool<T>().Remove(entity);
+	}
+
+	template <typename T> bool Has(Entity entity) const {
+		auto pool = findPool<T>();
+		return pool && pool->Has(entity);
+	}
+
+	template <typename T> T & Get(Entity entity) {
+		return Pool<T>().Get(entity);
+	}
+
+	template <typename T> ComponentPool<T> & Pool() {
+		auto type = typeId<T>();
+		if (type >= pools.size()) {
+			pools.resize(type + 1);
+		}
+		if (!pools[type]) {
+			pools[type].reset(new ComponentPool<T>());
+		}
+		return static_cast<ComponentPool<T> &>(*pools[type]);
+	}
+
+	/// <summary>
+	/// Calls body(entity, components...) for every entity that has all the listed components. Entities are visited in
+	/// the packed order of the smallest pool, so listing a rare component makes the walk short. body must not add or
+	/// remove components of the listed types.
+	/// </summary>
+	template <typename... Components, typename Body> void Each(Body body) {
+		std::tuple<ComponentPool<Components> *...> typed(&Pool<Components>()...);
+		ComponentPoolBase * listed[] = { std::get<ComponentPool<Components> *>(typed)... };
+		auto driver = listed[0];
+		for (auto pool : listed) {
+			if (pool->Size() < driver->Size()) driver = pool;
+		}
+
+		auto & entities = driver->Entities();
+		for (size_t i = 0; i < entities.size(); i++) {
+			auto entity = entities[i];
+			bool matches = true;
+			for (auto pool : listed) {
+				matches = matches && pool->Has(entity);
+			}
+			if (matches) {
+				body(entity, *std::get<ComponentPool<Components> *>(typed)->Find(entity)...);
+			}
+		}
+	}
+
+private:
+	static uint32_t nextTypeId() {
+		static uint32_t next = 0;
+		return next++;
+	}
+
+	template <typename T> static uint32_t typeId() {
+		static const uint32_t id = nextTypeId();
+		return id;
+	}
+
+	template <typename T> const ComponentPool<T> * findPool() const {
+		auto type = typeId<T>();
+		return type < pools.size() ? static_cast<const ComponentPool<T> *>(pools[type].get()) : nullptr;
+	}
+
+	std::vector<uint32_t> generations;
+	std::vector<uint32_t> freeIndices;
+	std::vector<std::unique_ptr<ComponentPoolBase>> pools;
+};
@@ -0,0 +1,217 @@
+#pragma once
+#include <glm\glm.hpp>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+
+#include <Systems\Scene\EntityRegistry.h>
+#include <Systems\Scene\TransformHierarchy.h>
+#include <Systems\Rendering\Mesh.h>
+#include <Systems\Rendering\MeshLod.h>
+#include <Systems\Rendering\MaterialSystem.h>
+#include <Systems\Rendering\RenderQueue.h>
+#include <Systems\Culling\Frustum.h>
+#include <Systems\Culling\FrustumCuller.h>
+#include <Systems\Culling\OcclusionRasterizer.h>
+#include <Systems\Culling\BoundingVolumeHierarchy.h>
+
+struct TransformComponent
+{
+	TransformHandle node;
+};
+
+/// <summary>
+/// Meshes are shared assets, entities only point at them.
+/// </summary>
+struct MeshComponent
+{
+	const Mesh * mesh;
+};
+
+/// <summary>
+/// Detail levels of the entity's mesh. SelectLods points its MeshComponent at the level the camera needs.
+/// </summary>
+struct LodComponent
+{
+	const LodMesh * lods;
+};
+
+struct MaterialComponent
+{
+	const MaterialInstance * material;
+	uint32_t pass;
+};
+
+/// <summary>
+/// Sphere around the mesh in its own space, and the same sphere in world space as of the last UpdateWorldBounds.
+/// </summary>
+struct BoundsComponent
+{
+	BoundingSphere local;
+	BoundingSphere world;
+};
+
+/// <summary>
+/// Marks the entity as hiding what is behind it, with the index of its simplified mesh in an OcclusionRasterizer.
+/// </summary>
+struct OccluderComponent
+{
+	uint32_t occluder;
+};
+
+/// <summary>
+/// Moves every entity's bounds into world space with its transform. Walks the bounds pool in packed order.
+/// </summary>
+static void UpdateWorldBounds(EntityRegistry & registry, const TransformHierarchy & transforms) {
+	registry.Each<BoundsComponent, TransformComponent>([&transforms](Entity, BoundsComponent & bounds, TransformComponent & transform) {
+		auto & world = transforms.GetWorld(transform.node);
+		auto & local = bounds.local.centerRadius;
+		auto center = world * glm::vec4(local.x, local.y, local.z, 1.0f);
+
+		// The largest axis scale keeps the sphere conservative under non uniform scaling.
+		float scale = 0.0f;
+		for (int axis = 0; axis < 3; axis++) {
+			auto column = world[axis];
+			scale = std::max(scale, column.x * column.x + column.y * column.y + column.z * column.z);
+		}
+		bounds.world.centerRadius = glm::vec4(center.x, center.y, center.z, local.w * std::sqrt(scale));
+	});
+}
+
+/// <summary>
+/// Turns world positions into the depths a RenderQueue sorts by: Normalized for Submit, 0 at the near plane and 1 at
+/// the far one, and Distance along the view direction for SubmitBlended.
+/// </summary>
+struct ViewDepth
+{
+	// Row of the view matrix that gives view space z, negated so depth grows away from the camera.
+	glm::vec4 forward;
+	float nearPlane;
+	float farPlane;
+
+	static ViewDepth FromView(const glm::mat4 & view, float nearPlane, float farPlane) {
+		return { glm::vec4(-view[0][2], -view[1][2], -view[2][2], -view[3][2]), nearPlane, farPlane };
+	}
+
+	float Distance(const glm::vec3 & position) const {
+		return forward.x * position.x + forward.y * position.y + forward.z * position.z + forward.w;
+	}
+
+	float Normalized(const glm::vec3 & position) const {
+		return (Distance(position) - nearPlane) / (farPlane - nearPlane);
+	}
+};
+
+/// <summary>
+/// Picks each entity's mesh level from its world bounds, after UpdateWorldBounds. The bounds' growth over the local
+/// sphere gives the scale that carries the level errors into world units.
+/// </summary>
+static void SelectLods(EntityRegistry & registry, const LodCamera & camera) {
+	registry.Each<LodComponent, MeshComponent, BoundsComponent>([&camera](Entity, LodComponent & lod, MeshComponent & mesh, BoundsComponent & bounds) {
+		float localRadius = bounds.local.centerRadius.w;
+		float scale = localRadius > 0.0f ? bounds.world.centerRadius.w / localRadius : 1.0f;
+		mesh.mesh = &lod.lods->levels[lod.lods->Select(bounds.world, scale, camera)];
+	});
+}
+
+/// <summary>
+/// Places every occluder mesh where its entity's transform puts it, before OcclusionRasterizer::Render.
+/// </summary>
+static void UpdateOccluders(EntityRegistry & registry, const TransformHierarchy & transforms, OcclusionRasterizer & rasterizer) {
+	registry.Each<OccluderComponent, TransformComponent>([&transforms, &rasterizer](Entity, OccluderComponent & occluder, TransformComponent & transform) {
+		rasterizer.SetTransform(occluder.occluder, transforms.GetWorld(transform.node));
+	});
+}
+
+/// <summary>
+/// Submits one entity with the entity index as the draw's object. Opaque materials are keyed by the normalized depth of
+/// the bounds' center, blended ones go through SubmitBlended with its distance along the view direction.
+/// </summary>
+static void SubmitEntity(RenderQueue & queue, const ViewDepth & depth, Entity entity, const MeshComponent & mesh,
+	const MaterialComponent & material, const BoundingSphere & worldBounds) {
+	auto & sphere = worldBounds.centerRadius;
+	auto center = glm::vec3(sphere.x, sphere.y, sphere.z);
+	if (material.material->materialTemplate->blended) {
+		queue.SubmitBlended(material.material, mesh.mesh, entity.index, depth.Distance(center));
+	}
+	else {
+		queue.Submit(material.pass, material.material, mesh.mesh, entity.index, depth.Normalized(center));
+	}
+}
+
+/// <summary>
+/// Refills culler with the world bounds of every renderable entity, after UpdateWorldBounds. entities receives the
+/// entity behind each of the culler's indices.
+/// </summary>
+static void GatherCullingBounds(EntityRegistry & registry, FrustumCuller & culler, std::vector<Entity> & entities) {
+	culler.Clear();
+	entities.clear();
+	registry.Each<MeshComponent, MaterialComponent, BoundsComponent>(
+		[&culler, &entities](Entity entity, MeshComponent &, MaterialComponent &, BoundsComponent & bounds) {
+			culler.Add(bounds.world);
+			entities.push_back(entity);
+		});
+}
+
+/// <summary>
+/// Builds hierarchy over the world bounds of every renderable entity, after UpdateWorldBounds. entities receives the
+/// entity behind each of the hierarchy's object IDs.
+/// </summary>
+static void BuildHierarchy(EntityRegistry & registry, BoundingVolumeHierarchy & hierarchy, std::vector<Entity> & entities,
+	WorkerPool * workers = nullptr) {
+	std::vector<BoundingBox> boxes;
+	entities.clear();
+	registry.Each<MeshComponent, MaterialComponent, BoundsComponent>(
+		[&boxes, &entities](Entity entity, MeshComponent &, MaterialComponent &, BoundsComponent & bounds) {
+			boxes.push_back(BoundingBox::FromSphere(bounds.world));
+			entities.push_back(entity);
+		});
+	hierarchy.Build(boxes, workers);
+}
+
+/// <summary>
+/// Moves the entities BuildHierarchy placed to their current world bounds, after UpdateWorldBounds.
+/// </summary>
+static void RefitHierarchy(EntityRegistry & registry, BoundingVolumeHierarchy & hierarchy, const std::vector<Entity> & entities) {
+	for (uint32_t object = 0; object < entities.size(); object++) {
+		hierarchy.SetBounds(object, BoundingBox::FromSphere(registry.Get<BoundsComponent>(entities[object]).world));
+	}
+	hierarchy.Refit();
+}
+
+/// <summary>
+/// The entity whose bounds the ray through cursor enters first, or NoEntity. cursor is in pixels from the top left of
+/// a viewport of the given size, viewProjection has depth from 0 to 1 and y pointing down the screen as in Vulkan.
+/// </summary>
+static Entity PickEntity(const BoundingVolumeHierarchy & hierarchy, const std::vector<Entity> & entities, const glm::mat4 & viewProjection,
+	const glm::vec2 & cursor, const glm::vec2 & viewport) {
+	float x = cursor.x / viewport.x * 2.0f - 1.0f;
+	float y = cursor.y / viewport.y * 2.0f - 1.0f;
+	auto inverse = glm::inverse(viewProjection);
+	auto nearPoint = inverse * glm::vec4(x, y, 0.0f, 1.0f);
+	auto farPoint = inverse * glm::vec4(x, y, 1.0f, 1.0f);
+	auto origin = glm::vec3(nearPoint.x / nearPoint.w, nearPoint.y / nearPoint.w, nearPoint.z / nearPoint.w);
+	auto target = glm::vec3(farPoint.x / farPoint.w, farPoint.y / farPoint.w, farPoint.z / farPoint.w);
+
+	RayHit hit;
+	if (!hierarchy.Raycast(origin, target - origin, hit, 1.0f)) {
+		return NoEntity;
+	}
+	return entities[hit.object];
+}
+
+/// <summary>
+/// Submits the entities a FrustumCuller kept through SubmitEntity, visible being what Cull returned for the bounds
+/// GatherCullingBounds collected. With a rendered OcclusionRasterizer the ones it hides are skipped too. Entities that
+/// are occluders themselves are not tested, their own depth is in the buffer and would hide them.
+/// </summary>
+static void SubmitVisible(EntityRegistry & registry, RenderQueue & queue, const ViewDepth & depth, const std::vector<uint32_t> & visible,
+	const std::vector<Entity> & entities, const OcclusionRasterizer * occlusion = nullptr) {
+	for (auto index : visible) {
+		auto entity = entities[index];
+		auto & bounds = registry.Get<BoundsComponent>(entity).world;
+		if (!occlusion || registry.Has<OccluderComponent>(entity) || occlusion->IsVisible(bounds)) {
+			SubmitEntity(queue, depth, entity, registry.Get<MeshComponent>(entity), registry.Get<MaterialComponent>(entity), bounds);
+		}
+	}
+}
@@ -0,0 +1,351 @@
+#pragma once
+#include <glm\glm.hpp>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define TRANSFORM_HIERARCHY_SSE 1
+#include <xmmintrin.h>
+#endif
+
+#include <Systems\Threading\WorkerPool.h>
+
+typedef uint32_t TransformHandle;
+static const TransformHandle NoTransform = UINT32_MAX;
+
+/// <summary>
+/// out = a * b for column major 4x4 matrices. out may not alias a or b.
+/// </summary>
+static void multiplyMatrices(const glm::mat4 & a, const glm::mat4 & b, glm::mat4 & out) {
+	const float * left = &a[0][0];
+	const float * right = &b[0][0];
+	float * result = &out[0][0];
+#ifdef TRANSFORM_HIERARCHY_SSE
+	__m128 columns[4] = { _mm_loadu_ps(left), _mm_loadu_ps(left + 4), _mm_loadu_ps(left + 8), _mm_loadu_ps(left + 12) };
+	for (int column = 0; column < 4; column++) {
+		const float * weights = right + column * 4;
+		__m128 sum = _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(columns[0], _mm_set1_ps(weights[0])), _mm_mul_ps(columns[1], _mm_set1_ps(weights[1]))),
+			_mm_add_ps(_mm_mul_ps(columns[2], _mm_set1_ps(weights[2])), _mm_mul_ps(columns[3], _mm_set1_ps(weights[3]))));
+		_mm_storeu_ps(result + column * 4, sum);
+	}
+#else
+	for (int column = 0; column < 4; column++) {
+		for (int row = 0; row < 4; row++) {
+			float sum = 0.0f;
+			for (int k = 0; k < 4; k++) {
+				sum += left[k * 4 + row] * right[column * 4 + k];
+			}
+			result[column * 4 + row] = sum;
+		}
+	}
+#endif
+}
+
+/// <summary>
+/// Parent/child transforms kept in flat arrays ordered by depth: roots first, then their children, and so on. Within
+/// a level children are grouped by parent in the order of the parents, so any run of nodes has its children in one
+/// run on the next level, and a subtree is a single range per level.
+///
+/// Update only walks the subtrees below nodes whose local transform changed since the last one, level by level so a
+/// parent is always done before its children, with the ranges of each level split across the worker pool. A frame in
+/// which nothing moved costs nothing. Creating, destroying or reparenting nodes reorders the arrays at the next Update.
+/// </summary>
+class TransformHierarchy
+{
+public:
+	static const uint32_t ChunkSize = 1024;
+
+	TransformHandle Create(const glm::mat4 & local, TransformHandle parent = NoTransform) {
+		if (parent != NoTransform) checkAlive(parent);
+		invalidateLayout();
+
+		TransformHandle handle;
+		if (!freeHandles.empty()) {
+			handle = freeHandles.back();
+			freeHandles.pop_back();
+		}
+		else {
+			handle = static_cast<TransformHandle>(nodes.size());
+			nodes.push_back({});
+		}
+
+		auto & node = nodes[handle];
+		node = {};
+		node.alive = true;
+		node.parent = parent;
+		node.local = local;
+		node.world = local;
+		if (parent != NoTransform) {
+			nodes[parent].children.push_back(handle);
+		}
+		return handle;
+	}
+
+	/// <summary>
+	/// Destroys the node and everything below it.
+	/// </summary>
+	void Destroy(TransformHandle handle) {
+		checkAlive(handle);
+		invalidateLayout();
+		detach(handle);
+
+		std::vector<TransformHandle> doomed = { handle };
+		while (!doomed.empty()) {
+			auto current = doomed.back();
+			doomed.pop_back();
+			auto & node = nodes[current];
+			doomed.insert(doomed.end(), node.children.begin(), node.children.end());
+			node = {};
+			freeHandles.push_back(current);
+		}
+	}
+
+	void SetParent(TransformHandle handle, TransformHandle parent) {
+		checkAlive(handle);
+		if (parent != NoTransform) {
+			checkAlive(parent);
+			for (auto ancestor = parent; ancestor != NoTransform; ancestor = nodes[ancestor].parent) {
+				if (ancestor == handle) {
+					throw std::runtime_error("A transform can't be parented to its own descendant");
+				}
+			}
+		}
+
+		invalidateLayout();
+		detach(handle);
+		nodes[handle].parent = parent;
+		if (parent != NoTransform) {
+			nodes[parent].children.push_back(handle);
+		}
+	}
+
+	void SetLocal(TransformHandle handle, const glm::mat4 & local) {
+		checkAlive(handle);
+		if (layoutChanged) {
+			nodes[handle].local = local;
+			return;
+		}
+
+		auto slot = nodes[handle].slot;
+		locals[slot] = local;
+		dirtySlots.push_back(slot);
+	}
+
+	const glm::mat4 & GetLocal(TransformHandle handle) const {
+		checkAlive(handle);
+		return layoutChanged ? nodes[handle].local : locals[nodes[handle].slot];
+	}
+
+	/// <summary>
+	/// As of the last Update.
+	/// </summary>
+	const glm::mat4 & GetWorld(TransformHandle handle) const {
+		checkAlive(handle);
+		return layoutChanged ? nodes[handle].world : worlds[nodes[handle].slot];
+	}
+
+	void Update(WorkerPool * workers = nullptr) {
+		updatedCount = 0;
+		if (layoutChanged) {
+			rebuildLayout();
+		}
+		if (dirtySlots.empty()) return;
+
+		pending.resize(levelStarts.size() - 1);
+		for (auto slot : dirtySlots) {
+			pending[levelOf(slot)].push_back({ slot, slot + 1 });
+		}
+		dirtySlots.clear();
+
+		for (size_t level = 0; level < pending.size(); level++) {
+			auto & ranges = pending[level];
+			if (ranges.empty()) continue;
+
+			mergeRanges(ranges);
+			chunks.clear();
+			for (auto & range : ranges) {
+				for (uint32_t begin = range.begin; begin < range.end; begin += ChunkSize) {
+					chunks.push_back({ begin, std::min(begin + ChunkSize, range.end) });
+				}
+				updatedCount += range.end - range.begin;
+			}
+
+			auto propagate = [this](size_t begin, size_t end) {
+				for (size_t chunk = begin; chunk < end; chunk++) {
+					for (uint32_t slot = chunks[chunk].begin; slot < chunks[chunk].end; slot++) {
+						auto parent = parentSlots[slot];
+						if (parent == NoTransform) {
+							worlds[slot] = locals[slot];
+						}
+						else {
+							multiplyMatrices(worlds[parent], locals[slot], worlds[slot]);
+						}
+					}
+				}
+			};
+
+			if (workers) {
+				workers->ParallelFor(chunks.size(), 1, propagate);
+			}
+			else {
+				propagate(0, chunks.size());
+			}
+
+			if (level + 1 < pending.size()) {
+				for (auto & range : ranges) {
+					Range children = { firstChildren[range.begin], firstChildren[range.end - 1] + childCounts[range.end - 1] };
+					if (children.begin < children.end) {
+						pending[level + 1].push_back(children);
+					}
+				}
+			}
+			ranges.clear();
+		}
+	}
+
+	/// <summary>
+	/// How many world transforms the last Update recomputed.
+	/// </summary>
+	uint32_t UpdatedCount() const { return updatedCount; }
+
+private:
+	struct Node
+	{
+		bool alive;
+		TransformHandle parent;
+		std::vector<TransformHandle> children;
+		uint32_t slot;
+		// Only read while the layout is being rebuilt, the slot arrays are authoritative otherwise.
+		glm::mat4 local;
+		glm::mat4 world;
+	};
+
+	struct Range
+	{
+		uint32_t begin;
+		uint32_t end;
+	};
+
+	void checkAlive(TransformHandle handle) const {
+		if (handle >= nodes.size() || !nodes[handle].alive) {
+			throw std::runtime_error("Unknown transform handle");
+		}
+	}
+
+	/// <summary>
+	/// Moves the slot values back into the nodes before the first structural change, the slots are stale from then on.
+	/// </summary>
+	void invalidateLayout() {
+		if (layoutChanged) return;
+
+		for (uint32_t slot = 0; slot < handles.size(); slot++) {
+			auto & node = nodes[handles[slot]];
+			node.local = locals[slot];
+			node.world = worlds[slot];
+		}
+		layoutChanged = true;
+	}
+
+	void detach(TransformHandle handle) {
+		auto parent = nodes[handle].parent;
+		if (parent == NoTransform) return;
+
+		auto & siblings = nodes[parent].children;
+		siblings.erase(std::find(siblings.begin(), siblings.end(), handle));
+	}
+
+	uint32_t levelOf(uint32_t slot) const {
+		return static_cast<uint32_t>(std::upper_bound(levelStarts.begin(), levelStarts.end(), slot) - levelStarts.begin() - 1);
+	}
+
+	static void mergeRanges(std::vector<Range> & ranges) {
+		std::sort(ranges.begin(), ranges.end(), [](const Range & a, const Range & b) { return a.begin < b.begin; });
+		size_t merged = 0;
+		for (size_t i = 1; i < ranges.size(); i++) {
+			if (ranges[i].begin <= ranges[merged].end) {
+				ranges[merged].end = std::max(ranges[merged].end, ranges[i].end);
+			}
+			else {
+				ranges[++merged] = ranges[i];
+			}
+		}
+		ranges.resize(merged + 1);
+	}
+
+	/// <summary>
+	/// Lays the live nodes out breadth first and marks every root dirty, so the next pass recomputes everything.
+	/// </summary>
+	void rebuildLayout() {
+		handles.clear();
+		for (TransformHandle handle = 0; handle < nodes.size(); handle++) {
+			if (nodes[handle].alive && nodes[handle].parent == NoTransform) {
+				handles.push_back(handle);
+			}
+		}
+
+		levelStarts.assign(1, 0);
+		size_t levelBegin = 0;
+		while (levelBegin < handles.size()) {
+			size_t levelEnd = handles.size();
+			levelStarts.push_back(static_cast<uint32_t>(levelEnd));
+			for (size_t slot = levelBegin; slot < levelEnd; slot++) {
+				auto & children = nodes[handles[slot]].children;
+				handles.insert(handles.end(), children.begin(), children.end());
+			}
+			levelBegin = levelEnd;
+		}
+
+		auto count = handles.size();
+		locals.resize(count);
+		worlds.resize(count);
+		parentSlots.resize(count);
+		firstChildren.resize(count);
+		childCounts.resize(count);
+
+		uint32_t nextChild = levelStarts.size() > 1 ? levelStarts[1] : 0;
+		for (uint32_t slot = 0; slot < count; slot++) {
+			nodes[handles[slot]].slot = slot;
+		}
+		for (uint32_t slot = 0; slot < count; slot++) {
+			auto & node = nodes[handles[slot]];
+			locals[slot] = node.local;
+			worlds[slot] = node.world;
+			parentSlots[slot] = node.parent == NoTransform ? NoTransform : nodes[node.parent].slot;
+			firstChildren[slot] = nextChild;
+			childCounts[slot] = static_cast<uint32_t>(node.children.size());
+			nextChild += childCounts[slot];
+		}
+
+		dirtySlots.clear();
+		if (levelStarts.size() > 1) {
+			pending.assign(levelStarts.size() - 1, {});
+			dirtySlots.reserve(levelStarts[1]);
+			for (uint32_t slot = 0; slot < levelStarts[1]; slot++) {
+				dirtySlots.push_back(slot);
+			}
+		}
+		layoutChanged = false;
+	}
+
+	std::vector<Node> nodes;
+	std::vector<TransformHandle> freeHandles;
+	bool layoutChanged = false;
+
+	// Indexed by slot, in depth order.
+	std::vector<TransformHandle> handles;
+	std::vector<glm::mat4> locals;
+	std::vector<glm::mat4> worlds;
+	std::vector<uint32_t> parentSlots;
+	std::vector<uint32_t> firstChildren;
+	std::vector<uint32_t> childCounts;
+	// First slot of every level, plus one past the last slot.
+	std::vector<uint32_t> levelStarts = { 0 };
+
+	std::vector<uint32_t> dirtySlots;
+	std::vector<std::vector<Range>> pending;
+	std::vector<Range> chunks;
+	uint32_t updatedCount = 0;
+};
@@ -0,0 +1,373 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <mutex>
+#include <future>
+#include <fstream>
+#include <sstream>
+#include <memory>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+#include <shaderc\shaderc.hpp>
+
+#include "..\..\Hash.h"
+#include "..\Threading\WorkerPool.h"
+
+struct ShaderSource {
+	ShaderSource(const std::string & filename) : filename(filename) {
+
+	}
+
+	ShaderSource(const std::string & filename, std::vector<std::string> defines) : filename(filename), defines(std::move(defines)) {
+
+	}
+
+	std::string filename;
+	std::vector<std::string> defines;
+};
+
+/// <summary>
+/// Compiles GLSL to SPIR-V on the worker pool with the shaderc library linked into the process, and keeps the results
+/// in an on-disk cache keyed by a hash of the source, everything it includes, its defines and the compiler build. A
+/// warm cache costs one read of each source file, the compiler only runs for shaders that actually changed.
+///
+/// Quoted includes are looked up next to the including file first and then in the include directories, angled
+/// includes only in the include directories.
+/// </summary>
+class ShaderCompiler {
+public:
+	ShaderCompiler(WorkerPool & workers, std::string cacheDirectory = "shaders/.cache", std::vector<std::string> includeDirectories = { "shaders" })
+		: workers(workers), cacheDirectory(std::move(cacheDirectory)), includeDirectories(std::move(includeDirectories)) {
+		if (!compiler.IsValid()) {
+			throw std::runtime_error("Failed to initialize the shader compiler");
+		}
+		makeDirectory(this->cacheDirectory);
+		compilerVersion = hashCompilerBuild();
+	}
+
+	/// <summary>
+	/// Returns the path of the compiled SPIR-V, compiling on a worker only when the cache has no entry for the current source.
+	/// </summary>
+	std::shared_future<std::string> CompileAsync(const ShaderSource & source) {
+		return workers.Enqueue([this, source]() { return compile(source); }).share();
+	}
+
+	std::vector<std::string> CompileAll(const std::vector<ShaderSource> & sources) {
+		std::vector<std::shared_future<std::string>> pending;
+		for (auto & source : sources) {
+			pending.push_back(CompileAsync(source));
+		}
+
+		std::vector<std::string> spirvFiles;
+		for (auto & result : pending) {
+			spirvFiles.push_back(result.get());
+		}
+		return spirvFiles;
+	}
+
+	/// <summary>
+	/// Every file the source pulled in through #include the last time it was compiled, the source included.
+	/// </summary>
+	std::vector<std::string> GetDependencies(const std::string & filename) {
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		auto dependencies = sourceDependencies.find(filename);
+		if (dependencies == sourceDependencies.end()) return { filename };
+		return dependencies->second;
+	}
+
+	static bool IsSpirv(const std::string & filename) {
+		return filename.size() > 4 && filename.compare(filename.size() - 4, 4, ".spv") == 0;
+	}
+
+private:
+	/// <summary>
+	/// Hands shaderc the files hashSource found, resolved the same way so the key covers exactly what gets compiled.
+	/// </summary>
+	class Includer : public shaderc::CompileOptions::IncluderInterface {
+	public:
+		explicit Includer(const ShaderCompiler & compiler) : compiler(compiler) {
+
+		}
+
+		shaderc_include_result * GetInclude(const char * requestedSource, shaderc_include_type type, const char * requestingSource, size_t /*includeDepth*/) override {
+			auto include = new IncludeData();
+			include->name = compiler.resolveInclude(requestedSource, requestingSource, type == shaderc_include_type_relative);
+			if (include->name.empty()) {
+				// An empty name tells shaderc the include failed, the content becomes the error message.
+				include->contents = std::string("Cannot find ") + requestedSource;
+			}
+			else {
+				include->contents = readText(include->name);
+			}
+
+			include->result.source_name = include->name.c_str();
+			include->result.source_name_length = include->name.size();
+			include->result.content = include->contents.c_str();
+			include->result.content_length = include->contents.size();
+			include->result.user_data = include;
+			return &include->result;
+		}
+
+		void ReleaseInclude(shaderc_include_result * data) override {
+			delete static_cast<IncludeData*>(data->user_data);
+		}
+
+	private:
+		struct IncludeData
+		{
+			std::string name;
+			std::string contents;
+			shaderc_include_result result;
+		};
+
+		const ShaderCompiler & compiler;
+	};
+
+	std::string compile(const ShaderSource & source) {
+		std::vector<std::string> dependencies;
+		uint64_t key = hashSource(source, &dependencies);
+		std::string spirvFile = cacheDirectory + "/" + hashToHex(key) + ".spv";
+
+		std::shared_ptr<std::promise<void>> compilation;
+		std::shared_future<void> inFlight;
+		{
+			std::lock_guard<std::mutex> lock(cacheMutex);
+			sourceDependencies[source.filename] = dependencies;
+
+			auto existing = compilations.find(key);
+			if (existing != compilations.end()) {
+				inFlight = existing->second;
+			}
+			else {
+				compilation = std::make_shared<std::promise<void>>();
+				compilations[key] = compilation->get_future().share();
+			}
+		}
+
+		if (!compilation) {
+			inFlight.get();
+			return spirvFile;
+		}
+
+		// Once the entry is on disk, or has failed, later requests are answered by the cache or try again, the
+		// in-flight record is only there for callers racing this one.
+		try {
+			if (!fileExists(spirvFile)) {
+				runCompiler(source, spirvFile);
+			}
+			finish(key);
+			compilation->set_value();
+		}
+		catch (...) {
+			finish(key);
+			compilation->set_exception(std::current_exception());
+			throw;
+		}
+
+		return spirvFile;
+	}
+
+	void finish(uint64_t key) {
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		compilations.erase(key);
+	}
+
+	void runCompiler(const ShaderSource & source, const std::string & spirvFile) {
+		shaderc::CompileOptions options;
+		for (auto & define : source.defines) {
+			auto equals = define.find('=');
+			if (equals == std::string::npos) {
+				options.AddMacroDefinition(define);
+			}
+			else {
+				options.AddMacroDefinition(define.substr(0, equals), define.substr(equals + 1));
+			}
+		}
+		options.SetIncluder(std::unique_ptr<shaderc::CompileOptions::IncluderInterface>(new Includer(*this)));
+
+		auto text = readText(source.filename);
+		auto result = compiler.CompileGlslToSpv(text.c_str(), text.size(), shaderKind(source.filename), source.filename.c_str(), options);
+		if (result.GetCompilationStatus() != shaderc_compilation_status_success) {
+			throw std::runtime_error("Failed to compile " + source.filename + ":\n" + result.GetErrorMessage());
+		}
+
+		// Write next to the cache entry and move it in afterwards, a crash mid write must not leave a truncated entry behind.
+		std::ostringstream temporaryName;
+		temporaryName << spirvFile << "." << std::this_thread::get_id() << ".tmp";
+		std::string temporaryFile = temporaryName.str();
+		{
+			std::ofstream output(temporaryFile, std::ios::binary | std::ios::trunc);
+			std::vector<uint32_t> words(result.cbegin(), result.cend());
+			output.write(reinterpret_cast<const char*>(words.data()), words.size() * sizeof(uint32_t));
+			if (!output) {
+				output.close();
+				std::remove(temporaryFile.c_str());
+				throw std::runtime_error("Failed to write " + temporaryFile);
+			}
+		}
+
+		if (std::rename(temporaryFile.c_str(), spirvFile.c_str()) != 0) {
+			// Another process filled the same entry first, the contents are identical.
+			std::remove(temporaryFile.c_str());
+			if (!fileExists(spirvFile)) {
+				throw std::runtime_error("Failed to store " + spirvFile + " in the shader cache");
+			}
+		}
+	}
+
+	uint64_t hashSource(const ShaderSource & source, std::vector<std::string> * dependencies) {
+		uint64_t hash = compilerVersion;
+
+		auto defines = source.defines;
+		std::sort(defines.begin(), defines.end());
+		for (auto & define : defines) {
+			hash = hashString(define, hash);
+		}
+
+		// The stage comes from the extension, so the name is part of the key as well as the contents.
+		hash = hashString(extension(source.filename), hash);
+
+		std::set<std::string> visited;
+		return hashFile(source.filename, hash, &visited, dependencies);
+	}
+
+	uint64_t hashFile(const std::string & filename, uint64_t hash, std::set<std::string> * visited, std::vector<std::string> * dependencies) {
+		if (!visited->insert(filename).second) return hash;
+		dependencies->push_back(filename);
+
+		std::string text = readText(filename);
+		hash = hashString(text, hash);
+
+		std::istringstream lines(text);
+		std::string line;
+		bool relative;
+		while (std::getline(lines, line)) {
+			auto includeName = parseInclude(line, &relative);
+			if (includeName.empty()) continue;
+
+			auto includeFile = resolveInclude(includeName, filename, relative);
+			if (includeFile.empty()) {
+				throw std::runtime_error(filename + " includes " + includeName + ", which is in none of the include directories");
+			}
+			hash = hashFile(includeFile, hash, visited, dependencies);
+		}
+
+		return hash;
+	}
+
+	std::string resolveInclude(const std::string & includeName, const std::string & includingFile, bool relative) const {
+		if (relative && fileExists(directory(includingFile) + includeName)) {
+			return directory(includingFile) + includeName;
+		}
+		for (auto & includeDirectory : includeDirectories) {
+			auto candidate = includeDirectory + "/" + includeName;
+			if (fileExists(candidate)) return candidate;
+		}
+		return "";
+	}
+
+	uint64_t hashCompilerBuild() {
+		// The SPIR-V of a fixed shader carries the generator's version in its header and changes with the code the
+		// compiler emits, one in-process compile at startup is cheaper than finding out any other way.
+		static const char * probe = "#version 450\nlayout(location = 0) out vec4 color;\nvoid main() { color = vec4(1.0); }\n";
+		auto result = compiler.CompileGlslToSpv(probe, strlen(probe), shaderc_glsl_fragment_shader, "probe.frag", shaderc::CompileOptions());
+		if (result.GetCompilationStatus() != shaderc_compilation_status_success) {
+			throw std::runtime_error("The shader compiler failed on its probe shader: " + result.GetErrorMessage());
+		}
+
+		unsigned int spirvVersion = 0, spirvRevision = 0;
+		shaderc_get_spv_version(&spirvVersion, &spirvRevision);
+		uint64_t hash = hashValue(static_cast<uint64_t>(spirvVersion) << 32 | spirvRevision);
+		for (auto word = result.cbegin(); word != result.cend(); ++word) {
+			hash = hashValue(static_cast<uint64_t>(*word), hash);
+		}
+		return hash;
+	}
+
+	static std::string readText(const std::string & filename) {
+		std::ifstream file(filename, std::ios::binary);
+		if (!file.is_open()) {
+			throw std::runtime_error("Failed to open shader source " + filename);
+		}
+
+		std::stringstream contents;
+		contents << file.rdbuf();
+		return contents.str();
+	}
+
+	static std::string parseInclude(const std::string & line, bool * relative) {
+		auto start = line.find_first_not_of(" \t");
+		if (start == std::string::npos || line.compare(start, 8, "#include") != 0) return "";
+
+		auto open = line.find_first_of("\"<", start + 8);
+		if (open == std::string::npos) return "";
+		*relative = line[open] == '"';
+		auto close = line.find(*relative ? '"' : '>', open + 1);
+		if (close == std::string::npos) return "";
+
+		return line.substr(open + 1, close - open - 1);
+	}
+
+	static shaderc_shader_kind shaderKind(const std::string & filename) {
+		auto stage = extension(filename);
+		if (stage == ".vert") return shaderc_glsl_vertex_shader;
+		if (stage == ".frag") return shaderc_glsl_fragment_shader;
+		if (stage == ".comp") return shaderc_glsl_compute_shader;
+		if (stage == ".geom") return shaderc_glsl_geometry_shader;
+		if (stage == ".tesc") return shaderc_glsl_tess_control_shader;
+		if (stage == ".tese") return shaderc_glsl_tess_evaluation_shader;
+		throw std::runtime_error("No shader stage for the extension of " + filename);
+	}
+
+	static std::string directory(const std::string & filename) {
+		auto separator = filename.find_last_of("/\\");
+		return separator == std::string::npos ? "" : filename.substr(0, separator + 1);
+	}
+
+	static std::string extension(const std::string & filename) {
+		auto dot = filename.find_last_of('.');
+		return dot == std::string::npos ? "" : filename.substr(dot);
+	}
+
+	static bool fileExists(const std::string & filename) {
+		struct stat fileStats;
+		return stat(filename.c_str(), &fileStats) == 0;
+	}
+
+	static void makeDirectory(const std::string & path) {
+		std::string partial;
+		for (size_t i = 0; i <= path.size(); i++) {
+			if (i == path.size() || path[i] == '/' || path[i] == '\\') {
+				if (!partial.empty() && !fileExists(partial)) {
+#ifdef _WIN32
+					_mkdir(partial.c_str());
+#else
+					mkdir(partial.c_str(), 0755);
+#endif
+				}
+			}
+			if (i < path.size()) partial += path[i];
+		}
+	}
+
+	WorkerPool & workers;
+	std::string cacheDirectory;
+	std::vector<std::string> includeDirectories;
+	// Compiling is thread safe, every worker shares the one instance.
+	shaderc::Compiler compiler;
+	uint64_t compilerVersion;
+
+	std::mutex cacheMutex;
+	std::map<uint64_t, std::shared_future<void>> compilations;
+	std::map<std::string, std::vector<std::string>> sourceDependencies;
+};
@@ -0,0 +1,561 @@
+#pragma once
+#include <vulkan\vulkan.h>
+#include <vector>
+#include <map>
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+
+#include <Builders\GraphicsPipelineBuilder.h>
+
+struct ReflectedBinding
+{
+	uint32_t set;
+	uint32_t binding;
+	VkDescriptorType type;
+	// 0 for runtime sized arrays, the pipeline decides how many descriptors they get.
+	uint32_t count;
+	std::string name;
+};
+
+struct ReflectedVertexAttribute
+{
+	uint32_t location;
+	VkFormat format;
+	uint32_t size;
+	std::string name;
+};
+
+/// <summary>
+/// Vertex input state derived from a vertex shader, owns the arrays the create info points at.
+/// </summary>
+struct ReflectedVertexInput
+{
+	std::vector<VkVertexInputBindingDescription> bindings;
+	std::vector<VkVertexInputAttributeDescription> attributes;
+
+	VkPipelineVertexInputStateCreateInfo Build() const {
+		return VertexInputBuilder()
+			.WithBindings(bindings.data(), static_cast<unsigned int>(bindings.size()))
+			->WithAttributes(attributes.data(), static_cast<unsigned int>(attributes.size()))
+			->Build();
+	}
+};
+
+/// <summary>
+/// Reads the resource interface of a single SPIR-V module: descriptor bindings, push constant block size and vertex inputs.
+/// Only the declarations are walked, function bodies are skipped. Array sizes given by specialization constants are
+/// reflected at the constants' default values.
+/// </summary>
+class ShaderReflection
+{
+public:
+	ShaderReflection(const uint32_t * words, size_t wordCount, VkShaderStageFlagBits stage) : stage(stage) {
+		if (wordCount < 5 || words[0] != spirvMagic) {
+			throw std::runtime_error("Not a SPIR-V module");
+		}
+
+		parse(words, wordCount);
+		reflect();
+	}
+
+	VkShaderStageFlagBits stage;
+	std::vector<ReflectedBinding> bindings;
+	std::vector<ReflectedVertexAttribute> inputs;
+	uint32_t pushConstantSize = 0;
+
+private:
+	static const uint32_t spirvMagic = 0x07230203;
+
+	enum Op : uint32_t {
+		OpName = 5,
+		OpTypeVoid = 19,
+		OpTypeInt = 21,
+		OpTypeFloat = 22,
+		OpTypeVector = 23,
+		OpTypeMatrix = 24,
+		OpTypeImage = 25,
+		OpTypeSampler = 26,
+		OpTypeSampledImage = 27,
+		OpTypeArray = 28,
+		OpTypeRuntimeArray = 29,
+		OpTypeStruct = 30,
+		OpTypePointer = 32,
+		OpTypeFunction = 33,
+		OpConstant = 43,
+		OpSpecConstantTrue = 48,
+		OpSpecConstantFalse = 49,
+		OpSpecConstant = 50,
+		OpSpecConstantOp = 52,
+		OpFunction = 54,
+		OpVariable = 59,
+		OpDecorate = 71,
+		OpMemberDecorate = 72,
+		OpIAdd = 128,
+		OpISub = 130,
+		OpIMul = 132,
+		OpUDiv = 134,
+		OpSDiv = 135
+	};
+
+	enum Decoration : uint32_t {
+		DecorationBlock = 2,
+		DecorationBufferBlock = 3,
+		DecorationArrayStride = 6,
+		DecorationMatrixStride = 7,
+		DecorationBuiltIn = 11,
+		DecorationLocation = 30,
+		DecorationBinding = 33,
+		DecorationDescriptorSet = 34,
+		DecorationOffset = 35
+	};
+
+	enum StorageClass : uint32_t {
+		StorageUniformConstant = 0,
+		StorageInput = 1,
+		StorageUniform = 2,
+		StoragePushConstant = 9,
+		StorageBuffer = 12
+	};
+
+	static const uint32_t DimBuffer = 5;
+	static const uint32_t DimSubpassData = 6;
+
+	struct Decorations {
+		uint32_t set = 0;
+		uint32_t binding = 0;
+		uint32_t location = 0;
+		uint32_t arrayStride = 0;
+		bool hasBinding = false;
+		bool hasLocation = false;
+		bool builtIn = false;
+		bool block = false;
+		bool bufferBlock = false;
+	};
+
+	struct MemberDecorations {
+		uint32_t offset = 0;
+		uint32_t matrixStride = 0;
+	};
+
+	struct Variable {
+		uint32_t id;
+		uint32_t pointerType;
+		uint32_t storageClass;
+	};
+
+	void parse(const uint32_t * words, size_t wordCount) {
+		size_t offset = 5;
+		while (offset < wordCount) {
+			uint32_t instructionWords = words[offset] >> 16;
+			uint32_t opcode = words[offset] & 0xffff;
+			if (instructionWords == 0 || offset + instructionWords > wordCount) {
+				throw std::runtime_error("Malformed SPIR-V instruction");
+			}
+
+			const uint32_t * operands = words + offset + 1;
+			uint32_t operandCount = instructionWords - 1;
+
+			switch (opcode) {
+			case OpName:
+				names[operands[0]] = readString(operands + 1, operandCount - 1);
+				break;
+			case OpDecorate:
+				decorate(decorations[operands[0]], operands[1], operandCount > 2 ? operands[2] : 0);
+				break;
+			case OpMemberDecorate:
+				if (operands[2] == DecorationOffset) memberDecorations[operands[0]][operands[1]].offset = operands[3];
+				if (operands[2] == DecorationMatrixStride) memberDecorations[operands[0]][operands[1]].matrixStride = operands[3];
+				break;
+			case OpConstant:
+			case OpSpecConstant:
+				// Wider constants continue in a second word, the low word is all an array size can use.
+				constants[operands[1]] = operands[2];
+				break;
+			case OpSpecConstantTrue:
+			case OpSpecConstantFalse:
+				constants[operands[1]] = opcode == OpSpecConstantTrue ? 1 : 0;
+				break;
+			case OpSpecConstantOp:
+				specConstantOp(operands, operandCount);
+				break;
+			case OpVariable:
+				variables.push_back({ operands[1], operands[0], operands[2] });
+				break;
+			case OpFunction:
+				// Everything declared at module scope comes before the first function.
+				return;
+			default:
+				if (opcode >= OpTypeVoid && opcode <= OpTypeFunction) {
+					std::vector<uint32_t> declaration(1, opcode);
+					declaration.insert(declaration.end(), operands, operands + operandCount);
+					types[operands[0]] = declaration;
+				}
+				break;
+			}
+
+			offset += instructionWords;
+		}
+	}
+
+	// Sizes written as expressions of other constants, such as N * 2, are folded from the defaults. Anything else stays
+	// unknown and is rejected if an array size turns out to depend on it.
+	void specConstantOp(const uint32_t * operands, uint32_t operandCount) {
+		if (operandCount != 5) return;
+		auto a = constants.find(operands[3]), b = constants.find(operands[4]);
+		if (a == constants.end() || b == constants.end()) return;
+
+		uint32_t value;
+		switch (operands[2]) {
+		case OpIAdd: value = a->second + b->second; break;
+		case OpISub: value = a->second - b->second; break;
+		case OpIMul: value = a->second * b->second; break;
+		case OpUDiv:
+		case OpSDiv:
+			if (b->second == 0) return;
+			value = operands[2] == OpUDiv ? a->second / b->second
+				: static_cast<uint32_t>(static_cast<int32_t>(a->second) / static_cast<int32_t>(b->second));
+			break;
+		default: return;
+		}
+		constants[operands[1]] = value;
+	}
+
+	uint32_t arrayLength(uint32_t lengthId) {
+		auto length = constants.find(lengthId);
+		if (length == constants.end()) {
+			throw std::runtime_error("Array length is a specialization constant expression reflection can't evaluate");
+		}
+		return length->second;
+	}
+
+	static void decorate(Decorations & target, uint32_t decoration, uint32_t value) {
+		switch (decoration) {
+		case DecorationBlock: target.block = true; break;
+		case DecorationBufferBlock: target.bufferBlock = true; break;
+		case DecorationArrayStride: target.arrayStride = value; break;
+		case DecorationBuiltIn: target.builtIn = true; break;
+		case DecorationLocation: target.location = value; target.hasLocation = true; break;
+		case DecorationBinding: target.binding = value; target.hasBinding = true; break;
+		case DecorationDescriptorSet: target.set = value; break;
+		default: break;
+		}
+	}
+
+	static std::string readString(const uint32_t * words, uint32_t wordCount) {
+		auto characters = reinterpret_cast<const char*>(words);
+		size_t maxLength = wordCount * sizeof(uint32_t);
+		size_t length = 0;
+		while (length < maxLength && characters[length] != '\0') length++;
+		return std::string(characters, length);
+	}
+
+	void reflect() {
+		for (auto & variable : variables) {
+			auto & pointer = type(variable.pointerType);
+			uint32_t pointee = pointer[3];
+			auto & variableDecorations = decorations[variable.id];
+
+			switch (variable.storageClass) {
+			case StorageUniformConstant:
+			case StorageUniform:
+			case StorageBuffer:
+				if (variableDecorations.hasBinding) {
+					reflectBinding(variable, pointee, variableDecorations);
+				}
+				break;
+			case StoragePushConstant:
+				pushConstantSize = std::max(pushConstantSize, sizeOf(pointee));
+				break;
+			case StorageInput:
+				if (stage == VK_SHADER_STAGE_VERTEX_BIT && variableDecorations.hasLocation && !variableDecorations.builtIn) {
+					reflectInput(variable, pointee, variableDecorations.location);
+				}
+				break;
+			default:
+				break;
+			}
+		}
+
+		std::sort(bindings.begin(), bindings.end(), [](const ReflectedBinding & a, const ReflectedBinding & b) {
+			return a.set != b.set ? a.set < b.set : a.binding < b.binding;
+		});
+		std::sort(inputs.begin(), inputs.end(), [](const ReflectedVertexAttribute & a, const ReflectedVertexAttribute & b) {
+			return a.location < b.location;
+		});
+	}
+
+	void reflectBinding(const Variable & variable, uint32_t typeId, const Decorations & variableDecorations) {
+		uint32_t count = 1;
+		auto * resource = &type(typeId);
+		if ((*resource)[0] == OpTypeArray) {
+			count = arrayLength((*resource)[3]);
+			resource = &type((*resource)[2]);
+		}
+		else if ((*resource)[0] == OpTypeRuntimeArray) {
+			count = 0;
+			resource = &type((*resource)[2]);
+		}
+
+		ReflectedBinding binding = {};
+		binding.set = variableDecorations.set;
+		binding.binding = variableDecorations.binding;
+		binding.count = count;
+		binding.name = names[variable.id];
+		binding.type = descriptorType(*resource, variable.storageClass);
+		bindings.push_back(binding);
+	}
+
+	VkDescriptorType descriptorType(const std::vector<uint32_t> & resource, uint32_t storageClass) {
+		switch (resource[0]) {
+		case OpTypeSampler:
+			return VK_DESCRIPTOR_TYPE_SAMPLER;
+		case OpTypeSampledImage:
+			return VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		case OpTypeImage: {
+			uint32_t dimension = resource[3];
+			bool storage = resource[7] == 2;
+			if (dimension == DimBuffer) return storage ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+			if (dimension == DimSubpassData) return VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+			return storage ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+		}
+		case OpTypeStruct:
+			if (storageClass == StorageBuffer || decorations[resource[1]].bufferBlock) return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			return VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		default:
+			throw std::runtime_error("Unsupported descriptor type in SPIR-V module");
+		}
+	}
+
+	void reflectInput(const Variable & variable, uint32_t typeId, uint32_t location) {
+		auto & input = type(typeId);
+
+		// Matrices take one location per column.
+		uint32_t columns = 1;
+		uint32_t columnType = typeId;
+		if (input[0] == OpTypeMatrix) {
+			columnType = input[2];
+			columns = input[3];
+		}
+
+		for (uint32_t column = 0; column < columns; column++) {
+			ReflectedVertexAttribute attribute = {};
+			attribute.location = location + column;
+			attribute.format = vertexFormat(columnType, names[variable.id]);
+			attribute.size = sizeOf(columnType);
+			attribute.name = names[variable.id];
+			inputs.push_back(attribute);
+		}
+	}
+
+	VkFormat vertexFormat(uint32_t typeId, const std::string & name) {
+		auto & input = type(typeId);
+		uint32_t components = 1;
+		auto * scalar = &input;
+		if (input[0] == OpTypeVector) {
+			components = input[3];
+			scalar = &type(input[2]);
+		}
+
+		// Rows by width 8, 16, 32 and 64, columns by component count. 8 bit floats don't exist, and 64 bit vectors of
+		// three or four components take two locations each, which the attribute layout can't describe.
+		static const VkFormat floatFormats[4][4] = {
+			{ VK_FORMAT_UNDEFINED, VK_FORMAT_UNDEFINED, VK_FORMAT_UNDEFINED, VK_FORMAT_UNDEFINED },
+			{ VK_FORMAT_R16_SFLOAT, VK_FORMAT_R16G16_SFLOAT, VK_FORMAT_R16G16B16_SFLOAT, VK_FORMAT_R16G16B16A16_SFLOAT },
+			{ VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT },
+			{ VK_FORMAT_R64_SFLOAT, VK_FORMAT_R64G64_SFLOAT, VK_FORMAT_UNDEFINED, VK_FORMAT_UNDEFINED } };
+		static const VkFormat intFormats[4][4] = {
+			{ VK_FORMAT_R8_SINT, VK_FORMAT_R8G8_SINT, VK_FORMAT_R8G8B8_SINT, VK_FORMAT_R8G8B8A8_SINT },
+			{ VK_FORMAT_R16_SINT, VK_FORMAT_R16G16_SINT, VK_FORMAT_R16G16B16_SINT, VK_FORMAT_R16G16B16A16_SINT },
+			{ VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT },
+			{ VK_FORMAT_R64_SINT, VK_FORMAT_R64G64_SINT, VK_FORMAT_UNDEFINED, VK_FORMAT_UNDEFINED } };
+		static const VkFormat uintFormats[4][4] = {
+			{ VK_FORMAT_R8_UINT, VK_FORMAT_R8G8_UINT, VK_FORMAT_R8G8B8_UINT, VK_FORMAT_R8G8B8A8_UINT },
+			{ VK_FORMAT_R16_UINT, VK_FORMAT_R16G16_UINT, VK_FORMAT_R16G16B16_UINT, VK_FORMAT_R16G16B16A16_UINT },
+			{ VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT },
+			{ VK_FORMAT_R64_UINT, VK_FORMAT_R64G64_UINT, VK_FORMAT_UNDEFINED, VK_FORMAT_UNDEFINED } };
+
+		uint32_t width = (*scalar)[2];
+		int row = width == 8 ? 0 : width == 16 ? 1 : width == 32 ? 2 : width == 64 ? 3 : -1;
+		VkFormat format = VK_FORMAT_UNDEFINED;
+		if (row >= 0 && components >= 1 && components <= 4) {
+			if ((*scalar)[0] == OpTypeFloat) format = floatFormats[row][components - 1];
+			else format = (*scalar)[3] ? intFormats[row][components - 1] : uintFormats[row][components - 1];
+		}
+
+		if (format == VK_FORMAT_UNDEFINED) {
+			throw std::runtime_error("Unsupported vertex input " + name + ": " + std::to_string(components) + " component " + std::to_string(width) +
+				" bit " + ((*scalar)[0] == OpTypeFloat ? "float" : "integer"));
+		}
+		return format;
+	}
+
+	uint32_t sizeOf(uint32_t typeId, uint32_t matrixStride = 0) {
+		auto & declaration = type(typeId);
+		switch (declaration[0]) {
+		case OpTypeInt:
+		case OpTypeFloat:
+			return declaration[2] / 8;
+		case OpTypeVector:
+			return declaration[3] * sizeOf(declaration[2]);
+		case OpTypeMatrix:
+			return declaration[3] * (matrixStride ? matrixStride : sizeOf(declaration[2]));
+		case OpTypeArray: {
+			uint32_t stride = decorations[typeId].arrayStride;
+			return arrayLength(declaration[3]) * (stride ? stride : sizeOf(declaration[2]));
+		}
+		case OpTypeStruct: {
+			uint32_t size = 0;
+			auto & members = memberDecorations[typeId];
+			for (uint32_t member = 0; member + 2 < declaration.size(); member++) {
+				auto & memberDecoration = members[member];
+				size = std::max(size, memberDecoration.offset + sizeOf(declaration[member + 2], memberDecoration.matrixStride));
+			}
+			return size;
+		}
+		default:
+			// Runtime arrays and opaque types have no static size.
+			return 0;
+		}
+	}
+
+	const std::vector<uint32_t> & type(uint32_t id) {
+		auto declaration = types.find(id);
+		if (declaration == types.end()) {
+			throw std::runtime_error("SPIR-V module references an unknown type");
+		}
+		return declaration->second;
+	}
+
+	// Type declarations keep their opcode in front of the operands: { opcode, resultId, ... }.
+	std::map<uint32_t, std::vector<uint32_t>> types;
+	std::map<uint32_t, uint32_t> constants;
+	std::map<uint32_t, std::string> names;
+	std::map<uint32_t, Decorations> decorations;
+	std::map<uint32_t, std::map<uint32_t, MemberDecorations>> memberDecorations;
+	std::vector<Variable> variables;
+};
+
+/// <summary>
+/// Combines the reflection of every stage in a pipeline into the layouts Vulkan needs.
+/// </summary>
+class PipelineReflection
+{
+public:
+	void Add(const ShaderReflection & stage) {
+		for (auto & binding : stage.bindings) {
+			if (binding.set >= sets.size()) sets.resize(binding.set + 1);
+			auto & setBindings = sets[binding.set];
+
+			auto existing = std::find_if(setBindings.begin(), setBindings.end(), [&binding](const VkDescriptorSetLayoutBinding & layoutBinding) {
+				return layoutBinding.binding == binding.binding;
+			});
+
+			if (existing != setBindings.end()) {
+				if (existing->descriptorType != binding.type) {
+					throw std::runtime_error("Shader stages disagree on the type of descriptor " + binding.name);
+				}
+				existing->stageFlags |= stage.stage;
+				continue;
+			}
+
+			VkDescriptorSetLayoutBinding layoutBinding = {};
+			layoutBinding.binding = binding.binding;
+			layoutBinding.descriptorType = binding.type;
+			layoutBinding.descriptorCount = binding.count;
+			layoutBinding.stageFlags = stage.stage;
+			layoutBinding.pImmutableSamplers = nullptr;
+			setBindings.push_back(layoutBinding);
+		}
+
+		if (stage.pushConstantSize > 0) {
+			pushConstantSize = std::max(pushConstantSize, stage.pushConstantSize);
+			pushConstantStages |= stage.stage;
+		}
+
+		if (stage.stage == VK_SHADER_STAGE_VERTEX_BIT) {
+			vertexInputs = stage.inputs;
+		}
+	}
+
+	/// <summary>
+	/// Bindings for every set index up to the highest one used, unused sets come back empty.
+	/// </summary>
+	const std::vector<std::vector<VkDescriptorSetLayoutBinding>> & SetLayoutBindings() const {
+		return sets;
+	}
+
+	/// <summary>
+	/// SPIR-V can't say whether a buffer is bound with dynamic offsets, the pipeline that does so marks the binding here.
+	/// </summary>
+	void MakeDynamic(uint32_t set, uint32_t binding) {
+		auto layoutBinding = find(set, binding);
+		if (layoutBinding->descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER) {
+			layoutBinding->descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		}
+		else if (layoutBinding->descriptorType == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER) {
+			layoutBinding->descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+		}
+		else if (layoutBinding->descriptorType != VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC &&
+			layoutBinding->descriptorType != VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC) {
+			throw std::runtime_error("Only uniform and storage buffers can use dynamic offsets");
+		}
+	}
+
+	std::vector<VkPushConstantRange> PushConstantRanges() const {
+		if (pushConstantSize == 0) return {};
+
+		VkPushConstantRange range = {};
+		range.stageFlags = pushConstantStages;
+		range.offset = 0;
+		range.size = pushConstantSize;
+		return { range };
+	}
+
+	/// <summary>
+	/// Packs every vertex input into one interleaved binding in location order. Pass stride when the
+	/// vertex struct is padded beyond the attributes the shader reads.
+	/// </summary>
+	ReflectedVertexInput VertexInput(uint32_t binding = 0, uint32_t stride = 0) const {
+		ReflectedVertexInput vertexInput;
+		uint32_t offset = 0;
+		for (auto & input : vertexInputs) {
+			VkVertexInputAttributeDescription attribute = {};
+			attribute.binding = binding;
+			attribute.location = input.location;
+			attribute.format = input.format;
+			attribute.offset = offset;
+			vertexInput.attributes.push_back(attribute);
+			offset += input.size;
+		}
+
+		if (!vertexInputs.empty()) {
+			VkVertexInputBindingDescription bindingDescription = {};
+			bindingDescription.binding = binding;
+			bindingDescription.stride = stride ? stride : offset;
+			bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+			vertexInput.bindings.push_back(bindingDescription);
+		}
+
+		return vertexInput;
+	}
+
+	const std::vector<ReflectedVertexAttribute> & VertexInputs() const {
+		return vertexInputs;
+	}
+
+private:
+	VkDescriptorSetLayoutBinding * find(uint32_t set, uint32_t binding) {
+		if (set < sets.size()) {
+			for (auto & layoutBinding : sets[set]) {
+				if (layoutBinding.binding == binding) return &layoutBinding;
+			}
+		}
+		throw std::runtime_error("No reflected descriptor at set " + std::to_string(set) + " binding " + std::to_string(binding));
+	}
+
+	std::vector<std::vector<VkDescriptorSetLayoutBinding>> sets;
+	std::vector<ReflectedVertexAttribute> vertexInputs;
+	uint32_t pushConstantSize = 0;
+	VkShaderStageFlags pushConstantStages = 0;
+};
@@ -0,0 +1,173 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <sys/inotify.h>
+#include <poll.h>
+#include <dirent.h>
+#include <unistd.h>
+#endif
+
+/// <summary>
+/// Watches a directory tree on a background thread and collects the files written inside it.
+/// Uses inotify on Linux and ReadDirectoryChangesW on Windows, so nothing is polled on the render thread.
+/// </summary>
+class ShaderWatcher {
+public:
+	ShaderWatcher(const std::string & directory) : root(Normalize(directory)) {
+		while (!root.empty() && root.back() == '/') root.pop_back();
+		watchThread = std::thread([this]() { watchLoop(); });
+	}
+
+	~ShaderWatcher() {
+		stopping = true;
+		watchThread.join();
+	}
+
+	ShaderWatcher(const ShaderWatcher &) = delete;
+	ShaderWatcher & operator=(const ShaderWatcher &) = delete;
+
+	/// <summary>
+	/// Files changed since the last call, each reported once no matter how many writes it saw.
+	/// </summary>
+	std::vector<std::string> PollChanges() {
+		std::lock_guard<std::mutex> lock(changesMutex);
+		std::vector<std::string> changes(changedFiles.begin(), changedFiles.end());
+		changedFiles.clear();
+		return changes;
+	}
+
+	static std::string Normalize(std::string path) {
+		std::replace(path.begin(), path.end(), '\\', '/');
+		return path;
+	}
+
+private:
+	void record(const std::string & path) {
+		std::lock_guard<std::mutex> lock(changesMutex);
+		changedFiles.insert(Normalize(path));
+	}
+
+#ifdef _WIN32
+	void watchLoop() {
+		HANDLE directory = CreateFileA(root.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+			nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+		if (directory == INVALID_HANDLE_VALUE) return;
+
+		OVERLAPPED overlapped = {};
+		overlapped.hEvent = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+		DWORD buffer[4096];
+		bool reading = false;
+
+		while (!stopping) {
+			if (!reading) {
+				ResetEvent(overlapped.hEvent);
+				if (!ReadDirectoryChangesW(directory, buffer, sizeof(buffer), TRUE,
+					FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME, nullptr, &overlapped, nullptr)) {
+					break;
+				}
+				reading = true;
+			}
+
+			if (WaitForSingleObject(overlapped.hEvent, 100) != WAIT_OBJECT_0) continue;
+			reading = false;
+
+			DWORD bytes = 0;
+			if (!GetOverlappedResult(directory, &overlapped, &bytes, FALSE) || bytes == 0) continue;
+
+			auto info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(buffer);
+			while (true) {
+				record(root + "/" + narrow(info->FileName, info->FileNameLength / sizeof(WCHAR)));
+				if (info->NextEntryOffset == 0) break;
+				info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(reinterpret_cast<const char*>(info) + info->NextEntryOffset);
+			}
+		}
+
+		if (reading) {
+			DWORD bytes = 0;
+			CancelIo(directory);
+			GetOverlappedResult(directory, &overlapped, &bytes, TRUE);
+		}
+		CloseHandle(overlapped.hEvent);
+		CloseHandle(directory);
+	}
+
+	static std::string narrow(const WCHAR * name, int length) {
+		int size = WideCharToMultiByte(CP_UTF8, 0, name, length, nullptr, 0, nullptr, nullptr);
+		std::string result(size, '\0');
+		WideCharToMultiByte(CP_UTF8, 0, name, length, &result[0], size, nullptr, nullptr);
+		return result;
+	}
+#else
+	void watchLoop() {
+		int inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (inotify < 0) return;
+
+		std::map<int, std::string> watchedDirectories;
+		addWatches(inotify, root, &watchedDirectories);
+
+		alignas(inotify_event) char buffer[4096];
+		while (!stopping) {
+			pollfd descriptor = { inotify, POLLIN, 0 };
+			if (poll(&descriptor, 1, 100) <= 0) continue;
+
+			ssize_t length = read(inotify, buffer, sizeof(buffer));
+			for (ssize_t offset = 0; offset < length;) {
+				auto event = reinterpret_cast<const inotify_event*>(buffer + offset);
+				offset += sizeof(inotify_event) + event->len;
+
+				auto directory = watchedDirectories.find(event->wd);
+				if (event->len == 0 || directory == watchedDirectories.end()) continue;
+
+				std::string path = directory->second + "/" + event->name;
+				if (event->mask & IN_ISDIR) {
+					addWatches(inotify, path, &watchedDirectories);
+				}
+				else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+					record(path);
+				}
+			}
+		}
+
+		close(inotify);
+	}
+
+	static void addWatches(int inotify, const std::string & directory, std::map<int, std::string> * watchedDirectories) {
+		// Editors often save by writing a temporary file and renaming it over the original, so renames count as writes.
+		int watch = inotify_add_watch(inotify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+		if (watch < 0) return;
+		(*watchedDirectories)[watch] = directory;
+
+		DIR * entries = opendir(directory.c_str());
+		if (!entries) return;
+		while (auto entry = readdir(entries)) {
+			std::string name = entry->d_name;
+			if (entry->d_type == DT_DIR && name != "." && name != "..") {
+				addWatches(inotify, directory + "/" + name, watchedDirectories);
+			}
+		}
+		closedir(entries);
+	}
+#endif
+
+	std::string root;
+	std::thread watchThread;
+	std::atomic<bool> stopping{ false };
+	std::mutex changesMutex;
+	std::set<std::string> changedFiles;
+};
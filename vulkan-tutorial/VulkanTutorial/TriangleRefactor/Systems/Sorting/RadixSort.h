@@ -0,0 +1,152 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <array>
+#include <utility>
+#include <type_traits>
+#include <algorithm>
+#include <functional>
+#include <cstring>
+#include <stdexcept>
+
+#include <Systems\Threading\WorkerPool.h>
+
+/// <summary>
+/// Maps a float to an unsigned key that sorts in the same order, negative values included.
+/// </summary>
+inline uint32_t SortableFloat(float value) {
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return (bits & 0x80000000u) ? ~bits : bits | 0x80000000u;
+}
+
+/// <summary>
+/// Least significant digit radix sort of unsigned keys carrying a 32 bit payload each, one byte per pass. It is stable,
+/// so keys that compare equal keep their submission order. The scratch arrays are kept between calls so sorting a
+/// frame's draws doesn't allocate once the queue has reached its usual size.
+///
+/// Given a worker pool, large inputs are split into one block per thread. Every block counts its own digits, the
+/// counts are turned into per block offsets, bucket by bucket and block by block, and the blocks then scatter in
+/// parallel without sharing a single write position, which keeps the sort stable.
+/// </summary>
+template <typename Key> class RadixSorter
+{
+	static_assert(std::is_unsigned<Key>::value, "Radix sort keys must be unsigned integers");
+
+public:
+	static const uint32_t DigitBits = 8;
+	static const uint32_t DigitCount = sizeof(Key);
+	static const uint32_t BucketCount = 1 << DigitBits;
+	// Below this splitting the work costs more than it saves.
+	static const size_t ParallelThreshold = 1 << 15;
+
+	/// <summary>
+	/// Sorts keys ascending and applies the same permutation to values, which must hold one value per key.
+	/// </summary>
+	void Sort(std::vector<Key> & keys, std::vector<uint32_t> & values, WorkerPool * workers = nullptr) {
+		if (values.size() != keys.size()) {
+			throw std::runtime_error("Radix sort needs one value per key");
+		}
+		size_t count = keys.size();
+		if (count < 2) return;
+
+		scratchKeys.resize(count);
+		scratchValues.resize(count);
+
+		size_t blockCount = workers && count >= ParallelThreshold ? workers->WorkerCount() + 1 : 1;
+		size_t blockSize = (count + blockCount - 1) / blockCount;
+		blockCount = (count + blockSize - 1) / blockSize;
+		histograms.resize(blockCount * DigitCount);
+
+		auto forEachBlock = [workers, blockCount](const std::function<void(size_t)> & body) {
+			if (blockCount == 1) {
+				body(0);
+				return;
+			}
+			workers->ParallelFor(blockCount, 1, [&body](size_t begin, size_t end) {
+				for (size_t block = begin; block < end; block++) body(block);
+			});
+		};
+
+		Key * sourceKeys = keys.data();
+		uint32_t * sourceValues = values.data();
+		Key * targetKeys = scratchKeys.data();
+		uint32_t * targetValues = scratchValues.data();
+
+		// One read of the keys builds the histograms of every digit.
+		forEachBlock([&](size_t block) {
+			auto blockHistograms = &histograms[block * DigitCount];
+			for (uint32_t digit = 0; digit < DigitCount; digit++) {
+				blockHistograms[digit].fill(0);
+			}
+			for (size_t i = block * blockSize, end = std::min(i + blockSize, count); i < end; i++) {
+				for (uint32_t digit = 0; digit < DigitCount; digit++) {
+					blockHistograms[digit][Digit(sourceKeys[i], digit)]++;
+				}
+			}
+		});
+
+		bool moved = false;
+		for (uint32_t digit = 0; digit < DigitCount; digit++) {
+			// Every key shares this byte, the pass would only copy.
+			auto firstBucket = Digit(sourceKeys[0], digit);
+			size_t inFirstBucket = 0;
+			for (size_t block = 0; block < blockCount; block++) {
+				inFirstBucket += histograms[block * DigitCount + digit][firstBucket];
+			}
+			if (inFirstBucket == count) continue;
+
+			// A pass leaves the set of keys alone, so one block's totals still hold, but several blocks now hold
+			// different keys than when they were counted.
+			if (moved && blockCount > 1) {
+				forEachBlock([&](size_t block) {
+					auto & histogram = histograms[block * DigitCount + digit];
+					histogram.fill(0);
+					for (size_t i = block * blockSize, end = std::min(i + blockSize, count); i < end; i++) {
+						histogram[Digit(sourceKeys[i], digit)]++;
+					}
+				});
+			}
+
+			size_t offset = 0;
+			for (uint32_t bucket = 0; bucket < BucketCount; bucket++) {
+				for (size_t block = 0; block < blockCount; block++) {
+					auto & slot = histograms[block * DigitCount + digit][bucket];
+					auto bucketSize = slot;
+					slot = offset;
+					offset += bucketSize;
+				}
+			}
+
+			forEachBlock([&](size_t block) {
+				auto & histogram = histograms[block * DigitCount + digit];
+				for (size_t i = block * blockSize, end = std::min(i + blockSize, count); i < end; i++) {
+					auto target = histogram[Digit(sourceKeys[i], digit)]++;
+					targetKeys[target] = sourceKeys[i];
+					targetValues[target] = sourceValues[i];
+				}
+			});
+
+			std::swap(sourceKeys, targetKeys);
+			std::swap(sourceValues, targetValues);
+			moved = true;
+		}
+
+		// An odd number of passes left the result in the scratch arrays.
+		if (sourceKeys != keys.data()) {
+			keys.swap(scratchKeys);
+			values.swap(scratchValues);
+		}
+	}
+
+	static uint32_t Digit(Key key, uint32_t digit) {
+		return static_cast<uint32_t>(key >> (digit * DigitBits)) & (BucketCount - 1);
+	}
+
+private:
+	std::vector<Key> scratchKeys;
+	std::vector<uint32_t> scratchValues;
+	// DigitCount histograms per block, block major.
+	std::vector<std::array<size_t, BucketCount>> histograms;
+};
@@ -0,0 +1,145 @@
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <queue>
+#include <vector>
+#include <functional>
+#include <future>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+
+/// <summary>
+/// Fixed set of worker threads pulling tasks from one shared queue.
+/// </summary>
+class WorkerPool {
+public:
+	WorkerPool(unsigned int workerCount = DefaultWorkerCount()) {
+		for (unsigned int i = 0; i < workerCount; i++) {
+			workers.emplace_back([this]() { workerLoop(); });
+		}
+	}
+
+	~WorkerPool() {
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			stopping = true;
+		}
+		queueCondition.notify_all();
+
+		for (auto & worker : workers) {
+			worker.join();
+		}
+	}
+
+	WorkerPool(const WorkerPool &) = delete;
+	WorkerPool & operator=(const WorkerPool &) = delete;
+
+	template <typename Task> auto Enqueue(Task task) -> std::future<decltype(task())> {
+		using Result = decltype(task());
+		auto packagedTask = std::make_shared<std::packaged_task<Result()>>(std::move(task));
+		auto result = packagedTask->get_future();
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			tasks.push([packagedTask]() { (*packagedTask)(); });
+		}
+		queueCondition.notify_one();
+		return result;
+	}
+
+	/// <summary>
+	/// Runs body over [0, count) in chunks of at least minChunkSize and blocks until every chunk is done.
+	/// The calling thread works through chunks too, so this is safe to call from inside a worker.
+	/// </summary>
+	void ParallelFor(size_t count, size_t minChunkSize, const std::function<void(size_t begin, size_t end)> & body) {
+		if (count == 0) return;
+
+		size_t threadCount = workers.size() + 1;
+		size_t chunkSize = std::max(minChunkSize, (count + threadCount * 4 - 1) / (threadCount * 4));
+		size_t chunkCount = (count + chunkSize - 1) / chunkSize;
+
+		if (chunkCount == 1 || workers.empty()) {
+			body(0, count);
+			return;
+		}
+
+		auto state = std::make_shared<ParallelForState>();
+		state->count = count;
+		state->chunkSize = chunkSize;
+		state->chunkCount = chunkCount;
+		state->body = &body;
+
+		size_t helperCount = std::min(workers.size(), chunkCount - 1);
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			for (size_t i = 0; i < helperCount; i++) {
+				tasks.push([state]() { state->Run(); });
+			}
+		}
+		queueCondition.notify_all();
+
+		state->Run();
+
+		std::unique_lock<std::mutex> lock(state->doneMutex);
+		state->doneCondition.wait(lock, [&state]() { return state->completedChunks == state->chunkCount; });
+	}
+
+	unsigned int WorkerCount() const {
+		return static_cast<unsigned int>(workers.size());
+	}
+
+	static unsigned int DefaultWorkerCount() {
+		unsigned int hardwareThreads = std::thread::hardware_concurrency();
+		return hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+	}
+
+private:
+	struct ParallelForState {
+		size_t count;
+		size_t chunkSize;
+		size_t chunkCount;
+		const std::function<void(size_t, size_t)> * body;
+		std::atomic<size_t> nextChunk{ 0 };
+		size_t completedChunks = 0;
+		std::mutex doneMutex;
+		std::condition_variable doneCondition;
+
+		void Run() {
+			size_t finished = 0;
+			for (size_t chunk = nextChunk++; chunk < chunkCount; chunk = nextChunk++) {
+				size_t begin = chunk * chunkSize;
+				(*body)(begin, std::min(begin + chunkSize, count));
+				finished++;
+			}
+
+			if (finished == 0) return;
+
+			std::lock_guard<std::mutex> lock(doneMutex);
+			completedChunks += finished;
+			if (completedChunks == chunkCount) {
+				doneCondition.notify_all();
+			}
+		}
+	};
+
+	void workerLoop() {
+		while (true) {
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(queueMutex);
+				queueCondition.wait(lock, [this]() { return stopping || !tasks.empty(); });
+				if (stopping && tasks.empty()) return;
+				task = std::move(tasks.front());
+				tasks.pop();
+			}
+			task();
+		}
+	}
+
+	std::vector<std::thread> workers;
+	std::queue<std::function<void()>> tasks;
+	std::mutex queueMutex;
+	std::condition_variable queueCondition;
+	bool stopping = false;
+};
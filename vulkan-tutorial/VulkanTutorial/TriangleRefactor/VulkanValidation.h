@@ -1,4 +1,6 @@
 #pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW\glfw3.h>
 #include <vulkan\vulkan.h>
 #include <vector>
 #include <iostream>
@@ -49,6 +51,21 @@ public:
 		return extensions;
 	}
 
+	static bool checkInstanceExtensionSupport(const char * extensionName) {
+		uint32_t extensionCount;
+		vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
+
+		std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+		vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, availableExtensions.data());
+
+		for (const auto & extension : availableExtensions) {
+			if (strcmp(extensionName, extension.extensionName) == 0) {
+				return true;
+			}
+		}
+		return false;
+	}
+
 	static bool checkDeviceExtensionSupport(VkPhysicalDevice device, const std::vector<const char *> & deviceExtensions) {
 		uint32_t extensionCount;
 		vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
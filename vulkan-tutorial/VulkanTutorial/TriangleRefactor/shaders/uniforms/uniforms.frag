@@ -4,6 +4,10 @@
 layout(location = 0) out vec4 outColor;
 layout(location = 0) in vec3 fragColor;
 
+layout(set = 2, binding = 0) uniform MaterialParameters {
+	vec4 tint;
+} material;
+
 void main(){
-	outColor = vec4(fragColor,1.0);
+	outColor = vec4(fragColor,1.0) * material.tint;
 }
\ No newline at end of file
@@ -1,15 +1,49 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
-layout( binding = 0) uniform UniformBufferObject {
-    mat4 model;
+#ifdef BINDLESS
+#extension GL_EXT_nonuniform_qualifier : require
+
+// Frame data is a plain storage buffer in the bindless table.
+layout(set = 0, binding = 0) readonly buffer FrameUniforms {
+    mat4 view;
+    mat4 proj;
+} frames[];
+
+layout(push_constant) uniform DrawConstants {
+    uint frameIndex;
+} resources;
+
+#define frame frames[resources.frameIndex]
+#else
+// Set 0 changes once per frame and set 1 once per pass.
+layout(set = 0, binding = 0) uniform FrameUniforms {
     mat4 view;
     mat4 proj;
-} ubo;
+} frame;
+#endif
+
+#ifdef INDIRECT
+// Every draw of an indirect list is issued with its draw ID as firstInstance. The list belongs to the pass.
+struct DrawData {
+    mat4 model;
+};
+
+layout(set = 1, binding = 0) readonly buffer DrawList {
+    DrawData draws[];
+} drawList;
+
+#define instanceModel drawList.draws[gl_InstanceIndex].model
+#endif
 
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
 
+#ifndef INDIRECT
+// Per instance stream, a batch's instances start at its firstInstance.
+layout(location = 2) in mat4 instanceModel;
+#endif
+
 layout(location = 0) out vec3 fragColor;
 
 out gl_PerVertex {
@@ -17,8 +51,7 @@ out gl_PerVertex {
 };
 
 void main() {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
-    //fragColor = vec3(ubo.model[0].x,0,1);
+    gl_Position = frame.proj * frame.view * instanceModel * vec4(inPosition, 1.0);
     fragColor = inColor;
 }
 
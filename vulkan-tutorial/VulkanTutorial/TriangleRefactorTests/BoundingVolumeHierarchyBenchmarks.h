@@ -0,0 +1,184 @@
+#pragma once
+#include "Harness.h"
+#include "CullingFixtures.h"
+
+#include <random>
+#include <Systems\Culling\BoundingVolumeHierarchy.h>
+#include <Systems\Scene\Renderables.h>
+
+static std::vector<BoundingBox> randomBoxes(size_t count, uint32_t seed, float extent = 60.0f) {
+	std::vector<BoundingBox> boxes;
+	for (auto & sphere : randomSpheres(count, seed, extent)) {
+		boxes.push_back(BoundingBox::FromSphere(sphere));
+	}
+	return boxes;
+}
+
+static std::vector<uint32_t> cullEveryBox(const std::vector<BoundingBox> & boxes, const Frustum & frustum) {
+	std::vector<uint32_t> visible;
+	for (uint32_t i = 0; i < boxes.size(); i++) {
+		if (frustum.Intersects(boxes[i])) visible.push_back(i);
+	}
+	return visible;
+}
+
+// The slab test the hierarchy runs at its leaves, against every box.
+static bool raycastEveryBox(const std::vector<BoundingBox> & boxes, const glm::vec3 & origin, const glm::vec3 & direction, RayHit & hit) {
+	bool found = false;
+	hit.distance = FLT_MAX;
+	for (uint32_t i = 0; i < boxes.size(); i++) {
+		float enter = 0.0f, exit = FLT_MAX;
+		for (int axis = 0; axis < 3; axis++) {
+			float lower = (boxes[i].min[axis] - origin[axis]) / direction[axis];
+			float upper = (boxes[i].max[axis] - origin[axis]) / direction[axis];
+			enter = std::max(enter, std::min(lower, upper));
+			exit = std::min(exit, std::max(lower, upper));
+		}
+		if (enter <= exit && enter < hit.distance) {
+			hit = { i, enter };
+			found = true;
+		}
+	}
+	return found;
+}
+
+static void checkHierarchyQueries(BoundingVolumeHierarchy & hierarchy, const std::vector<BoundingBox> & boxes, std::mt19937 & random) {
+	auto frustum = testFrustum();
+	auto visible = hierarchy.Cull(frustum);
+	std::sort(visible.begin(), visible.end());
+	HARNESS_CHECK(visible == cullEveryBox(boxes, frustum));
+
+	std::uniform_real_distribution<float> coordinate(-1.0f, 1.0f);
+	for (int ray = 0; ray < 100; ray++) {
+		glm::vec3 origin(coordinate(random) * 70.0f, coordinate(random) * 70.0f, coordinate(random) * 70.0f);
+		glm::vec3 direction(coordinate(random), coordinate(random), coordinate(random));
+		RayHit hit = {}, expected = {};
+		bool found = hierarchy.Raycast(origin, direction, hit);
+		HARNESS_CHECK(found == raycastEveryBox(boxes, origin, direction, expected));
+		HARNESS_CHECK(!found || std::fabs(hit.distance - expected.distance) < 1e-4f * std::max(1.0f, expected.distance));
+	}
+}
+
+HARNESS_TEST(BoundingVolumeHierarchyMatchesBruteForce) {
+	BoundingVolumeHierarchy empty;
+	empty.Build({});
+	RayHit hit;
+	HARNESS_CHECK(empty.Cull(testFrustum()).empty() && !empty.Raycast(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), hit));
+
+	WorkerPool workers;
+	std::mt19937 random(5);
+	for (auto pool : { static_cast<WorkerPool *>(nullptr), &workers }) {
+		// Above the parallel threshold, so the pooled build hands out subtrees.
+		auto boxes = randomBoxes(3 * BoundingVolumeHierarchy::ParallelThreshold + 11, 21);
+		BoundingVolumeHierarchy hierarchy;
+		hierarchy.Build(boxes, pool);
+		HARNESS_CHECK(hierarchy.ObjectCount() == boxes.size() && hierarchy.NodeCount() < boxes.size());
+		checkHierarchyQueries(hierarchy, boxes, random);
+
+		// A few moved objects walk up from their leaves, many moved ones refit every node.
+		std::uniform_real_distribution<float> offset(-10.0f, 10.0f);
+		for (size_t moved : { boxes.size() / 100, boxes.size() / 2 }) {
+			for (size_t i = 0; i < moved; i++) {
+				auto object = static_cast<uint32_t>(random() % boxes.size());
+				glm::vec3 shift(offset(random), offset(random), offset(random));
+				boxes[object] = { boxes[object].min + shift, boxes[object].max + shift };
+				hierarchy.SetBounds(object, boxes[object]);
+			}
+			hierarchy.Refit();
+			checkHierarchyQueries(hierarchy, boxes, random);
+		}
+	}
+	expectThrow([&]() { empty.SetBounds(0, BoundingBox()); }, "bounds for an object outside the hierarchy");
+}
+
+HARNESS_TEST(PickEntityFindsNearestUnderCursor) {
+	TransformHierarchy transforms;
+	EntityRegistry registry;
+	MaterialTemplate materialTemplate = {};
+	MaterialInstance material = { &materialTemplate, {}, 0 };
+	Mesh mesh = {};
+
+	// Two entities straight ahead of the test camera, one behind the other, and one off to the side.
+	std::vector<Entity> created;
+	for (auto & sphere : { glm::vec4(0.0f, 0.0f, -20.0f, 1.0f), glm::vec4(0.0f, 0.0f, -10.0f, 1.0f), glm::vec4(8.0f, 0.0f, -10.0f, 1.0f) }) {
+		auto entity = registry.Create();
+		registry.Add(entity, TransformComponent{ transforms.Create(glm::mat4(1.0f)) });
+		registry.Add(entity, MeshComponent{ &mesh });
+		registry.Add(entity, MaterialComponent{ &material, 0 });
+		registry.Add(entity, BoundsComponent{ { sphere }, {} });
+		created.push_back(entity);
+	}
+	transforms.Update();
+	UpdateWorldBounds(registry, transforms);
+	BoundingVolumeHierarchy hierarchy;
+	std::vector<Entity> entities;
+	BuildHierarchy(registry, hierarchy, entities);
+
+	auto viewProjection = testViewProjection(1.0f, 1.5f, 0.5f, 50.0f);
+	glm::vec2 viewport(300.0f, 200.0f);
+	HARNESS_CHECK(PickEntity(hierarchy, entities, viewProjection, glm::vec2(150.0f, 100.0f), viewport) == created[1]);
+	HARNESS_CHECK(PickEntity(hierarchy, entities, viewProjection, glm::vec2(5.0f, 5.0f), viewport) == NoEntity);
+
+	// Once the nearer one has moved away the one behind it is picked.
+	glm::mat4 away(1.0f);
+	away[3] = glm::vec4(0.0f, 30.0f, 0.0f, 1.0f);
+	transforms.SetLocal(registry.Get<TransformComponent>(created[1]).node, away);
+	transforms.Update();
+	UpdateWorldBounds(registry, transforms);
+	RefitHierarchy(registry, hierarchy, entities);
+	HARNESS_CHECK(PickEntity(hierarchy, entities, viewProjection, glm::vec2(150.0f, 100.0f), viewport) == created[0]);
+}
+
+HARNESS_BENCHMARK(BoundingVolumeHierarchyTimes) {
+	auto frustum = testFrustum();
+	WorkerPool workers;
+	std::mt19937 random(13);
+	std::uniform_real_distribution<float> coordinate(-1.0f, 1.0f);
+	for (size_t count : { 10000, 100000, 1000000 }) {
+		// The same density at every count, as for the culler.
+		float extent = 60.0f * std::cbrt(count / 100000.0f);
+		auto boxes = randomBoxes(count, 7, extent);
+		std::cout << " " << count << " boxes" << std::endl;
+
+		BoundingVolumeHierarchy hierarchy;
+		auto serialBuild = bestMilliseconds([&]() { hierarchy.Build(boxes); }, 3);
+		printTiming("build", count, serialBuild);
+		auto pooledBuild = bestMilliseconds([&]() { hierarchy.Build(boxes, &workers); }, 3);
+		printTiming("build on the worker pool", count, pooledBuild, serialBuild);
+
+		// Moved there and back on alternate runs, so every refit does about the same work.
+		for (size_t moved : { count / 100, count / 2 }) {
+			float step = 1.0f;
+			auto refit = bestMilliseconds([&]() {
+				for (size_t i = 0; i < moved; i++) {
+					auto object = static_cast<uint32_t>(i * 7919 % count);
+					boxes[object] = { boxes[object].min + glm::vec3(step), boxes[object].max + glm::vec3(step) };
+					hierarchy.SetBounds(object, boxes[object]);
+				}
+				hierarchy.Refit();
+				step = -step;
+			});
+			printTiming("refit, " + std::to_string(moved * 100 / count) + "% moved", moved, refit);
+		}
+
+		auto bruteCull = bestMilliseconds([&]() { harnessSink += cullEveryBox(boxes, frustum).size(); });
+		printTiming("cull every box", count, bruteCull);
+		auto cull = bestMilliseconds([&]() { harnessSink += hierarchy.Cull(frustum).size(); });
+		printTiming("cull the hierarchy", count, cull, bruteCull);
+
+		std::vector<std::pair<glm::vec3, glm::vec3>> rays;
+		for (int ray = 0; ray < 100; ray++) {
+			rays.push_back({ glm::vec3(coordinate(random), coordinate(random), coordinate(random)) * extent,
+				glm::vec3(coordinate(random), coordinate(random), coordinate(random)) });
+		}
+		RayHit hit;
+		auto bruteRays = bestMilliseconds([&]() {
+			for (auto & ray : rays) harnessSink += raycastEveryBox(boxes, ray.first, ray.second, hit) ? 1 : 0;
+		}, 1);
+		printTiming("100 rays against every box", count, bruteRays);
+		auto hierarchyRays = bestMilliseconds([&]() {
+			for (auto & ray : rays) harnessSink += hierarchy.Raycast(ray.first, ray.second, hit) ? 1 : 0;
+		});
+		printTiming("100 rays through the hierarchy", count, hierarchyRays, bruteRays);
+	}
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <glm\glm.hpp>
+#include <Systems\Culling\Frustum.h>
+
+#include <vector>
+#include <random>
+#include <cmath>
+
+// Perspective camera at the origin looking down -z, with depth running from 0 to 1 as it does in Vulkan.
+static glm::mat4 testViewProjection(float verticalFov, float aspect, float nearPlane, float farPlane) {
+	float focal = 1.0f / std::tan(verticalFov * 0.5f);
+	glm::mat4 projection(0.0f);
+	projection[0][0] = focal / aspect;
+	projection[1][1] = focal;
+	projection[2][2] = farPlane / (nearPlane - farPlane);
+	projection[2][3] = -1.0f;
+	projection[3][2] = nearPlane * farPlane / (nearPlane - farPlane);
+	return projection;
+}
+
+static Frustum testFrustum() {
+	return Frustum::FromViewProjection(testViewProjection(1.0f, 1.5f, 0.5f, 50.0f));
+}
+
+// Spheres scattered all around the test camera, so every plane rejects some of them and a few straddle each one.
+static std::vector<BoundingSphere> randomSpheres(size_t count, uint32_t seed, float extent = 60.0f) {
+	std::mt19937 random(seed);
+	std::uniform_real_distribution<float> coordinate(-extent, extent), radius(0.05f, 4.0f);
+	std::vector<BoundingSphere> spheres(count);
+	for (auto & sphere : spheres) {
+		sphere.centerRadius = glm::vec4(coordinate(random), coordinate(random), coordinate(random), radius(random));
+	}
+	return spheres;
+}
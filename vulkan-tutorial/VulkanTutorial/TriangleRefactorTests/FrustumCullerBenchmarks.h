@@ -0,0 +1,71 @@
+#pragma once
+#include "Harness.h"
+#include "CullingFixtures.h"
+
+#include <Systems\Culling\FrustumCuller.h>
+
+static std::vector<CullingPath> availableCullingPaths() {
+	std::vector<CullingPath> paths = { CullingPath::Scalar };
+	if (FrustumCuller::BestPath() != CullingPath::Scalar) paths.push_back(CullingPath::Sse);
+	if (FrustumCuller::BestPath() == CullingPath::Avx) paths.push_back(CullingPath::Avx);
+	return paths;
+}
+
+static const char * cullingPathName(CullingPath path) {
+	switch (path) {
+	case CullingPath::Sse: return "SSE";
+	case CullingPath::Avx: return "AVX";
+	default: return "scalar";
+	}
+}
+
+static void fillCuller(FrustumCuller & culler, const std::vector<BoundingSphere> & spheres) {
+	culler.Clear();
+	for (auto & sphere : spheres) {
+		culler.Add(sphere);
+	}
+}
+
+HARNESS_TEST(FrustumCullerPathsMatchIntersects) {
+	// Not a multiple of the block or lane width, so the padding and the last partial block are both exercised.
+	auto spheres = randomSpheres(3 * FrustumCuller::BlockSize + 5, 11);
+	auto frustum = testFrustum();
+	std::vector<uint32_t> expected;
+	for (uint32_t i = 0; i < spheres.size(); i++) {
+		if (frustum.Intersects(spheres[i])) expected.push_back(i);
+	}
+	HARNESS_CHECK(!expected.empty() && expected.size() < spheres.size());
+
+	FrustumCuller culler;
+	fillCuller(culler, spheres);
+	WorkerPool workers;
+	for (auto path : availableCullingPaths()) {
+		culler.SetPath(path);
+		HARNESS_CHECK(culler.Cull(frustum) == expected);
+		HARNESS_CHECK(culler.Cull(frustum, &workers) == expected);
+	}
+}
+
+HARNESS_BENCHMARK(FrustumCullerTimes) {
+	auto frustum = testFrustum();
+	FrustumCuller culler;
+	WorkerPool workers;
+	for (size_t count : { 100000, 250000, 500000, 1000000 }) {
+		// The same density at every count, so the visible fraction stays put as the scene grows.
+		auto spheres = randomSpheres(count, 5, 60.0f * std::cbrt(count / 100000.0f));
+		fillCuller(culler, spheres);
+
+		std::cout << " " << count << " spheres" << std::endl;
+		double scalar = 0.0;
+		for (auto path : availableCullingPaths()) {
+			culler.SetPath(path);
+			auto time = bestMilliseconds([&]() { harnessSink += culler.Cull(frustum).size(); }, 10);
+			if (path == CullingPath::Scalar) scalar = time;
+			printTiming(cullingPathName(path), count, time, scalar);
+		}
+
+		culler.SetPath(FrustumCuller::BestPath());
+		auto pooled = bestMilliseconds([&]() { harnessSink += culler.Cull(frustum, &workers).size(); }, 10);
+		printTiming(std::string(cullingPathName(FrustumCuller::BestPath())) + " on the worker pool", count, pooled, scalar);
+	}
+}
@@ -0,0 +1,293 @@
+#pragma once
+#include "Harness.h"
+#include "CullingFixtures.h"
+
+#include <vulkan\vulkan.h>
+#include <glm\glm.hpp>
+#include <FileReader.h>
+#include <Builders\GraphicsPipelineBuilder.h>
+#include <Systems\Graphics\MappedBuffer.h>
+#include <Systems\Descriptors\DescriptorWriter.h>
+#include <Systems\Culling\Frustum.h>
+#include <Systems\Shaders\ShaderCompiler.h>
+
+#include <cmath>
+
+/// <summary>
+/// Just enough Vulkan to run a compute shader without a window: the first device with a compute queue, a command pool
+/// and one queue. Available() is false on machines without a Vulkan driver, the GPU tests skip there.
+/// </summary>
+class ComputeContext
+{
+public:
+	ComputeContext() {
+		VkApplicationInfo appInfo = {};
+		appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+		appInfo.pApplicationName = "TriangleRefactorTests";
+		appInfo.apiVersion = VK_API_VERSION_1_0;
+
+		VkInstanceCreateInfo instanceInfo = {};
+		instanceInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+		instanceInfo.pApplicationInfo = &appInfo;
+		if (vkCreateInstance(&instanceInfo, nullptr, &instance) != VK_SUCCESS) {
+			instance = VK_NULL_HANDLE;
+			return;
+		}
+
+		uint32_t deviceCount = 0;
+		vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
+		std::vector<VkPhysicalDevice> devices(deviceCount);
+		vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
+		for (auto candidate : devices) {
+			uint32_t familyCount = 0;
+			vkGetPhysicalDeviceQueueFamilyProperties(candidate, &familyCount, nullptr);
+			std::vector<VkQueueFamilyProperties> families(familyCount);
+			vkGetPhysicalDeviceQueueFamilyProperties(candidate, &familyCount, families.data());
+			for (uint32_t family = 0; family < familyCount; family++) {
+				if (families[family].queueFlags & VK_QUEUE_COMPUTE_BIT) {
+					physicalDevice = candidate;
+					queueFamily = family;
+					break;
+				}
+			}
+			if (physicalDevice != VK_NULL_HANDLE) break;
+		}
+		if (physicalDevice == VK_NULL_HANDLE) return;
+
+		float priority = 1.0f;
+		VkDeviceQueueCreateInfo queueInfo = {};
+		queueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+		queueInfo.queueFamilyIndex = queueFamily;
+		queueInfo.queueCount = 1;
+		queueInfo.pQueuePriorities = &priority;
+
+		VkDeviceCreateInfo deviceInfo = {};
+		deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+		deviceInfo.queueCreateInfoCount = 1;
+		deviceInfo.pQueueCreateInfos = &queueInfo;
+		vkOk(vkCreateDevice(physicalDevice, &deviceInfo, nullptr, &device), "Failed to create the test device");
+		vkGetDeviceQueue(device, queueFamily, 0, &queue);
+
+		VkCommandPoolCreateInfo poolInfo = {};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.queueFamilyIndex = queueFamily;
+		vkOk(vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool), "Failed to create the test command pool");
+	}
+
+	~ComputeContext() {
+		if (device != VK_NULL_HANDLE) {
+			vkDestroyCommandPool(device, commandPool, nullptr);
+			vkDestroyDevice(device, nullptr);
+		}
+		if (instance != VK_NULL_HANDLE) {
+			vkDestroyInstance(instance, nullptr);
+		}
+	}
+
+	bool Available() const { return device != VK_NULL_HANDLE; }
+
+	/// <summary>
+	/// Records commands into a one time command buffer, submits it and waits for the queue to finish it.
+	/// </summary>
+	void Execute(const std::function<void(VkCommandBuffer)> & recordCommands) {
+		VkCommandBufferAllocateInfo allocateInfo = {};
+		allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocateInfo.commandPool = commandPool;
+		allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocateInfo.commandBufferCount = 1;
+		VkCommandBuffer commandBuffer;
+		vkOk(vkAllocateCommandBuffers(device, &allocateInfo, &commandBuffer), "Failed to allocate a test command buffer");
+
+		VkCommandBufferBeginInfo beginInfo = {};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		vkBeginCommandBuffer(commandBuffer, &beginInfo);
+		recordCommands(commandBuffer);
+		vkEndCommandBuffer(commandBuffer);
+
+		VkSubmitInfo submitInfo = {};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &commandBuffer;
+		vkOk(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE), "Failed to submit a test command buffer");
+		vkQueueWaitIdle(queue);
+		vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+	}
+
+	VkInstance instance = VK_NULL_HANDLE;
+	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+	VkDevice device = VK_NULL_HANDLE;
+	VkQueue queue = VK_NULL_HANDLE;
+	VkCommandPool commandPool = VK_NULL_HANDLE;
+	uint32_t queueFamily = 0;
+};
+
+// Matches the std140 Culling block in cull.comp, as GpuCulling fills it.
+struct CullingTestParameters
+{
+	Frustum frustum;
+	uint32_t drawCount;
+	uint32_t capacity;
+	uint32_t compact;
+	uint32_t padding;
+	glm::mat4 pyramidViewProjection;
+	glm::vec2 pyramidSize;
+	uint32_t pyramidLevels;
+	uint32_t padding2;
+};
+
+// Spheres closer than this to a plane may land either side of it with the GPU's rounding.
+static bool nearFrustumBorder(const Frustum & frustum, const BoundingSphere & sphere) {
+	auto & s = sphere.centerRadius;
+	for (auto & plane : frustum.planes) {
+		if (std::fabs(plane.x * s.x + plane.y * s.y + plane.z * s.z + plane.w + s.w) < 1e-3f) return true;
+	}
+	return false;
+}
+
+HARNESS_TEST(GpuCullingMatchesFrustumIntersects) {
+	ComputeContext context;
+	if (!context.Available()) {
+		std::cout << "  skipped, no Vulkan device" << std::endl;
+		return;
+	}
+	auto device = context.device;
+	auto physicalDevice = context.physicalDevice;
+
+	WorkerPool workers;
+	ShaderCompiler compiler(workers, "../TriangleRefactor/shaders/.cache", { "../TriangleRefactor/shaders" });
+	auto spirvFile = compiler.CompileAll({ ShaderSource("../TriangleRefactor/shaders/culling/cull.comp") })[0];
+	MappedFile spirv(spirvFile);
+	auto moduleInfo = ShaderModuleInfoBuilder(spirv).Build();
+	VkShaderModule module;
+	vkOk(vkCreateShaderModule(device, &moduleInfo, nullptr, &module), "Failed to create the culling module");
+
+	VkDescriptorSetLayoutBinding bindings[5] = {};
+	for (uint32_t binding = 0; binding < 5; binding++) {
+		bindings[binding].binding = binding;
+		bindings[binding].descriptorType = binding == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[binding].descriptorCount = 1;
+		bindings[binding].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+	VkDescriptorSetLayoutCreateInfo setLayoutInfo = {};
+	setLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	setLayoutInfo.bindingCount = 5;
+	setLayoutInfo.pBindings = bindings;
+	VkDescriptorSetLayout setLayout;
+	vkOk(vkCreateDescriptorSetLayout(device, &setLayoutInfo, nullptr, &setLayout), "Failed to create the culling set layout");
+
+	VkPipelineLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	layoutInfo.setLayoutCount = 1;
+	layoutInfo.pSetLayouts = &setLayout;
+	VkPipelineLayout layout;
+	vkOk(vkCreatePipelineLayout(device, &layoutInfo, nullptr, &layout), "Failed to create the culling pipeline layout");
+
+	VkComputePipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = module;
+	pipelineInfo.stage.pName = "main";
+	pipelineInfo.layout = layout;
+	VkPipeline pipeline;
+	vkOk(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline), "Failed to create the culling pipeline");
+
+	const uint32_t drawCount = 10000;
+	auto spheres = randomSpheres(drawCount, 7);
+	auto frustum = testFrustum();
+
+	MappedBuffer parameters, bounds, commands, visibleCommands, visibleCount;
+	parameters.Create(device, physicalDevice, sizeof(CullingTestParameters), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+	bounds.Create(device, physicalDevice, sizeof(BoundingSphere) * drawCount, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+	commands.Create(device, physicalDevice, sizeof(VkDrawIndexedIndirectCommand) * drawCount, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+	visibleCommands.Create(device, physicalDevice, sizeof(VkDrawIndexedIndirectCommand) * drawCount, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+	visibleCount.Create(device, physicalDevice, sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+	memcpy(bounds.mapped, spheres.data(), sizeof(BoundingSphere) * drawCount);
+	for (uint32_t id = 0; id < drawCount; id++) {
+		commands.As<VkDrawIndexedIndirectCommand>()[id] = { 3, 1, 0, 0, id };
+	}
+
+	VkDescriptorPoolSize poolSizes[2] = { { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 }, { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4 } };
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = 1;
+	poolInfo.poolSizeCount = 2;
+	poolInfo.pPoolSizes = poolSizes;
+	VkDescriptorPool descriptorPool;
+	vkOk(vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool), "Failed to create the culling descriptor pool");
+
+	VkDescriptorSetAllocateInfo setInfo = {};
+	setInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	setInfo.descriptorPool = descriptorPool;
+	setInfo.descriptorSetCount = 1;
+	setInfo.pSetLayouts = &setLayout;
+	VkDescriptorSet set;
+	vkOk(vkAllocateDescriptorSets(device, &setInfo, &set), "Failed to allocate the culling set");
+	DescriptorWriter(set)
+		.WriteBuffer(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, parameters.DescriptorInfo())
+		->WriteBuffer(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, bounds.DescriptorInfo())
+		->WriteBuffer(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, commands.DescriptorInfo())
+		->WriteBuffer(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, visibleCommands.DescriptorInfo())
+		->WriteBuffer(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, visibleCount.DescriptorInfo())
+		->Update(device);
+
+	auto cull = [&](uint32_t compact) {
+		auto values = parameters.As<CullingTestParameters>();
+		*values = CullingTestParameters();
+		values->frustum = frustum;
+		values->drawCount = drawCount;
+		values->capacity = drawCount;
+		values->compact = compact;
+		*visibleCount.As<uint32_t>() = 0;
+		context.Execute([&](VkCommandBuffer commandBuffer) {
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, layout, 0, 1, &set, 0, nullptr);
+			vkCmdDispatch(commandBuffer, (drawCount + 63) / 64, 1, 1);
+
+			VkMemoryBarrier toHost = {};
+			toHost.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			toHost.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			toHost.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &toHost, 0, nullptr, 0, nullptr);
+		});
+	};
+
+	// Compacted, the survivors arrive in any order, each draw's firstInstance says which it was.
+	cull(1);
+	std::vector<bool> compacted(drawCount, false);
+	auto survivors = *visibleCount.As<uint32_t>();
+	HARNESS_CHECK(survivors <= drawCount);
+	for (uint32_t i = 0; i < survivors; i++) {
+		auto id = visibleCommands.As<VkDrawIndexedIndirectCommand>()[i].firstInstance;
+		HARNESS_CHECK(id < drawCount && !compacted[id]);
+		compacted[id] = true;
+	}
+
+	// In place, every slot stays and culled draws lose their instances.
+	cull(0);
+	uint32_t visible = 0, compared = 0;
+	for (uint32_t id = 0; id < drawCount; id++) {
+		auto & command = visibleCommands.As<VkDrawIndexedIndirectCommand>()[id];
+		HARNESS_CHECK(command.firstInstance == id);
+		if (nearFrustumBorder(frustum, spheres[id])) continue;
+
+		bool expected = frustum.Intersects(spheres[id]);
+		HARNESS_CHECK(compacted[id] == expected);
+		HARNESS_CHECK((command.instanceCount == 1) == expected);
+		visible += expected ? 1 : 0;
+		compared++;
+	}
+	// Both outcomes have to be exercised for the comparison to mean anything.
+	HARNESS_CHECK(visible > 0 && visible < compared);
+
+	vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+	for (auto buffer : { &parameters, &bounds, &commands, &visibleCommands, &visibleCount }) {
+		buffer->Destroy(device);
+	}
+	vkDestroyPipeline(device, pipeline, nullptr);
+	vkDestroyPipelineLayout(device, layout, nullptr);
+	vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+	vkDestroyShaderModule(device, module, nullptr);
+	spirv.Release();
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <functional>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+#include <iostream>
+#include <iomanip>
+#include <cstdint>
+
+/// <summary>
+/// One test or benchmark. Tests throw to fail, benchmarks print their own timings.
+/// </summary>
+struct HarnessCase
+{
+	std::string name;
+	bool benchmark;
+	std::function<void()> run;
+};
+
+static std::vector<HarnessCase> & harnessCases() {
+	static std::vector<HarnessCase> cases;
+	return cases;
+}
+
+struct HarnessRegistration
+{
+	HarnessRegistration(const char * name, bool benchmark, void(*run)()) {
+		harnessCases().push_back({ name, benchmark, run });
+	}
+};
+
+#define HARNESS_TEST(name) \
+	static void name(); \
+	static HarnessRegistration name##Registration(#name, false, name); \
+	static void name()
+
+#define HARNESS_BENCHMARK(name) \
+	static void name(); \
+	static HarnessRegistration name##Registration(#name, true, name); \
+	static void name()
+
+#define HARNESS_CHECK(condition) \
+	if (!(condition)) throw std::runtime_error(std::string(__FILE__) + ":" + std::to_string(__LINE__) + " " + #condition)
+
+template <typename F> static void expectThrow(F && function, const std::string & what) {
+	try {
+		function();
+	}
+	catch (const std::runtime_error &) {
+		return;
+	}
+	throw std::runtime_error("Expected an error: " + what);
+}
+
+/// <summary>
+/// Fastest of several runs in milliseconds. The best run is the one least disturbed by the rest of the machine.
+/// </summary>
+template <typename F> static double bestMilliseconds(F && function, int runs = 5) {
+	double best = 1e30;
+	for (int run = 0; run < runs; run++) {
+		auto start = std::chrono::high_resolution_clock::now();
+		function();
+		auto end = std::chrono::high_resolution_clock::now();
+		best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+	}
+	return best;
+}
+
+static void printTiming(const std::string & label, size_t count, double milliseconds, double baseline = 0.0) {
+	std::cout << "  " << std::left << std::setw(32) << label << std::right << std::setw(10) << count
+		<< std::setw(12) << std::fixed << std::setprecision(3) << milliseconds << " ms";
+	if (baseline > 0.0) {
+		std::cout << std::setw(8) << std::setprecision(2) << baseline / milliseconds << "x";
+	}
+	std::cout << std::endl;
+}
+
+// Keeps results alive so the optimizer can't drop the work being timed.
+static volatile uint64_t harnessSink = 0;
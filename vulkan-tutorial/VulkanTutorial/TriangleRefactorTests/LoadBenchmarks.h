@@ -0,0 +1,89 @@
+#pragma once
+#include "Harness.h"
+
+#include <vulkan\vulkan.h>
+#include <FileReader.h>
+#include <Builders\GraphicsPipelineBuilder.h>
+
+#include <fstream>
+#include <cstdio>
+
+static void writeScratchFile(const std::string & filename, size_t size) {
+	std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+	std::vector<uint32_t> words(std::min<size_t>(size, 1 << 20) / sizeof(uint32_t) + 1);
+	for (size_t i = 0; i < words.size(); i++) {
+		words[i] = static_cast<uint32_t>(i * 2654435761u);
+	}
+	for (size_t written = 0; written < size;) {
+		auto chunk = std::min(size - written, words.size() * sizeof(uint32_t));
+		file.write(reinterpret_cast<const char *>(words.data()), chunk);
+		written += chunk;
+	}
+	if (!file) {
+		throw std::runtime_error("Failed to write " + filename);
+	}
+}
+
+// Reads every byte, a mapping that is never touched would cost nothing.
+static uint64_t checksum(const char * data, size_t size) {
+	uint64_t sum = 0;
+	for (size_t i = 0; i < size; i++) {
+		sum += static_cast<unsigned char>(data[i]);
+	}
+	return sum;
+}
+
+HARNESS_TEST(SpirvLoaderRejectsEmptyAndPartialWords) {
+	const std::string empty = "load-test-empty.spv", partial = "load-test-partial.spv", whole = "load-test-whole.spv";
+	writeScratchFile(empty, 0);
+	writeScratchFile(partial, 6);
+	writeScratchFile(whole, 8);
+
+	MappedFile emptyFile(empty), partialFile(partial), wholeFile(whole);
+	HARNESS_CHECK(emptyFile.Empty() && emptyFile.Words() == nullptr);
+	expectThrow([&]() { ShaderModuleInfoBuilder builder(emptyFile); }, "an empty SPIR-V file");
+	expectThrow([&]() { ShaderModuleInfoBuilder builder(partialFile); }, "a SPIR-V file that isn't whole words");
+	HARNESS_CHECK(ShaderModuleInfoBuilder(wholeFile).Build().codeSize == 8);
+
+	emptyFile.Release();
+	partialFile.Release();
+	wholeFile.Release();
+	std::remove(empty.c_str());
+	std::remove(partial.c_str());
+	std::remove(whole.c_str());
+}
+
+static void benchmarkLoads(const char * label, size_t fileCount, size_t fileSize) {
+	std::vector<std::string> filenames;
+	for (size_t i = 0; i < fileCount; i++) {
+		filenames.push_back("load-benchmark-" + std::to_string(i) + ".bin");
+		writeScratchFile(filenames.back(), fileSize);
+	}
+
+	// Both run over a warm file cache, so this compares the copy into a vector against mapping the pages.
+	auto readTime = bestMilliseconds([&]() {
+		for (auto & filename : filenames) {
+			auto contents = readFile(filename);
+			harnessSink += checksum(contents.data(), contents.size());
+		}
+	});
+	auto mappedTime = bestMilliseconds([&]() {
+		for (auto & filename : filenames) {
+			MappedFile contents(filename);
+			harnessSink += checksum(contents.Data(), contents.Size());
+		}
+	});
+
+	std::cout << " " << label << ", " << fileCount << " files of " << fileSize / 1024 << " KB" << std::endl;
+	printTiming("readFile", fileCount, readTime);
+	printTiming("MappedFile", fileCount, mappedTime, readTime);
+
+	for (auto & filename : filenames) {
+		std::remove(filename.c_str());
+	}
+}
+
+HARNESS_BENCHMARK(FileLoadTimes) {
+	benchmarkLoads("shader sized", 2000, 8 << 10);
+	benchmarkLoads("asset sized", 4, 128 << 20);
+}
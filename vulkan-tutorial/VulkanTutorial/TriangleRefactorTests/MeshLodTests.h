@@ -0,0 +1,92 @@
+#pragma once
+#include "Harness.h"
+
+#include <set>
+#include <utility>
+#include <Data\Vertex.h>
+#include <Systems\Rendering\MeshLod.h>
+#include <Systems\Scene\Renderables.h>
+
+// A rolling heightfield split down the middle by a seam. The seam column is stored once per side, each side in its own
+// color, the way a UV or normal seam is stored.
+static void seamedTerrain(int size, std::vector<Vertex> & vertices, std::vector<uint32_t> & indices) {
+	auto seam = size / 2;
+	auto vertexAt = [&](int x, int y, int side) {
+		auto first = side == 0 ? 0 : (seam + 1) * (size + 1);
+		return static_cast<uint32_t>(first + (x - side * seam) * (size + 1) + y);
+	};
+	for (int side = 0; side < 2; side++) {
+		for (int x = side * seam; x <= (side == 0 ? seam : size); x++) {
+			for (int y = 0; y <= size; y++) {
+				float height = std::sin(x * 0.3f) * std::cos(y * 0.2f) * 2.0f;
+				vertices.push_back({ glm::vec3(static_cast<float>(x), static_cast<float>(y), height), glm::vec3(static_cast<float>(side)) });
+			}
+		}
+	}
+	for (int x = 0; x < size; x++) {
+		auto side = x < seam ? 0 : 1;
+		for (int y = 0; y < size; y++) {
+			auto a = vertexAt(x, y, side), b = vertexAt(x + 1, y, side), c = vertexAt(x, y + 1, side), d = vertexAt(x + 1, y + 1, side);
+			indices.insert(indices.end(), { a, b, d, a, d, c });
+		}
+	}
+}
+
+HARNESS_TEST(MeshSimplifierKeepsSeamsApart) {
+	const int size = 32;
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	seamedTerrain(size, vertices, indices);
+	auto lods = GenerateLods(vertices, indices);
+	HARNESS_CHECK(lods.levels.size() > 2 && lods.levels.back().indexCount * 4 < indices.size());
+
+	for (auto & level : lods.levels) {
+		// Every triangle keeps to one side, and the seam edges one side ends on are the edges the other side starts from.
+		std::set<std::pair<float, float>> seamEdges[2];
+		for (uint32_t i = level.firstIndex; i < level.firstIndex + level.indexCount; i += 3) {
+			auto & a = vertices[lods.indices[i]], & b = vertices[lods.indices[i + 1]], & c = vertices[lods.indices[i + 2]];
+			HARNESS_CHECK(a.color.x == b.color.x && b.color.x == c.color.x);
+
+			auto side = static_cast<int>(a.color.x);
+			const Vertex * corners[] = { &a, &b, &c };
+			for (int corner = 0; corner < 3; corner++) {
+				auto & from = corners[corner]->position, & to = corners[(corner + 1) % 3]->position;
+				if (from.x == size / 2 && to.x == size / 2) {
+					seamEdges[side].insert({ std::min(from.y, to.y), std::max(from.y, to.y) });
+				}
+			}
+		}
+		HARNESS_CHECK(!seamEdges[0].empty() && seamEdges[0] == seamEdges[1]);
+	}
+}
+
+HARNESS_TEST(SelectLodsCoarsensWithDistance) {
+	const int size = 32;
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	seamedTerrain(size, vertices, indices);
+	Mesh fullMesh = {};
+	fullMesh.indexCount = static_cast<uint32_t>(indices.size());
+	auto lodMesh = LodMesh::Create(fullMesh, GenerateLods(vertices, indices), 0);
+
+	TransformHierarchy transforms;
+	EntityRegistry registry;
+	auto entity = registry.Create();
+	registry.Add(entity, TransformComponent{ transforms.Create(glm::mat4(1.0f)) });
+	registry.Add(entity, MeshComponent{ &fullMesh });
+	registry.Add(entity, LodComponent{ &lodMesh });
+	registry.Add(entity, BoundsComponent{ { glm::vec4(16.0f, 16.0f, 0.0f, 23.0f) }, {} });
+	transforms.Update();
+	UpdateWorldBounds(registry, transforms);
+
+	// Walking away from the terrain, the level only ever gets coarser, from the full mesh to the coarsest.
+	uint32_t previous = 0;
+	for (float distance : { 10.0f, 100.0f, 1000.0f, 10000.0f, 100000.0f }) {
+		SelectLods(registry, LodCamera::FromPerspective(glm::vec3(16.0f, 16.0f, 23.0f + distance), glm::radians(45.0f), 720.0f));
+		auto level = registry.Get<MeshComponent>(entity).mesh->index;
+		HARNESS_CHECK(level >= previous && lodMesh.levels[level].indexCount == registry.Get<MeshComponent>(entity).mesh->indexCount);
+		HARNESS_CHECK(distance != 10.0f || level == 0);
+		previous = level;
+	}
+	HARNESS_CHECK(previous == lodMesh.levels.size() - 1);
+}
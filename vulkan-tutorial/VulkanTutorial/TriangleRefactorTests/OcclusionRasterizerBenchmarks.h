@@ -0,0 +1,170 @@
+#pragma once
+#include "Harness.h"
+#include "CullingFixtures.h"
+
+#include <random>
+#include <Systems\Culling\OcclusionRasterizer.h>
+#include <Systems\Scene\Renderables.h>
+
+// With an identity view projection clip space is the scene: x and y across the buffer, z straight into depth.
+static uint32_t addWall(OcclusionRasterizer & rasterizer, float halfSize, float depth) {
+	return rasterizer.AddOccluder({
+		glm::vec3(-halfSize, -halfSize, depth), glm::vec3(halfSize, -halfSize, depth),
+		glm::vec3(halfSize, halfSize, depth), glm::vec3(-halfSize, halfSize, depth)
+	}, { 0, 1, 2, 0, 2, 3 });
+}
+
+static BoundingBox testBox(float x0, float y0, float z0, float x1, float y1, float z1) {
+	return { glm::vec3(x0, y0, z0), glm::vec3(x1, y1, z1) };
+}
+
+// A unit cube occluder, twelve triangles.
+static uint32_t addCube(OcclusionRasterizer & rasterizer) {
+	std::vector<glm::vec3> positions;
+	for (int corner = 0; corner < 8; corner++) {
+		positions.push_back(glm::vec3((corner & 1) ? 0.5f : -0.5f, (corner & 2) ? 0.5f : -0.5f, (corner & 4) ? 0.5f : -0.5f));
+	}
+	return rasterizer.AddOccluder(positions, {
+		0, 2, 1, 1, 2, 3, 4, 5, 6, 5, 7, 6, 0, 1, 4, 1, 5, 4,
+		2, 6, 3, 3, 6, 7, 0, 4, 2, 2, 4, 6, 1, 3, 5, 3, 7, 5
+	});
+}
+
+HARNESS_TEST(OcclusionRasterizerHidesBoxesBehindOccluders) {
+	OcclusionRasterizer rasterizer;
+	addWall(rasterizer, 0.5f, 0.5f);
+	WorkerPool workers;
+	for (auto pool : { static_cast<WorkerPool *>(nullptr), &workers }) {
+		rasterizer.Render(glm::mat4(1.0f), pool);
+
+		// The wall spans the middle half of the buffer both ways, at its own depth.
+		uint32_t covered = 0;
+		for (uint32_t i = 0; i < OcclusionRasterizer::Width * OcclusionRasterizer::Height; i++) {
+			if (rasterizer.Depth()[i] < 1.0f) {
+				HARNESS_CHECK(std::fabs(rasterizer.Depth()[i] - 0.5f) < 1e-5f);
+				covered++;
+			}
+		}
+		HARNESS_CHECK(covered == OcclusionRasterizer::Width * OcclusionRasterizer::Height / 4);
+
+		HARNESS_CHECK(!rasterizer.IsVisible(testBox(-0.2f, -0.2f, 0.7f, 0.2f, 0.2f, 0.8f)));
+		HARNESS_CHECK(rasterizer.IsVisible(testBox(-0.2f, -0.2f, 0.2f, 0.2f, 0.2f, 0.3f)));
+		// Partly beside the wall, partly behind it.
+		HARNESS_CHECK(rasterizer.IsVisible(testBox(0.4f, -0.2f, 0.7f, 0.7f, 0.2f, 0.8f)));
+		// Reaching in front of the near plane.
+		HARNESS_CHECK(rasterizer.IsVisible(testBox(-0.2f, -0.2f, -0.1f, 0.2f, 0.2f, 0.8f)));
+		HARNESS_CHECK(!rasterizer.IsVisible(testBox(2.0f, 2.0f, 0.7f, 3.0f, 3.0f, 0.8f)));
+	}
+}
+
+HARNESS_TEST(OcclusionRasterizerPoolMatchesSerial) {
+	std::mt19937 random(7);
+	std::uniform_real_distribution<float> across(-1.2f, 1.2f);
+	std::uniform_real_distribution<float> depth(0.0f, 1.0f);
+	OcclusionRasterizer serial, pooled;
+	for (int occluder = 0; occluder < 64; occluder++) {
+		std::vector<glm::vec3> positions;
+		for (int corner = 0; corner < 3; corner++) {
+			positions.push_back(glm::vec3(across(random), across(random), depth(random)));
+		}
+		serial.AddOccluder(positions, { 0, 1, 2 });
+		pooled.AddOccluder(positions, { 0, 1, 2 });
+	}
+
+	WorkerPool workers;
+	serial.Render(glm::mat4(1.0f));
+	pooled.Render(glm::mat4(1.0f), &workers);
+	auto texels = OcclusionRasterizer::Width * OcclusionRasterizer::Height;
+	HARNESS_CHECK(std::equal(serial.Depth(), serial.Depth() + texels, pooled.Depth()));
+}
+
+HARNESS_TEST(SubmitVisibleSkipsOccludedEntities) {
+	TransformHierarchy transforms;
+	EntityRegistry registry;
+	OcclusionRasterizer rasterizer;
+	MaterialTemplate materialTemplate = {};
+	MaterialInstance material = { &materialTemplate, {}, 0 };
+	Mesh mesh = {};
+
+	// A wall, one small entity straight behind it and one beside it. The wall's mesh sits behind both, its transform
+	// moves it in front of them, so the first is only hidden once UpdateOccluders has placed it. The wall is drawn too,
+	// with bounds that round to just behind its own depth.
+	auto wall = registry.Create();
+	registry.Add(wall, TransformComponent{ transforms.Create(glm::mat4(1.0f)) });
+	registry.Add(wall, OccluderComponent{ addWall(rasterizer, 0.5f, 0.95f) });
+	registry.Add(wall, MeshComponent{ &mesh });
+	registry.Add(wall, MaterialComponent{ &material, 0 });
+	registry.Add(wall, BoundsComponent{ { glm::vec4(0.0f, 0.0f, 0.96f, 0.005f) }, {} });
+	auto spheres = { glm::vec4(0.0f, 0.0f, 0.8f, 0.1f), glm::vec4(0.8f, 0.0f, 0.8f, 0.1f) };
+	for (auto & sphere : spheres) {
+		auto entity = registry.Create();
+		registry.Add(entity, TransformComponent{ transforms.Create(glm::mat4(1.0f)) });
+		registry.Add(entity, MeshComponent{ &mesh });
+		registry.Add(entity, MaterialComponent{ &material, 0 });
+		registry.Add(entity, BoundsComponent{ { sphere }, {} });
+	}
+	glm::mat4 wallWorld(1.0f);
+	wallWorld[3] = glm::vec4(0.0f, 0.0f, -0.45f, 1.0f);
+	transforms.SetLocal(registry.Get<TransformComponent>(wall).node, wallWorld);
+	transforms.Update();
+	UpdateWorldBounds(registry, transforms);
+	UpdateOccluders(registry, transforms, rasterizer);
+	rasterizer.Render(glm::mat4(1.0f));
+
+	FrustumCuller culler;
+	std::vector<Entity> entities;
+	GatherCullingBounds(registry, culler, entities);
+	std::vector<uint32_t> all = { 0, 1, 2 };
+	RenderQueue queue;
+	auto depth = ViewDepth::FromView(glm::mat4(1.0f), 0.0f, 1.0f);
+	SubmitVisible(registry, queue, depth, all, entities, &rasterizer);
+	queue.Sort();
+	std::vector<uint32_t> expected = { entities[0].index, entities[2].index };
+	auto instances = queue.Instances();
+	std::sort(instances.begin(), instances.end());
+	HARNESS_CHECK(entities[0] == wall && instances == expected);
+
+	queue.Clear();
+	SubmitVisible(registry, queue, depth, all, entities);
+	queue.Sort();
+	HARNESS_CHECK(queue.Instances().size() == 3);
+}
+
+HARNESS_BENCHMARK(OcclusionRasterizerTimes) {
+	auto viewProjection = testViewProjection(1.0f, 1.5f, 0.5f, 50.0f);
+	WorkerPool workers;
+	// Cubes scattered in front of the test camera, overlapping each other and the spheres' volume.
+	std::mt19937 random(3);
+	std::uniform_real_distribution<float> across(-15.0f, 15.0f), ahead(-40.0f, -8.0f);
+	for (size_t occluders : { 16, 64, 256 }) {
+		OcclusionRasterizer rasterizer;
+		for (size_t i = 0; i < occluders; i++) {
+			glm::mat4 world(1.0f);
+			world[0][0] = world[1][1] = world[2][2] = 4.0f;
+			world[3] = glm::vec4(across(random), across(random), ahead(random), 1.0f);
+			rasterizer.SetTransform(addCube(rasterizer), world);
+		}
+
+		std::cout << " " << occluders << " occluders, " << occluders * 12 << " triangles" << std::endl;
+		auto serial = bestMilliseconds([&]() { rasterizer.Render(viewProjection); harnessSink += static_cast<uint64_t>(rasterizer.Depth()[0]); }, 10);
+		printTiming("render", occluders * 12, serial);
+		auto pooled = bestMilliseconds([&]() { rasterizer.Render(viewProjection, &workers); harnessSink += static_cast<uint64_t>(rasterizer.Depth()[0]); }, 10);
+		printTiming("render on the worker pool", occluders * 12, pooled, serial);
+
+		// Only what the frustum keeps reaches the occlusion test.
+		std::vector<BoundingSphere> spheres;
+		auto frustum = Frustum::FromViewProjection(viewProjection);
+		for (auto & sphere : randomSpheres(400000, 9)) {
+			if (frustum.Intersects(sphere)) spheres.push_back(sphere);
+		}
+		size_t hidden = 0;
+		auto tests = bestMilliseconds([&]() {
+			hidden = 0;
+			for (auto & sphere : spheres) {
+				hidden += rasterizer.IsVisible(sphere) ? 0 : 1;
+			}
+			harnessSink += hidden;
+		});
+		printTiming("test bounds (" + std::to_string(hidden) + " hidden)", spheres.size(), tests);
+	}
+}
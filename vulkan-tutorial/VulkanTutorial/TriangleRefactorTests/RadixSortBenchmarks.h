@@ -0,0 +1,129 @@
+#pragma once
+#include "Harness.h"
+
+#include <random>
+#include <utility>
+#include <Systems\Sorting\RadixSort.h>
+#include <Systems\Rendering\RenderQueue.h>
+
+// Few distinct keys, so the sort's stability is actually tested.
+template <typename Key> static std::vector<Key> randomSortKeys(size_t count, uint32_t seed) {
+	std::mt19937_64 random(seed);
+	std::vector<Key> keys(count);
+	for (auto & key : keys) {
+		key = static_cast<Key>(random() % (count / 4 + 1)) * static_cast<Key>(sizeof(Key) == 8 ? 0x100000001ull : 1);
+	}
+	return keys;
+}
+
+template <typename Key> static std::vector<std::pair<Key, uint32_t>> stableSorted(const std::vector<Key> & keys) {
+	std::vector<std::pair<Key, uint32_t>> pairs(keys.size());
+	for (uint32_t i = 0; i < keys.size(); i++) {
+		pairs[i] = { keys[i], i };
+	}
+	std::stable_sort(pairs.begin(), pairs.end(), [](const std::pair<Key, uint32_t> & a, const std::pair<Key, uint32_t> & b) {
+		return a.first < b.first;
+	});
+	return pairs;
+}
+
+template <typename Key> static void checkRadixSort(size_t count, WorkerPool * workers) {
+	auto keys = randomSortKeys<Key>(count, static_cast<uint32_t>(count));
+	auto expected = stableSorted(keys);
+
+	std::vector<uint32_t> values(count);
+	for (uint32_t i = 0; i < count; i++) values[i] = i;
+	RadixSorter<Key> sorter;
+	sorter.Sort(keys, values, workers);
+	for (size_t i = 0; i < count; i++) {
+		HARNESS_CHECK(keys[i] == expected[i].first && values[i] == expected[i].second);
+	}
+}
+
+HARNESS_TEST(RadixSorterMatchesStableSort) {
+	WorkerPool workers;
+	// Below and above the parallel threshold, the larger one split into blocks that don't divide it evenly.
+	for (size_t count : { size_t(0), size_t(1), size_t(1000), RadixSorter<uint32_t>::ParallelThreshold * 3 + 7 }) {
+		checkRadixSort<uint32_t>(count, nullptr);
+		checkRadixSort<uint32_t>(count, &workers);
+		checkRadixSort<uint64_t>(count, nullptr);
+		checkRadixSort<uint64_t>(count, &workers);
+	}
+
+	std::vector<uint32_t> keys(8), values(7);
+	RadixSorter<uint32_t> sorter;
+	expectThrow([&]() { sorter.Sort(keys, values); }, "a payload shorter than its keys");
+}
+
+HARNESS_TEST(SortableFloatKeepsOrder) {
+	float values[] = { -1e30f, -2.0f, -1.0f, -0.5f, 0.0f, 1e-30f, 0.5f, 1.0f, 3.0f, 1e30f };
+	for (size_t i = 1; i < sizeof(values) / sizeof(values[0]); i++) {
+		HARNESS_CHECK(SortableFloat(values[i - 1]) < SortableFloat(values[i]));
+	}
+}
+
+HARNESS_TEST(RenderQueueDrawsBlendedBackToFront) {
+	MaterialTemplate opaqueTemplate = {};
+	MaterialTemplate blendedTemplate = {};
+	blendedTemplate.index = 1;
+	blendedTemplate.blended = true;
+	MaterialInstance opaque = { &opaqueTemplate, {}, 0 };
+	MaterialInstance blended = { &blendedTemplate, {}, 1 };
+	Mesh mesh = {};
+
+	RenderQueue queue;
+	queue.SubmitBlended(&blended, &mesh, 0, 2.0f);
+	queue.Submit(0, &opaque, &mesh, 1, 0.9f);
+	queue.SubmitBlended(&blended, &mesh, 2, 7.5f);
+	queue.Submit(0, &opaque, &mesh, 3, 0.1f);
+	queue.SubmitBlended(&blended, &mesh, 4, -1.0f);
+	queue.Sort();
+
+	// Opaque front to back first, then every blended draw from the farthest in.
+	std::vector<uint32_t> expected = { 3, 1, 2, 0, 4 };
+	HARNESS_CHECK(queue.Instances() == expected);
+	HARNESS_CHECK(queue.Batches().size() == 2);
+	HARNESS_CHECK(queue.Batches()[1].pass == RenderQueue::BlendedPass && queue.Batches()[1].instanceCount == 3);
+}
+
+HARNESS_BENCHMARK(RadixSortTimes) {
+	WorkerPool workers;
+	RadixSorter<uint64_t> sorter;
+	for (size_t count : { 10000, 100000, 1000000 }) {
+		// Render queue keys carry a draw index along, so the baselines sort the same pairs.
+		auto keys = randomSortKeys<uint64_t>(count, 3);
+		std::vector<std::pair<uint64_t, uint32_t>> pairs(count);
+		for (uint32_t i = 0; i < count; i++) {
+			pairs[i] = { keys[i], i };
+		}
+
+		std::cout << " " << count << " keys" << std::endl;
+		std::vector<std::pair<uint64_t, uint32_t>> sortedPairs;
+		auto standard = bestMilliseconds([&]() {
+			sortedPairs = pairs;
+			std::sort(sortedPairs.begin(), sortedPairs.end());
+			harnessSink += sortedPairs[0].second;
+		});
+		printTiming("std::sort", count, standard);
+		auto stable = bestMilliseconds([&]() {
+			sortedPairs = pairs;
+			std::stable_sort(sortedPairs.begin(), sortedPairs.end(), [](const std::pair<uint64_t, uint32_t> & a, const std::pair<uint64_t, uint32_t> & b) {
+				return a.first < b.first;
+			});
+			harnessSink += sortedPairs[0].second;
+		});
+		printTiming("std::stable_sort", count, stable, standard);
+
+		std::vector<uint64_t> sortedKeys;
+		std::vector<uint32_t> values(count);
+		for (auto pool : { static_cast<WorkerPool *>(nullptr), &workers }) {
+			auto time = bestMilliseconds([&]() {
+				sortedKeys = keys;
+				for (uint32_t i = 0; i < count; i++) values[i] = i;
+				sorter.Sort(sortedKeys, values, pool);
+				harnessSink += values[0];
+			});
+			printTiming(pool ? "radix on the worker pool" : "radix", count, time, standard);
+		}
+	}
+}
@@ -0,0 +1,47 @@
+#include "Harness.h"
+#include "LoadBenchmarks.h"
+#include "GpuCullingTests.h"
+#include "FrustumCullerBenchmarks.h"
+#include "RadixSortBenchmarks.h"
+#include "OcclusionRasterizerBenchmarks.h"
+#include "BoundingVolumeHierarchyBenchmarks.h"
+#include "MeshLodTests.h"
+
+#include <cstdlib>
+#include <cstring>
+
+// Runs every test, and the benchmarks too when started with --bench. A name on the command line runs only the cases
+// whose name contains it.
+int main(int argc, char ** argv) {
+	bool benchmarks = false;
+	std::string filter;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--bench") == 0) {
+			benchmarks = true;
+		}
+		else {
+			filter = argv[i];
+		}
+	}
+
+	int failures = 0;
+	for (auto & harnessCase : harnessCases()) {
+		if (harnessCase.benchmark && !benchmarks) continue;
+		if (!filter.empty() && harnessCase.name.find(filter) == std::string::npos) continue;
+
+		std::cout << harnessCase.name << std::endl;
+		try {
+			harnessCase.run();
+		}
+		catch (const std::exception & e) {
+			std::cerr << "  FAILED: " << e.what() << std::endl;
+			failures++;
+		}
+	}
+
+	if (failures > 0) {
+		std::cerr << failures << " failed" << std::endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}